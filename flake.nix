@@ -28,6 +28,7 @@
             wayland
             wayland-protocols
             cairo
+            pixman
             pango
             json_c
             libxkbcommon
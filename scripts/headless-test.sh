@@ -0,0 +1,106 @@
+#!/usr/bin/env bash
+# Snappy Switcher Headless Capture Test
+# Runs the daemon under a headless sway (wlroots) with previews enabled,
+# moves focus between two clients under every output transform and checks
+# that each focus change lands a preview. Needs sway >= 1.10
+# (ext-image-copy-capture) and a Wayland client, foot by default.
+
+set -uo pipefail
+
+BINARY="${BINARY:-./snappy-switcher}"
+CLIENT="${CLIENT:-foot}"
+TRANSFORMS="normal 90 180 270 flipped flipped-90 flipped-180 flipped-270"
+PASS=0
+FAIL=0
+
+log() { echo "[$(date +%H:%M:%S)] $1"; }
+pass() { ((PASS++)); log "✅ PASS: $1"; }
+fail() { ((FAIL++)); log "❌ FAIL: $1"; }
+
+for cmd in sway swaymsg "$CLIENT"; do
+    command -v "$cmd" >/dev/null || { echo "Missing: $cmd"; exit 77; }
+done
+[ -x "$BINARY" ] || { echo "Build first: $BINARY not found"; exit 77; }
+# The IPC socket path is fixed: a second daemon would take the first over
+if [ -S /tmp/snappy-switcher.sock ]; then
+    echo "A snappy-switcher daemon is running; stop it first"
+    exit 77
+fi
+
+WORK=$(mktemp -d)
+export HOME="$WORK/home" XDG_RUNTIME_DIR="$WORK/run"
+export XDG_CACHE_HOME="$WORK/cache" XDG_CONFIG_HOME="$WORK/home/.config"
+mkdir -p "$HOME/.config/snappy-switcher" "$HOME/.config/sway" "$XDG_RUNTIME_DIR"
+chmod 700 "$XDG_RUNTIME_DIR"
+LOG_FILE="$WORK/daemon.log"
+
+cat > "$HOME/.config/snappy-switcher/config.ini" <<INI
+[thumbnails]
+enabled = true
+INI
+echo "output HEADLESS-1 resolution 1280x720" > "$HOME/.config/sway/config"
+
+cleanup() {
+    [ -n "${DAEMON_PID:-}" ] && kill "$DAEMON_PID" 2>/dev/null
+    [ -n "${SWAY_PID:-}" ] && kill "$SWAY_PID" 2>/dev/null
+    wait 2>/dev/null
+    rm -f /tmp/snappy-switcher.sock
+    rm -rf "$WORK"
+}
+trap cleanup EXIT
+
+WLR_BACKENDS=headless WLR_RENDERER=pixman WLR_LIBINPUT_NO_DEVICES=1 \
+    sway -c "$HOME/.config/sway/config" >"$WORK/sway.log" 2>&1 &
+SWAY_PID=$!
+for _ in $(seq 50); do
+    SWAYSOCK=$(ls "$XDG_RUNTIME_DIR"/sway-ipc.*.sock 2>/dev/null | head -1)
+    WAYLAND_DISPLAY=$(cd "$XDG_RUNTIME_DIR" && ls wayland-* 2>/dev/null |
+                      grep -v lock | head -1)
+    [ -n "$SWAYSOCK" ] && [ -n "$WAYLAND_DISPLAY" ] && break
+    sleep 0.1
+done
+if [ -z "$SWAYSOCK" ] || [ -z "$WAYLAND_DISPLAY" ]; then
+    echo "sway did not start:"; cat "$WORK/sway.log"
+    exit 1
+fi
+export SWAYSOCK WAYLAND_DISPLAY
+unset DISPLAY HYPRLAND_INSTANCE_SIGNATURE
+
+"$CLIENT" >/dev/null 2>&1 &
+"$CLIENT" >/dev/null 2>&1 &
+sleep 1
+
+"$BINARY" --daemon >"$LOG_FILE" 2>&1 &
+DAEMON_PID=$!
+sleep 1
+
+captures() { grep -c '^\[Thumbs\] Captured' "$LOG_FILE"; }
+
+for t in $TRANSFORMS; do
+    swaymsg -q output HEADLESS-1 transform "$t"
+    before=$(captures)
+    swaymsg -q focus next
+    sleep 0.5
+    swaymsg -q focus next
+    sleep 0.5
+    "$BINARY" next >/dev/null 2>&1
+    sleep 0.2
+    "$BINARY" hide >/dev/null 2>&1
+    if ! kill -0 "$DAEMON_PID" 2>/dev/null; then
+        fail "Daemon died under transform $t"
+        break
+    fi
+    if [ "$(captures)" -gt "$before" ]; then
+        pass "Preview captured under transform $t"
+    else
+        fail "No preview under transform $t"
+    fi
+done
+
+if grep -q 'No toplevel capture protocol' "$LOG_FILE"; then
+    fail "Compositor offers no capture protocol"
+fi
+
+echo ""
+log "Results: $PASS passed, $FAIL failed"
+[ "$FAIL" -eq 0 ] || { echo "Daemon log:"; cat "$LOG_FILE"; exit 1; }
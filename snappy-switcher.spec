@@ -17,6 +17,7 @@ BuildRequires:  pkgconf-pkg-config
 BuildRequires:  wayland-devel
 BuildRequires:  wayland-protocols-devel
 BuildRequires:  cairo-devel
+BuildRequires:  pixman-devel
 BuildRequires:  pango-devel
 BuildRequires:  libxkbcommon-devel
 BuildRequires:  glib2-devel
@@ -26,6 +27,7 @@ BuildRequires:  librsvg2-devel
 # Runtime dependencies
 Requires:       wayland
 Requires:       cairo
+Requires:       pixman
 Requires:       pango
 Requires:       libxkbcommon
 Requires:       glib2
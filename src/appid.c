@@ -0,0 +1,307 @@
+/* src/appid.c - App Identity from the Client Process */
+#define _POSIX_C_SOURCE 200809L
+
+#include "appid.h"
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LOG(fmt, ...) fprintf(stderr, "[AppID] " fmt "\n", ##__VA_ARGS__)
+#define APPID_BUCKETS 64
+#define APPID_MAX_ENTRIES 512 /* Dead pids and windows pile up; start over */
+#define APPID_MAX 256
+#define ENVIRON_MAX 65536
+
+typedef struct AppIdEntry {
+  int pid;
+  unsigned long long start; /* Process start time: tells pid reuse apart */
+  char *app_id;             /* NULL: no sandbox identity */
+  struct AppIdEntry *next;
+} AppIdEntry;
+
+typedef struct WindowEntry {
+  char *address;
+  int pid;
+  char *app_id;
+  struct WindowEntry *next;
+} WindowEntry;
+
+static AppIdEntry *entries[APPID_BUCKETS];
+static int entry_count = 0;
+static WindowEntry *windows[APPID_BUCKETS];
+static int window_count = 0;
+
+/* Field 22 of /proc/<pid>/stat, or 0 if the process is gone */
+static unsigned long long start_time(int pid) {
+  char path[64], buf[1024];
+  snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+  FILE *fp = fopen(path, "r");
+  if (!fp)
+    return 0;
+  size_t n = fread(buf, 1, sizeof(buf) - 1, fp);
+  fclose(fp);
+  buf[n] = '\0';
+
+  /* comm may contain spaces and parens: fields restart after the last ')' */
+  char *p = strrchr(buf, ')');
+  if (!p)
+    return 0;
+  for (int field = 2; field < 22 && p; field++)
+    p = strchr(p + 1, ' ');
+  return p ? strtoull(p + 1, NULL, 10) : 0;
+}
+
+static bool valid_id(const char *id) {
+  if (!id[0])
+    return false;
+  for (const char *c = id; *c; c++) {
+    if (!isalnum((unsigned char)*c) && !strchr("._-", *c))
+      return false;
+  }
+  return true;
+}
+
+/* [Application] name= from the instance info Flatpak mounts at / */
+static bool from_flatpak_info(int pid, char *out, size_t size) {
+  char path[64], line[512];
+  snprintf(path, sizeof(path), "/proc/%d/root/.flatpak-info", pid);
+  FILE *fp = fopen(path, "r");
+  if (!fp)
+    return false;
+
+  bool in_app = false, found = false;
+  while (!found && fgets(line, sizeof(line), fp)) {
+    line[strcspn(line, "\r\n")] = '\0';
+    if (line[0] == '[')
+      in_app = strcmp(line, "[Application]") == 0;
+    else if (in_app && strncmp(line, "name=", 5) == 0)
+      found = snprintf(out, size, "%s", line + 5) < (int)size;
+  }
+  fclose(fp);
+  return found && valid_id(out);
+}
+
+/* Undo systemd unit name escaping ("\x2d" for '-') in place */
+static void unescape_unit(char *s) {
+  char *w = s;
+  for (char *r = s; *r; r++) {
+    unsigned int c;
+    if (r[0] == '\\' && r[1] == 'x' && isxdigit((unsigned char)r[2]) &&
+        isxdigit((unsigned char)r[3]) && sscanf(r + 2, "%2x", &c) == 1) {
+      *w++ = (char)c;
+      r += 3;
+    } else {
+      *w++ = *r;
+    }
+  }
+  *w = '\0';
+}
+
+static bool is_uuid(const char *s) {
+  for (int i = 0; i < 36; i++) {
+    bool dash = i == 8 || i == 13 || i == 18 || i == 23;
+    if (dash ? s[i] != '-' : !isxdigit((unsigned char)s[i]))
+      return false;
+  }
+  return s[36] == '\0';
+}
+
+/*
+ * Sandboxed launches get their own scope: "app-flatpak-<id>-<n>.scope"
+ * and "snap.<snap>.<app>-<uuid>.scope" (desktop ID "<snap>_<app>"). The
+ * generic "app-<launcher>-<id>-<n>.scope" of other launches is ignored:
+ * processes started from a terminal inherit the terminal's.
+ */
+static bool parse_scope(char *unit, char *out, size_t size) {
+  size_t len = strlen(unit);
+  if (len < 7 || strcmp(unit + len - 6, ".scope") != 0)
+    return false;
+  unit[len - 6] = '\0';
+
+  if (strncmp(unit, "app-flatpak-", 12) == 0) {
+    char *id = unit + 12;
+    char *dash = strrchr(id, '-');
+    if (!dash || !dash[1] ||
+        strspn(dash + 1, "0123456789") != strlen(dash + 1))
+      return false;
+    *dash = '\0';
+    unescape_unit(id);
+    snprintf(out, size, "%s", id);
+    return valid_id(out);
+  }
+
+  if (strncmp(unit, "snap.", 5) == 0) {
+    char *snap = unit + 5;
+    char *app = strchr(snap, '.');
+    if (!app)
+      return false;
+    *app++ = '\0';
+    /* The suffix is a UUID (app names may contain '-' too) */
+    size_t n = strlen(app);
+    char *dash = n > 37 && is_uuid(app + n - 36) ? app + n - 37
+                                                  : strrchr(app, '-');
+    if (!dash || *dash != '-')
+      return false;
+    *dash = '\0';
+    snprintf(out, size, "%s_%s", snap, app);
+    return valid_id(out);
+  }
+  return false;
+}
+
+/* Last path component of each /proc/<pid>/cgroup line */
+static bool from_cgroup(int pid, char *out, size_t size) {
+  char path[64], line[1024];
+  snprintf(path, sizeof(path), "/proc/%d/cgroup", pid);
+  FILE *fp = fopen(path, "r");
+  if (!fp)
+    return false;
+
+  bool found = false;
+  while (!found && fgets(line, sizeof(line), fp)) {
+    line[strcspn(line, "\r\n")] = '\0';
+    char *unit = strrchr(line, '/');
+    found = unit && parse_scope(unit + 1, out, size);
+  }
+  fclose(fp);
+  return found;
+}
+
+/* FLATPAK_ID from the environment (NUL-separated) */
+static bool from_environ(int pid, char *out, size_t size) {
+  char path[64];
+  snprintf(path, sizeof(path), "/proc/%d/environ", pid);
+  FILE *fp = fopen(path, "r");
+  if (!fp)
+    return false;
+
+  char *buf = malloc(ENVIRON_MAX);
+  size_t n = buf ? fread(buf, 1, ENVIRON_MAX - 1, fp) : 0;
+  fclose(fp);
+  if (!buf)
+    return false;
+  buf[n] = '\0';
+
+  bool found = false;
+  for (size_t i = 0; i < n && !found; i += strlen(buf + i) + 1) {
+    if (strncmp(buf + i, "FLATPAK_ID=", 11) == 0) {
+      found = snprintf(out, size, "%s", buf + i + 11) < (int)size &&
+              valid_id(out);
+    }
+  }
+  free(buf);
+  return found;
+}
+
+static char *resolve(int pid) {
+  char id[APPID_MAX];
+  if (from_flatpak_info(pid, id, sizeof(id)) ||
+      from_cgroup(pid, id, sizeof(id)) ||
+      from_environ(pid, id, sizeof(id))) {
+    LOG("pid %d -> %s", pid, id);
+    return strdup(id);
+  }
+  return NULL;
+}
+
+const char *appid_for_pid(int pid) {
+  if (pid <= 0)
+    return NULL;
+  unsigned long long start = start_time(pid);
+  if (!start)
+    return NULL;
+
+  AppIdEntry **link = &entries[(unsigned)pid % APPID_BUCKETS];
+  for (AppIdEntry *e = *link; e; e = e->next) {
+    if (e->pid != pid)
+      continue;
+    if (e->start != start) {
+      /* Same pid, different process */
+      free(e->app_id);
+      e->app_id = resolve(pid);
+      e->start = start;
+    }
+    return e->app_id;
+  }
+
+  if (entry_count >= APPID_MAX_ENTRIES)
+    appid_cleanup();
+  AppIdEntry *e = malloc(sizeof(AppIdEntry));
+  if (!e)
+    return NULL;
+  e->pid = pid;
+  e->start = start;
+  e->app_id = resolve(pid);
+  e->next = *link;
+  *link = e;
+  entry_count++;
+  return e->app_id;
+}
+
+static unsigned hash_address(const char *s) {
+  unsigned h = 5381;
+  while (*s)
+    h = h * 33 + (unsigned char)*s++;
+  return h % APPID_BUCKETS;
+}
+
+static void free_windows(void) {
+  for (int i = 0; i < APPID_BUCKETS; i++) {
+    WindowEntry *w = windows[i];
+    while (w) {
+      WindowEntry *next = w->next;
+      free(w->address);
+      free(w->app_id);
+      free(w);
+      w = next;
+    }
+    windows[i] = NULL;
+  }
+  window_count = 0;
+}
+
+const char *appid_for_window(const char *address, int pid) {
+  if (!address || pid <= 0)
+    return NULL;
+  WindowEntry **link = &windows[hash_address(address)];
+  for (WindowEntry *w = *link; w; w = w->next) {
+    if (w->pid == pid && strcmp(w->address, address) == 0)
+      return w->app_id;
+  }
+
+  const char *app_id = appid_for_pid(pid);
+  if (window_count >= APPID_MAX_ENTRIES) {
+    free_windows();
+    link = &windows[hash_address(address)];
+  }
+  WindowEntry *w = calloc(1, sizeof(WindowEntry));
+  if (!w || !(w->address = strdup(address)) ||
+      (app_id && !(w->app_id = strdup(app_id)))) {
+    if (w)
+      free(w->address);
+    free(w);
+    return app_id;
+  }
+  w->pid = pid;
+  w->next = *link;
+  *link = w;
+  window_count++;
+  return w->app_id;
+}
+
+void appid_cleanup(void) {
+  free_windows();
+  for (int i = 0; i < APPID_BUCKETS; i++) {
+    AppIdEntry *e = entries[i];
+    while (e) {
+      AppIdEntry *next = e->next;
+      free(e->app_id);
+      free(e);
+      e = next;
+    }
+    entries[i] = NULL;
+  }
+  entry_count = 0;
+}
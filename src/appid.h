@@ -0,0 +1,25 @@
+/* src/appid.h - App Identity from the Client Process */
+#ifndef APPID_H
+#define APPID_H
+
+/*
+ * Sandboxed apps often report a generic WM class ("firefox", "Code",
+ * "java"), while their sandbox knows the exact desktop file ID. For a
+ * client pid this reads it from /proc: the Flatpak instance info, the
+ * Flatpak or Snap systemd scope in the cgroup path, then FLATPAK_ID in
+ * the environment. Unsandboxed processes have none.
+ */
+
+/* Desktop file ID (without ".desktop") of the app owning pid, or NULL.
+ * Cached per process, so a recycled pid is looked up again. Copy the
+ * string: a later call may free it. Main thread only. */
+const char *appid_for_pid(int pid);
+
+/* Same for a window's client. A window keeps its pid for life, so a
+ * window seen before is answered from memory, without reading /proc. */
+const char *appid_for_window(const char *address, int pid);
+
+/* Drop the cache */
+void appid_cleanup(void);
+
+#endif /* APPID_H */
@@ -15,13 +15,17 @@ static Backend backends[] = {{.type = BACKEND_HYPRLAND,
                               .cleanup = hyprland_backend_cleanup,
                               .get_windows = update_window_list,
                               .activate_window = switch_to_window,
-                              .get_name = hyprland_get_name},
+                              .get_name = hyprland_get_name,
+                              .get_event_fd = hyprland_get_event_fd,
+                              .dispatch_events = hyprland_dispatch_events},
                              {.type = BACKEND_WLR,
                               .init = wlr_backend_init,
                               .cleanup = wlr_backend_cleanup,
                               .get_windows = wlr_get_windows,
                               .activate_window = wlr_activate_window,
-                              .get_name = wlr_get_name}};
+                              .get_name = wlr_get_name,
+                              .get_event_fd = wlr_get_event_fd,
+                              .dispatch_events = wlr_dispatch_events}};
 
 static Backend *current_backend = NULL;
 
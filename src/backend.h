@@ -8,6 +8,25 @@
 /* Backend types */
 typedef enum { BACKEND_HYPRLAND, BACKEND_WLR, BACKEND_UNKNOWN } BackendType;
 
+/* Window list changes reported while the daemon runs */
+typedef enum {
+  WINDOW_EVENT_OPEN,
+  WINDOW_EVENT_CLOSE,
+  WINDOW_EVENT_TITLE,
+  WINDOW_EVENT_FOCUS, /* Window gained focus (title/class may be NULL) */
+  WINDOW_EVENT_RESYNC /* Change the backend can't describe: re-fetch */
+} WindowEventType;
+
+typedef struct {
+  WindowEventType type;
+  const char *address;    /* Same format as WindowInfo.address */
+  const char *title;      /* OPEN, TITLE, FOCUS (wlr) */
+  const char *class_name; /* OPEN, FOCUS (wlr) */
+  int workspace_id;       /* OPEN */
+} WindowEvent;
+
+typedef void (*WindowEventHandler)(const WindowEvent *event);
+
 /* Backend function pointers */
 typedef struct {
   BackendType type;
@@ -16,6 +35,9 @@ typedef struct {
   int (*get_windows)(AppState *state, Config *config);
   void (*activate_window)(const char *identifier);
   const char *(*get_name)(void);
+  /* Live updates (optional): fd to poll for change events, or -1 */
+  int (*get_event_fd)(void);
+  void (*dispatch_events)(WindowEventHandler handler);
 } Backend;
 
 /* Initialize backend system, auto-detects which backend to use */
@@ -0,0 +1,487 @@
+/* src/bench.c - Headless Render Benchmark & Golden-Image Checks */
+#define _POSIX_C_SOURCE 200809L
+
+#include "bench.h"
+#include "config.h"
+#include "data.h"
+#include "icons.h"
+#include "render.h"
+#include "scale.h"
+#include "util.h"
+#include <cairo/cairo.h>
+#include <dirent.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#define LOG(fmt, ...) fprintf(stderr, "[Bench] " fmt "\n", ##__VA_ARGS__)
+
+#define BENCH_OUTPUT_HEIGHT 1080 /* Panel height cap as on a 1080p output */
+#define DEFAULT_FRAMES 30
+#define MAX_THEMES 64
+#define GOLDEN_TOLERANCE 2 /* Max per-channel difference (PNG round trip) */
+
+static const int window_counts[] = {1, 6, 20, 50, 100, 200, 500};
+#define NUM_WINDOW_COUNTS (sizeof(window_counts) / sizeof(window_counts[0]))
+
+/* Deliberately unresolvable classes: cards use letter icons, so goldens
+ * don't depend on the icon themes installed on the host */
+static const char *bench_classes[] = {
+    "bench-alpha", "bench-bravo", "bench-charlie", "bench-delta",
+    "bench-echo",  "bench-fox",   "bench-golf",    "bench-hotel",
+};
+#define NUM_BENCH_CLASSES (sizeof(bench_classes) / sizeof(bench_classes[0]))
+
+typedef struct {
+  const char *themes_dir;
+  const char *out_dir;
+  const char *golden_dir;
+  bool update_golden;
+  int frames;
+  double scale;
+  int threads;
+} BenchOptions;
+
+static int compare_double(const void *a, const void *b) {
+  double da = *(const double *)a;
+  double db = *(const double *)b;
+  return (da > db) - (da < db);
+}
+
+static int compare_str(const void *a, const void *b) {
+  return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static double percentile(const double *sorted, int n, double p) {
+  int idx = (int)(p * (n - 1) + 0.5);
+  return sorted[idx];
+}
+
+/* Synthetic MRU list: every fifth card is a context-mode group */
+static void build_snapshot(AppState *state, int count) {
+  app_state_init(state);
+  for (int i = 0; i < count; i++) {
+    char buf[64];
+    WindowInfo info;
+    memset(&info, 0, sizeof(info));
+
+    snprintf(buf, sizeof(buf), "0xbench%04x", i);
+    info.address = strdup(buf);
+    snprintf(buf, sizeof(buf), "Synthetic window %d", i + 1);
+    info.title = strdup(buf);
+    info.class_name = strdup(bench_classes[i % NUM_BENCH_CLASSES]);
+    info.workspace_id = i / 4 + 1;
+    info.focus_history_id = i;
+    info.is_active = (i == 0);
+    info.group_count = (i % 5 == 2) ? 3 : 1;
+
+    if (app_state_add(state, &info) < 0)
+      window_info_free(&info);
+  }
+  state->selected_index = (count > 1) ? 1 : 0;
+}
+
+/* Pixels differing beyond tolerance, or -1 if the golden is unusable */
+static long compare_golden(cairo_surface_t *img, const char *path) {
+  cairo_surface_t *golden = cairo_image_surface_create_from_png(path);
+  if (cairo_surface_status(golden) != CAIRO_STATUS_SUCCESS) {
+    cairo_surface_destroy(golden);
+    return -1;
+  }
+
+  int w = cairo_image_surface_get_width(img);
+  int h = cairo_image_surface_get_height(img);
+  if (cairo_image_surface_get_width(golden) != w ||
+      cairo_image_surface_get_height(golden) != h) {
+    cairo_surface_destroy(golden);
+    return -1;
+  }
+
+  cairo_surface_flush(golden);
+  const unsigned char *a = cairo_image_surface_get_data(img);
+  const unsigned char *b = cairo_image_surface_get_data(golden);
+  int sa = cairo_image_surface_get_stride(img);
+  int sb = cairo_image_surface_get_stride(golden);
+  /* Opaque PNGs load as RGB24: ignore the (undefined) alpha byte then */
+  int channels =
+      cairo_image_surface_get_format(golden) == CAIRO_FORMAT_RGB24 ? 3 : 4;
+
+  long diff = 0;
+  for (int y = 0; y < h; y++) {
+    const unsigned char *ra = a + (size_t)y * sa;
+    const unsigned char *rb = b + (size_t)y * sb;
+    for (int x = 0; x < w; x++) {
+      for (int c = 0; c < channels; c++) {
+        int d = ra[x * 4 + c] - rb[x * 4 + c];
+        if (d > GOLDEN_TOLERANCE || d < -GOLDEN_TOLERANCE) {
+          diff++;
+          break;
+        }
+      }
+    }
+  }
+
+  cairo_surface_destroy(golden);
+  return diff;
+}
+
+static int list_themes(const char *dir, char **names, int max) {
+  DIR *d = opendir(dir);
+  if (!d)
+    return -1;
+
+  int n = 0;
+  struct dirent *entry;
+  while ((entry = readdir(d)) != NULL && n < max) {
+    size_t len = strlen(entry->d_name);
+    if (len > 4 && strcmp(entry->d_name + len - 4, ".ini") == 0)
+      names[n++] = strdup(entry->d_name);
+  }
+  closedir(d);
+
+  qsort(names, n, sizeof(char *), compare_str);
+  return n;
+}
+
+/* Benchmark one theme across all window counts; returns failure count */
+static int bench_theme(const BenchOptions *opt, const char *theme_file) {
+  char path[1024];
+  snprintf(path, sizeof(path), "%s/%s", opt->themes_dir, theme_file);
+
+  Config *cfg = load_theme_config(path);
+  if (!cfg) {
+    LOG("Cannot read theme: %s", path);
+    return 1;
+  }
+
+  char theme[256];
+  snprintf(theme, sizeof(theme), "%s", theme_file);
+  theme[strlen(theme) - 4] = '\0'; /* Strip .ini */
+
+  render_set_config(cfg);
+  icons_init(cfg->icon_theme, cfg->icon_fallback);
+  icons_set_config(cfg);
+
+  /* Non-1x runs get their own goldens: theme-20@1.5x.png */
+  char suffix[16] = "";
+  if (opt->scale != 1.0)
+    snprintf(suffix, sizeof(suffix), "@%gx", opt->scale);
+
+  int failures = 0;
+  double *times = malloc(sizeof(double) * opt->frames);
+  if (!times) {
+    free_config(cfg);
+    return 1;
+  }
+
+  for (size_t c = 0; c < NUM_WINDOW_COUNTS; c++) {
+    AppState state;
+    build_snapshot(&state, window_counts[c]);
+
+    uint32_t width, height, pw, ph;
+    calculate_dimensions(&state, &width, &height);
+    render_buffer_size(width, height, &pw, &ph);
+    int stride = cairo_format_stride_for_width(CAIRO_FORMAT_ARGB32, pw);
+    unsigned char *data = malloc((size_t)stride * ph);
+    if (!data) {
+      app_state_free(&state);
+      failures++;
+      continue;
+    }
+
+    /* Warm-up frame fills icon/mask caches, like a daemon's second show */
+    render_snapshot(&state, data, width, height, stride, true);
+    for (int f = 0; f < opt->frames; f++) {
+      double t0 = now_ms();
+      render_snapshot(&state, data, width, height, stride, true);
+      times[f] = now_ms() - t0;
+    }
+    qsort(times, opt->frames, sizeof(double), compare_double);
+
+    cairo_surface_t *img = cairo_image_surface_create_for_data(
+        data, CAIRO_FORMAT_ARGB32, pw, ph, stride);
+
+    char file[1024];
+    if (opt->out_dir) {
+      snprintf(file, sizeof(file), "%s/%s-%d%s.png", opt->out_dir, theme,
+               window_counts[c], suffix);
+      cairo_surface_write_to_png(img, file);
+    }
+
+    const char *verdict = "-";
+    if (opt->golden_dir) {
+      snprintf(file, sizeof(file), "%s/%s-%d%s.png", opt->golden_dir, theme,
+               window_counts[c], suffix);
+      if (opt->update_golden) {
+        verdict = cairo_surface_write_to_png(img, file) == CAIRO_STATUS_SUCCESS
+                      ? "updated"
+                      : "WRITE FAILED";
+      } else {
+        long diff = compare_golden(img, file);
+        if (diff == 0) {
+          verdict = "ok";
+        } else {
+          verdict = diff < 0 ? "MISSING" : "MISMATCH";
+          failures++;
+        }
+        if (diff > 0)
+          LOG("%s: %ld pixels differ", file, diff);
+      }
+    }
+
+    printf("%-20s %5d  %4ux%-5u %8.3f %8.3f %8.3f %8.3f  %s\n", theme,
+           window_counts[c], pw, ph, percentile(times, opt->frames, 0.5),
+           percentile(times, opt->frames, 0.9),
+           percentile(times, opt->frames, 0.99), times[opt->frames - 1],
+           verdict);
+
+    cairo_surface_destroy(img);
+    free(data);
+    app_state_free(&state);
+  }
+
+  free(times);
+  render_set_config(NULL);
+  free_config(cfg);
+  return failures;
+}
+
+static void bench_usage(void) {
+  fprintf(stderr,
+          "Usage: snappy-switcher --render-bench [--themes DIR] [--out DIR]\n"
+          "                       [--golden DIR [--update-golden]] "
+          "[--frames N] [--scale S]\n"
+          "                       [--threads N]\n");
+}
+
+int run_render_bench(int argc, char **argv) {
+  BenchOptions opt = {.themes_dir = NULL,
+                      .out_dir = NULL,
+                      .golden_dir = NULL,
+                      .update_golden = false,
+                      .frames = DEFAULT_FRAMES,
+                      .scale = 1.0,
+                      .threads = -1};
+
+  for (int i = 0; i < argc; i++) {
+    bool has_val = i + 1 < argc;
+    if (strcmp(argv[i], "--themes") == 0 && has_val)
+      opt.themes_dir = argv[++i];
+    else if (strcmp(argv[i], "--out") == 0 && has_val)
+      opt.out_dir = argv[++i];
+    else if (strcmp(argv[i], "--golden") == 0 && has_val)
+      opt.golden_dir = argv[++i];
+    else if (strcmp(argv[i], "--frames") == 0 && has_val)
+      opt.frames = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--scale") == 0 && has_val)
+      opt.scale = atof(argv[++i]);
+    else if (strcmp(argv[i], "--threads") == 0 && has_val)
+      opt.threads = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--update-golden") == 0)
+      opt.update_golden = true;
+    else {
+      bench_usage();
+      return 1;
+    }
+  }
+  if (opt.frames < 1)
+    opt.frames = 1;
+  if (opt.scale <= 0)
+    opt.scale = 1.0;
+
+  struct stat st;
+  if (!opt.themes_dir)
+    opt.themes_dir = stat("themes", &st) == 0 && S_ISDIR(st.st_mode)
+                         ? "themes"
+                         : "/usr/share/snappy-switcher/themes";
+
+  if (opt.out_dir && mkdir(opt.out_dir, 0755) < 0 && errno != EEXIST) {
+    LOG("Cannot create output dir %s: %s", opt.out_dir, strerror(errno));
+    return 1;
+  }
+  if (opt.golden_dir && opt.update_golden &&
+      mkdir(opt.golden_dir, 0755) < 0 && errno != EEXIST) {
+    LOG("Cannot create golden dir %s: %s", opt.golden_dir, strerror(errno));
+    return 1;
+  }
+
+  char *themes[MAX_THEMES];
+  int n = list_themes(opt.themes_dir, themes, MAX_THEMES);
+  if (n <= 0) {
+    LOG("No themes found in %s", opt.themes_dir);
+    return 1;
+  }
+
+  render_set_output_height(BENCH_OUTPUT_HEIGHT);
+  render_set_scale((int)(opt.scale * 120 + 0.5));
+  render_set_threads(opt.threads);
+
+  printf("%-20s %5s  %-10s %8s %8s %8s %8s  %s\n", "theme", "wins", "size",
+         "p50 ms", "p90 ms", "p99 ms", "max ms", "golden");
+
+  int failures = 0;
+  for (int i = 0; i < n; i++) {
+    failures += bench_theme(&opt, themes[i]);
+    free(themes[i]);
+  }
+
+  render_cleanup();
+  icons_cleanup();
+
+  if (failures > 0) {
+    printf("%d check(s) failed\n", failures);
+    return 1;
+  }
+  return 0;
+}
+
+/* --- Downscaler benchmark --- */
+
+typedef struct {
+  const char *name;
+  int sw, sh, dw, dh;
+  cairo_filter_t filter; /* What the cairo path used for this case */
+} ScaleCase;
+
+static const ScaleCase scale_cases[] = {
+    {"icon 128->48", 128, 128, 48, 48, CAIRO_FILTER_BEST},
+    {"icon 256->56", 256, 256, 56, 56, CAIRO_FILTER_BEST},
+    {"icon 512->84", 512, 512, 84, 84, CAIRO_FILTER_BEST},
+    {"preview 1080p", 1920, 1080, 240, 135, CAIRO_FILTER_GOOD},
+    {"preview 4k", 3840, 2160, 320, 180, CAIRO_FILTER_GOOD},
+};
+#define NUM_SCALE_CASES (sizeof(scale_cases) / sizeof(scale_cases[0]))
+
+static const ScaleIsa scale_isas[] = {SCALE_SCALAR, SCALE_SSE2, SCALE_AVX2,
+                                      SCALE_NEON};
+#define NUM_SCALE_ISAS (sizeof(scale_isas) / sizeof(scale_isas[0]))
+
+/* Premultiplied gradients with some noise, the same on every run */
+static cairo_surface_t *scale_source(int w, int h) {
+  cairo_surface_t *s = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, w, h);
+  cairo_surface_flush(s);
+  unsigned char *data = cairo_image_surface_get_data(s);
+  int stride = cairo_image_surface_get_stride(s);
+  uint32_t seed = 12345;
+  for (int y = 0; y < h; y++) {
+    uint32_t *row = (uint32_t *)(data + (size_t)y * stride);
+    for (int x = 0; x < w; x++) {
+      seed = seed * 1103515245u + 12345u;
+      uint32_t a = (x * 255 / w + (seed >> 28)) & 0xff;
+      uint32_t r = a * (y * 255 / h) / 255;
+      uint32_t g = a * ((seed >> 16) & 0xff) / 255;
+      uint32_t b = a * (255 - x * 255 / w) / 255;
+      row[x] = a << 24 | r << 16 | g << 8 | b;
+    }
+  }
+  cairo_surface_mark_dirty(s);
+  return s;
+}
+
+static void scale_with_cairo(cairo_surface_t *src, cairo_surface_t *dst,
+                             const ScaleCase *sc) {
+  cairo_t *cr = cairo_create(dst);
+  cairo_scale(cr, (double)sc->dw / sc->sw, (double)sc->dh / sc->sh);
+  cairo_set_source_surface(cr, src, 0, 0);
+  cairo_pattern_set_filter(cairo_get_source(cr), sc->filter);
+  cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
+  cairo_paint(cr);
+  cairo_destroy(cr);
+  cairo_surface_flush(dst);
+}
+
+static double scale_median(double *times, int n) {
+  qsort(times, n, sizeof(double), compare_double);
+  return percentile(times, n, 0.5);
+}
+
+static void scale_bench_usage(void) {
+  fprintf(stderr, "Usage: snappy-switcher --scale-bench [--frames N]\n");
+}
+
+int run_scale_bench(int argc, char **argv) {
+  int frames = DEFAULT_FRAMES;
+  for (int i = 0; i < argc; i++) {
+    if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+      frames = atoi(argv[++i]);
+    else {
+      scale_bench_usage();
+      return 1;
+    }
+  }
+  if (frames < 1)
+    frames = 1;
+
+  double *times = malloc(sizeof(double) * frames);
+  if (!times)
+    return 1;
+
+  ScaleIsa default_isa = scale_get_isa();
+  printf("Median ms per reduction (kernel default: %s)\n",
+         scale_isa_name(default_isa));
+  printf("%-16s %8s", "case", "cairo");
+  for (size_t k = 0; k < NUM_SCALE_ISAS; k++)
+    printf(" %8s", scale_isa_name(scale_isas[k]));
+  printf("\n");
+
+  int failures = 0;
+  for (size_t c = 0; c < NUM_SCALE_CASES; c++) {
+    const ScaleCase *sc = &scale_cases[c];
+    cairo_surface_t *src = scale_source(sc->sw, sc->sh);
+    cairo_surface_t *dst =
+        cairo_image_surface_create(CAIRO_FORMAT_ARGB32, sc->dw, sc->dh);
+    unsigned char *in = cairo_image_surface_get_data(src);
+    int in_stride = cairo_image_surface_get_stride(src);
+    unsigned char *out = cairo_image_surface_get_data(dst);
+    int out_stride = cairo_image_surface_get_stride(dst);
+    size_t out_len = (size_t)out_stride * sc->dh;
+    unsigned char *reference = malloc(out_len);
+
+    for (int f = 0; f < frames; f++) {
+      double t0 = now_ms();
+      scale_with_cairo(src, dst, sc);
+      times[f] = now_ms() - t0;
+    }
+    printf("%-16s %8.3f", sc->name, scale_median(times, frames));
+
+    /* Every kernel must match the scalar one byte for byte */
+    for (size_t k = 0; k < NUM_SCALE_ISAS; k++) {
+      if (!scale_set_isa(scale_isas[k])) {
+        printf(" %8s", "-");
+        continue;
+      }
+      for (int f = 0; f < frames; f++) {
+        double t0 = now_ms();
+        scale_argb32(in, sc->sw, sc->sh, in_stride, out, sc->dw, sc->dh,
+                     out_stride, false);
+        times[f] = now_ms() - t0;
+      }
+      printf(" %8.3f", scale_median(times, frames));
+      if (!reference)
+        continue;
+      if (scale_isas[k] == SCALE_SCALAR) {
+        memcpy(reference, out, out_len);
+      } else if (memcmp(reference, out, out_len) != 0) {
+        LOG("%s: %s output differs from scalar", sc->name,
+            scale_isa_name(scale_isas[k]));
+        failures++;
+      }
+    }
+    printf("\n");
+
+    free(reference);
+    cairo_surface_destroy(dst);
+    cairo_surface_destroy(src);
+  }
+
+  scale_set_isa(default_isa);
+  free(times);
+  if (failures > 0) {
+    printf("%d check(s) failed\n", failures);
+    return 1;
+  }
+  return 0;
+}
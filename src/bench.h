@@ -0,0 +1,19 @@
+/* src/bench.h - Headless Render Benchmark */
+#ifndef BENCH_H
+#define BENCH_H
+
+/*
+ * Render synthetic snapshots offscreen for every theme and a range of
+ * window counts, report per-frame timing percentiles and optionally
+ * write/compare PNGs against golden images. Returns a process exit code.
+ */
+int run_render_bench(int argc, char **argv);
+
+/*
+ * Time the premultiplied ARGB32 downscaler against the cairo path it
+ * replaced, for icon and preview sized reductions, once per supported
+ * instruction set; fails if any of them disagrees with the scalar kernel.
+ */
+int run_scale_bench(int argc, char **argv);
+
+#endif /* BENCH_H */
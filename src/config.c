@@ -8,6 +8,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
+#include <sys/inotify.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
@@ -17,6 +18,8 @@
 static void set_defaults(Config *cfg) {
   cfg->mode = MODE_CONTEXT;
   cfg->follow_monitor = false;
+  cfg->prerender = 1;
+  cfg->frame_budget = 16;
 
   /* Default Theme Colors */
   cfg->background = 0x1e1e2e;
@@ -34,6 +37,7 @@ static void set_defaults(Config *cfg) {
   cfg->card_gap = 10;
   cfg->padding = 20;
   cfg->max_cols = 5;
+  cfg->max_height_percent = 80;
 
   /* Icons */
   cfg->icon_size = 56;
@@ -43,6 +47,14 @@ static void set_defaults(Config *cfg) {
   strncpy(cfg->icon_fallback, "Tela-circle-dracula",
           sizeof(cfg->icon_fallback) - 1);
   cfg->show_letter_fallback = true;
+  cfg->icon_cache_mb = 8;
+  cfg->icon_cache_ttl = 0;
+  cfg->icon_miss_ttl = 300;
+
+  /* Thumbnails */
+  cfg->show_thumbnails = false;
+  cfg->thumbnail_cache_mb = 16;
+  cfg->show_minimap = false;
 
   /* Font */
   strncpy(cfg->font_family, "Sans", sizeof(cfg->font_family) - 1);
@@ -73,6 +85,40 @@ static char *trim(char *str) {
   return str;
 }
 
+/* A later entry for the same class replaces the earlier one (config.ini
+ * is parsed twice around the theme) */
+static void add_icon_mapping(Config *cfg, const char *pattern,
+                             const char *icon) {
+  if (!pattern[0] || !icon[0])
+    return;
+  for (int i = 0; i < cfg->icon_mapping_count; i++) {
+    IconMapping *m = &cfg->icon_mappings[i];
+    if (strcasecmp(m->pattern, pattern) == 0) {
+      char *copy = strdup(icon);
+      if (copy) {
+        free(m->icon);
+        m->icon = copy;
+      }
+      return;
+    }
+  }
+
+  IconMapping *list = realloc(cfg->icon_mappings, (cfg->icon_mapping_count + 1) *
+                                                      sizeof(IconMapping));
+  if (!list)
+    return;
+  cfg->icon_mappings = list;
+  IconMapping *m = &list[cfg->icon_mapping_count];
+  m->pattern = strdup(pattern);
+  m->icon = strdup(icon);
+  if (!m->pattern || !m->icon) {
+    free(m->pattern);
+    free(m->icon);
+    return;
+  }
+  cfg->icon_mapping_count++;
+}
+
 /* --- Parse a single key-value pair --- */
 static void apply_value(Config *cfg, const char *section, const char *key,
                         const char *val) {
@@ -86,6 +132,17 @@ static void apply_value(Config *cfg, const char *section, const char *key,
     } else if (strcasecmp(key, "follow_monitor") == 0) {
       cfg->follow_monitor =
           (strcasecmp(val, "true") == 0 || strcmp(val, "1") == 0);
+    } else if (strcasecmp(key, "prerender") == 0) {
+      if (strcasecmp(val, "off") == 0)
+        cfg->prerender = 0;
+      else if (strcasecmp(val, "next") == 0)
+        cfg->prerender = 1;
+      else if (strcasecmp(val, "both") == 0)
+        cfg->prerender = 2;
+    } else if (strcasecmp(key, "frame_budget") == 0) {
+      cfg->frame_budget = atoi(val);
+      if (cfg->frame_budget < 0)
+        cfg->frame_budget = 0;
     }
   }
   /* Colors (from theme or manual override) */
@@ -120,6 +177,8 @@ static void apply_value(Config *cfg, const char *section, const char *key,
       cfg->padding = atoi(val);
     else if (strcasecmp(key, "max_cols") == 0)
       cfg->max_cols = atoi(val);
+    else if (strcasecmp(key, "max_height_percent") == 0)
+      cfg->max_height_percent = atoi(val);
     else if (strcasecmp(key, "icon_size") == 0)
       cfg->icon_size = atoi(val);
     else if (strcasecmp(key, "icon_radius") == 0)
@@ -134,6 +193,36 @@ static void apply_value(Config *cfg, const char *section, const char *key,
     else if (strcasecmp(key, "show_letter_fallback") == 0)
       cfg->show_letter_fallback =
           (strcasecmp(val, "true") == 0 || strcmp(val, "1") == 0);
+    else if (strcasecmp(key, "cache_mb") == 0) {
+      cfg->icon_cache_mb = atoi(val);
+      if (cfg->icon_cache_mb < 1)
+        cfg->icon_cache_mb = 1;
+    } else if (strcasecmp(key, "cache_ttl") == 0) {
+      cfg->icon_cache_ttl = atoi(val);
+      if (cfg->icon_cache_ttl < 0)
+        cfg->icon_cache_ttl = 0;
+    } else if (strcasecmp(key, "miss_ttl") == 0) {
+      cfg->icon_miss_ttl = atoi(val);
+      if (cfg->icon_miss_ttl < 0)
+        cfg->icon_miss_ttl = 0;
+    }
+  }
+  /* Class -> icon overrides: <WM_CLASS or glob> = <icon name> */
+  else if (strcasecmp(section, "icon_mappings") == 0) {
+    add_icon_mapping(cfg, key, val);
+  }
+  /* Thumbnails */
+  else if (strcasecmp(section, "thumbnails") == 0) {
+    if (strcasecmp(key, "enabled") == 0)
+      cfg->show_thumbnails =
+          (strcasecmp(val, "true") == 0 || strcmp(val, "1") == 0);
+    else if (strcasecmp(key, "cache_mb") == 0) {
+      cfg->thumbnail_cache_mb = atoi(val);
+      if (cfg->thumbnail_cache_mb < 1)
+        cfg->thumbnail_cache_mb = 1;
+    } else if (strcasecmp(key, "minimap") == 0)
+      cfg->show_minimap =
+          (strcasecmp(val, "true") == 0 || strcmp(val, "1") == 0);
   }
   /* Font */
   else if (strcasecmp(section, "font") == 0) {
@@ -224,6 +313,7 @@ static int load_theme(const char *theme_name, Config *cfg) {
 
     if (access(path, R_OK) == 0) {
       LOG("Loading theme: %s", path);
+      snprintf(cfg->theme_path, sizeof(cfg->theme_path), "%s", path);
       return parse_ini_file(path, cfg, NULL, 0);
     }
   }
@@ -300,7 +390,7 @@ static void create_default_config(const char *path) {
 }
 
 /* --- Main Config Loader --- */
-Config *load_config(void) {
+static Config *load_config_files(bool self_heal) {
   Config *cfg = malloc(sizeof(Config));
   if (!cfg)
     return NULL;
@@ -315,6 +405,9 @@ Config *load_config(void) {
   char config_path[1024];
   snprintf(config_path, sizeof(config_path),
            "%s/.config/snappy-switcher/config.ini", home);
+  /* The user file is watched even while the system one is in use, so
+   * creating it takes effect */
+  snprintf(cfg->config_path, sizeof(cfg->config_path), "%s", config_path);
 
   /* First Pass: Read config and extract theme name */
   char theme_name[256] = "";
@@ -322,6 +415,10 @@ Config *load_config(void) {
     /* Try system config */
     if (parse_ini_file("/etc/xdg/snappy-switcher/config.ini", cfg, theme_name,
                        sizeof(theme_name)) < 0) {
+      if (!self_heal) {
+        free_config(cfg);
+        return NULL;
+      }
       /* Self-Healing: Create default config file */
       create_default_config(config_path);
       strncpy(theme_name, "snappy-slate.ini", sizeof(theme_name) - 1);
@@ -341,6 +438,10 @@ Config *load_config(void) {
   return cfg;
 }
 
+Config *load_config(void) { return load_config_files(true); }
+
+Config *reload_config_files(void) { return load_config_files(false); }
+
 Config *get_default_config(void) {
   Config *cfg = malloc(sizeof(Config));
   if (cfg) {
@@ -350,7 +451,97 @@ Config *get_default_config(void) {
   return cfg;
 }
 
-void free_config(Config *cfg) { free(cfg); }
+Config *load_theme_config(const char *path) {
+  Config *cfg = get_default_config();
+  if (!cfg)
+    return NULL;
+  if (parse_ini_file(path, cfg, NULL, 0) < 0) {
+    free_config(cfg);
+    return NULL;
+  }
+  return cfg;
+}
+
+void free_config(Config *cfg) {
+  if (!cfg)
+    return;
+  for (int i = 0; i < cfg->icon_mapping_count; i++) {
+    free(cfg->icon_mappings[i].pattern);
+    free(cfg->icon_mappings[i].icon);
+  }
+  free(cfg->icon_mappings);
+  free(cfg);
+}
+
+/* --- Reload Watch --- */
+static int watch_fd = -1;
+static struct {
+  int wd;
+  char name[256];
+} watches[2]; /* config.ini, theme */
+
+static void watch_file(int slot, const char *path) {
+  watches[slot].wd = -1;
+  const char *slash = strrchr(path, '/');
+  if (!path[0] || !slash)
+    return;
+
+  char dir[512];
+  snprintf(dir, sizeof(dir), "%.*s", (int)(slash - path), path);
+  snprintf(watches[slot].name, sizeof(watches[slot].name), "%s", slash + 1);
+  /* Only finished writes: a removal keeps the running config */
+  watches[slot].wd =
+      inotify_add_watch(watch_fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO);
+}
+
+int config_watch(const Config *cfg) {
+  if (watch_fd < 0) {
+    watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watch_fd < 0) {
+      LOG("inotify unavailable, config won't reload: %s", strerror(errno));
+      return -1;
+    }
+    watches[0].wd = watches[1].wd = -1;
+  }
+
+  /* Add before removing: a directory that stays watched keeps its wd, so
+   * no save is missed and queued events still match */
+  int old[2] = {watches[0].wd, watches[1].wd};
+  watch_file(0, cfg ? cfg->config_path : "");
+  watch_file(1, cfg ? cfg->theme_path : "");
+  for (int i = 0; i < 2; i++) {
+    if (old[i] < 0 || old[i] == watches[0].wd || old[i] == watches[1].wd ||
+        (i == 1 && old[1] == old[0]))
+      continue;
+    inotify_rm_watch(watch_fd, old[i]);
+  }
+  return watch_fd;
+}
+
+int config_get_watch_fd(void) { return watch_fd; }
+
+bool config_handle_watch(void) {
+  char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+  bool changed = false;
+  ssize_t n;
+  while ((n = read(watch_fd, buf, sizeof(buf))) > 0) {
+    for (char *p = buf; p < buf + n;) {
+      const struct inotify_event *ev = (const struct inotify_event *)p;
+      for (int i = 0; ev->len && i < 2; i++) {
+        if (ev->wd == watches[i].wd && strcmp(ev->name, watches[i].name) == 0)
+          changed = true;
+      }
+      p += sizeof(struct inotify_event) + ev->len;
+    }
+  }
+  return changed;
+}
+
+void config_unwatch(void) {
+  if (watch_fd >= 0)
+    close(watch_fd);
+  watch_fd = -1;
+}
 
 void color_to_rgb(uint32_t color, double *r, double *g, double *b) {
   *r = ((color >> 16) & 0xFF) / 255.0;
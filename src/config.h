@@ -11,6 +11,12 @@ typedef enum {
   MODE_CONTEXT   /* Group tiled windows by workspace + app class */
 } ViewMode;
 
+/* [icon_mappings] entry */
+typedef struct {
+  char *pattern; /* WM_CLASS, or a glob like jetbrains-* */
+  char *icon;    /* Icon/desktop name; a * takes what the glob's * matched */
+} IconMapping;
+
 /* Theme configuration */
 typedef struct {
   /* Colors (0xRRGGBB) */
@@ -29,6 +35,7 @@ typedef struct {
   int border_width;
   int padding;
   int max_cols;
+  int max_height_percent; /* Panel height cap, % of output height */
   int icon_size;
   int icon_radius;
 
@@ -42,21 +49,59 @@ typedef struct {
   char icon_theme[64];
   char icon_fallback[64];
   bool show_letter_fallback;
+  int icon_cache_mb;
+  int icon_cache_ttl; /* Seconds a loaded icon stays cached, 0 = forever */
+  int icon_miss_ttl;  /* Seconds before a missing icon is looked up again */
+  IconMapping *icon_mappings; /* Extra class -> icon names, override built-ins */
+  int icon_mapping_count;
+
+  /* Window previews */
+  bool show_thumbnails;
+  int thumbnail_cache_mb;
+  bool show_minimap; /* Workspace layout sketch on context-mode cards */
 
   /* View Mode */
   bool follow_monitor;
+  int prerender;    /* Speculative frames: 0 off, 1 next, 2 next + prev */
+  int frame_budget; /* ms; slower frames drop to fast quality while cycling */
   ViewMode mode;
+
+  /* Files this config was read from, watched for reloads ("" if none) */
+  char config_path[512];
+  char theme_path[512];
 } Config;
 
 /* Load config from file, returns default if file not found */
 Config *load_config(void);
 
+/* Same, for a reload: never writes a default config.ini, NULL if there is
+ * none (keep the running config) */
+Config *reload_config_files(void);
+
+/* Load defaults overlaid with a single theme file (NULL if unreadable) */
+Config *load_theme_config(const char *path);
+
 /* Free config memory */
 void free_config(Config *config);
 
 /* Get default config (fallback values) */
 Config *get_default_config(void);
 
+/*
+ * inotify on the directories holding cfg's config.ini and theme (editors
+ * save by rename, so the files themselves can't be watched). Returns the
+ * fd, -1 if unavailable. Call again after a reload: the theme may differ.
+ */
+int config_watch(const Config *cfg);
+int config_get_watch_fd(void);
+
+/* Drain watch events; true if config.ini or the theme was written or
+ * replaced */
+bool config_handle_watch(void);
+
+/* Close the watch fd */
+void config_unwatch(void);
+
 /* Helper: Convert uint32_t hex color to cairo RGB (0.0-1.0) */
 void color_to_rgb(uint32_t color, double *r, double *g, double *b);
 
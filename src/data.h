@@ -10,11 +10,19 @@ typedef struct {
   char *address;        /* Window address (hex string) */
   char *title;          /* Window title */
   char *class_name;     /* Application class name */
+  char *app_id;         /* Flatpak/Snap app ID from the pid, or NULL */
+  int pid;              /* Client process, 0 if unknown */
   int workspace_id;     /* Workspace ID (Negative for special workspaces) */
   int focus_history_id; /* Focus history ID (0 = most recently focused) */
   bool is_active;       /* Whether this window is currently focused */
   bool is_floating;     /* Whether this window is floating (not tiled) */
   int group_count;      /* Number of windows in this group */
+
+  /* Compositor layout geometry (0 x 0 when the backend doesn't report it) */
+  int x, y;
+  int width, height;
+  int monitor_id;     /* Monitor ID, -1 if unknown */
+  bool is_fullscreen; /* Fullscreen or maximized */
 } WindowInfo;
 
 /* Application state */
@@ -23,6 +31,13 @@ typedef struct {
   int count;           /* Number of windows */
   int capacity;        /* Allocated capacity */
   int selected_index;  /* Currently selected window index */
+  int scroll_row;      /* First visible grid row (panel capped to output) */
+  int hover_index;     /* Card under the pointer, -1 if none */
+
+  /* Every window before context grouping, for the workspace minimap
+   * (NULL in overview mode) */
+  WindowInfo *members;
+  int member_count;
 
   /* UI Dimensions (Shared with Input/Render) */
   uint32_t width;
@@ -34,6 +49,15 @@ void app_state_init(AppState *state);
 
 int app_state_add(AppState *state, WindowInfo *info);
 
+/* Index of the window with this address, or -1 */
+int app_state_find(AppState *state, const char *address);
+
+/* Remove (and free) the window at index, keeping the order of the rest */
+void app_state_remove(AppState *state, int index);
+
+/* Drop a window from the minimap member list */
+void app_state_remove_member(AppState *state, const char *address);
+
 /* Free all resources held by AppState */
 void app_state_free(AppState *state);
 
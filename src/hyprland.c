@@ -2,8 +2,10 @@
 #define _POSIX_C_SOURCE 200809L
 
 #include "hyprland.h"
+#include "appid.h"
 #include "config.h"
 #include <errno.h>
+#include <fcntl.h>
 #include <json-c/json.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -15,13 +17,19 @@
 #define LOG(fmt, ...) fprintf(stderr, "[Hyprland] " fmt "\n", ##__VA_ARGS__)
 #define BUFFER_SIZE 65536
 #define INITIAL_CAPACITY 32
+#define EVENT_BUFFER_SIZE 8192
 
-static char *get_socket_path(void);
+static char *get_socket_path(const char *name);
+
+/* Event socket (socket2) state: partial lines are kept across reads */
+static int event_fd = -1;
+static char event_buf[EVENT_BUFFER_SIZE];
+static size_t event_len = 0;
 
 int hyprland_backend_init(void) {
   /* Hyprland backend doesn't need special initialization */
   /* Just check if we can connect */
-  char *socket_path = get_socket_path();
+  char *socket_path = get_socket_path(".socket.sock");
   if (!socket_path) {
     LOG("HYPRLAND_INSTANCE_SIGNATURE or XDG_RUNTIME_DIR not set");
     return -1;
@@ -39,7 +47,11 @@ int hyprland_backend_init(void) {
 }
 
 void hyprland_backend_cleanup(void) {
-  /* Nothing to cleanup for Hyprland backend */
+  if (event_fd >= 0) {
+    close(event_fd);
+    event_fd = -1;
+  }
+  event_len = 0;
 }
 
 const char *hyprland_get_name(void) { return "hyprland"; }
@@ -50,6 +62,10 @@ void app_state_init(AppState *state) {
   state->count = 0;
   state->capacity = 0;
   state->selected_index = 0;
+  state->scroll_row = 0;
+  state->hover_index = -1;
+  state->members = NULL;
+  state->member_count = 0;
   state->width = 200; /* Default safe size */
   state->height = 100;
 }
@@ -59,6 +75,7 @@ void window_info_free(WindowInfo *info) {
     free(info->address);
     free(info->title);
     free(info->class_name);
+    free(info->app_id);
     memset(info, 0, sizeof(WindowInfo));
   }
 }
@@ -74,6 +91,12 @@ void app_state_free(AppState *state) {
     state->windows = NULL;
     state->count = 0;
     state->capacity = 0;
+
+    for (int i = 0; i < state->member_count; i++)
+      window_info_free(&state->members[i]);
+    free(state->members);
+    state->members = NULL;
+    state->member_count = 0;
   }
 }
 
@@ -81,6 +104,39 @@ static char *safe_strdup(const char *str) {
   return str ? strdup(str) : strdup("");
 }
 
+int app_state_find(AppState *state, const char *address) {
+  if (!address)
+    return -1;
+  for (int i = 0; i < state->count; i++) {
+    if (state->windows[i].address &&
+        strcmp(state->windows[i].address, address) == 0)
+      return i;
+  }
+  return -1;
+}
+
+void app_state_remove(AppState *state, int index) {
+  if (index < 0 || index >= state->count)
+    return;
+  window_info_free(&state->windows[index]);
+  memmove(&state->windows[index], &state->windows[index + 1],
+          (state->count - index - 1) * sizeof(WindowInfo));
+  state->count--;
+}
+
+void app_state_remove_member(AppState *state, const char *address) {
+  for (int i = 0; i < state->member_count; i++) {
+    if (state->members[i].address &&
+        strcmp(state->members[i].address, address) == 0) {
+      window_info_free(&state->members[i]);
+      memmove(&state->members[i], &state->members[i + 1],
+              (state->member_count - i - 1) * sizeof(WindowInfo));
+      state->member_count--;
+      return;
+    }
+  }
+}
+
 int app_state_add(AppState *state, WindowInfo *info) {
   if (state->count >= state->capacity) {
     int new_cap = state->capacity == 0 ? INITIAL_CAPACITY : state->capacity * 2;
@@ -109,28 +165,28 @@ static int compare_mru(const void *a, const void *b) {
 }
 
 /* --- IPC --- */
-static char *get_socket_path(void) {
+static char *get_socket_path(const char *name) {
   const char *sig = getenv("HYPRLAND_INSTANCE_SIGNATURE");
   const char *xdg = getenv("XDG_RUNTIME_DIR");
   if (!sig || !xdg)
     return NULL;
 
-  size_t len = strlen(xdg) + strlen(sig) + 32;
+  size_t len = strlen(xdg) + strlen(sig) + strlen(name) + 16;
   char *path = malloc(len);
   if (path)
-    snprintf(path, len, "%s/hypr/%s/.socket.sock", xdg, sig);
+    snprintf(path, len, "%s/hypr/%s/%s", xdg, sig, name);
   return path;
 }
 
-static char *hyprland_request(const char *cmd) {
-  char *path = get_socket_path();
+static int connect_socket(const char *name) {
+  char *path = get_socket_path(name);
   if (!path)
-    return NULL;
+    return -1;
 
   int fd = socket(AF_UNIX, SOCK_STREAM, 0);
   if (fd < 0) {
     free(path);
-    return NULL;
+    return -1;
   }
 
   struct sockaddr_un addr = {0};
@@ -140,8 +196,15 @@ static char *hyprland_request(const char *cmd) {
 
   if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
     close(fd);
-    return NULL;
+    return -1;
   }
+  return fd;
+}
+
+static char *hyprland_request(const char *cmd) {
+  int fd = connect_socket(".socket.sock");
+  if (fd < 0)
+    return NULL;
 
   if (write(fd, cmd, strlen(cmd)) < 0) {
     close(fd);
@@ -172,6 +235,13 @@ static char *hyprland_request(const char *cmd) {
 }
 
 /* --- JSON Parsing --- */
+static int json_array_int(struct json_object *arr, size_t idx) {
+  if (!arr || !json_object_is_type(arr, json_type_array) ||
+      json_object_array_length(arr) <= idx)
+    return 0;
+  return json_object_get_int(json_object_array_get_idx(arr, idx));
+}
+
 static int parse_clients(const char *json_str, AppState *state) {
   struct json_object *root = json_tokener_parse(json_str);
   if (!root || !json_object_is_type(root, json_type_array)) {
@@ -184,6 +254,7 @@ static int parse_clients(const char *json_str, AppState *state) {
   for (size_t i = 0; i < len; i++) {
     struct json_object *obj = json_object_array_get_idx(root, i);
     struct json_object *ws_obj, *ws_id, *addr, *title, *cls, *focus, *floating;
+    struct json_object *at, *size, *monitor, *fullscreen, *pid;
 
     if (!json_object_object_get_ex(obj, "workspace", &ws_obj))
       continue;
@@ -199,16 +270,31 @@ static int parse_clients(const char *json_str, AppState *state) {
     json_object_object_get_ex(obj, "class", &cls);
     json_object_object_get_ex(obj, "focusHistoryID", &focus);
     json_object_object_get_ex(obj, "floating", &floating);
+    json_object_object_get_ex(obj, "at", &at);
+    json_object_object_get_ex(obj, "size", &size);
+    json_object_object_get_ex(obj, "monitor", &monitor);
+    json_object_object_get_ex(obj, "fullscreen", &fullscreen);
+    json_object_object_get_ex(obj, "pid", &pid);
 
     WindowInfo info;
     info.address = safe_strdup(json_object_get_string(addr));
     info.title = safe_strdup(json_object_get_string(title));
     info.class_name = safe_strdup(json_object_get_string(cls));
+    info.pid = pid ? json_object_get_int(pid) : 0;
+    const char *app_id = appid_for_window(info.address, info.pid);
+    info.app_id = app_id ? strdup(app_id) : NULL;
     info.workspace_id = wid;
     info.focus_history_id = focus ? json_object_get_int(focus) : 9999;
     info.is_active = (info.focus_history_id == 0);
     info.is_floating = floating ? json_object_get_boolean(floating) : false;
     info.group_count = 1;
+    info.x = json_array_int(at, 0);
+    info.y = json_array_int(at, 1);
+    info.width = json_array_int(size, 0);
+    info.height = json_array_int(size, 1);
+    info.monitor_id = monitor ? json_object_get_int(monitor) : -1;
+    /* Older releases report a bool, newer ones a fullscreen mode */
+    info.is_fullscreen = fullscreen && json_object_get_int(fullscreen) != 0;
 
     app_state_add(state, &info);
   }
@@ -218,8 +304,22 @@ static int parse_clients(const char *json_str, AppState *state) {
 }
 
 /* --- Aggregation (Context Mode) --- */
+static void copy_geometry(WindowInfo *dst, const WindowInfo *src) {
+  dst->x = src->x;
+  dst->y = src->y;
+  dst->width = src->width;
+  dst->height = src->height;
+  dst->monitor_id = src->monitor_id;
+  dst->is_fullscreen = src->is_fullscreen;
+}
+
+static void copy_identity(WindowInfo *dst, const WindowInfo *src) {
+  dst->pid = src->pid;
+  dst->app_id = src->app_id ? strdup(src->app_id) : NULL;
+}
+
 static void aggregate_context(AppState *state) {
-  if (state->count <= 1)
+  if (state->count == 0)
     return;
 
   int count = state->count;
@@ -233,11 +333,13 @@ static void aggregate_context(AppState *state) {
       out[out_count].address = safe_strdup(win->address);
       out[out_count].title = safe_strdup(win->title);
       out[out_count].class_name = safe_strdup(win->class_name);
+      copy_identity(&out[out_count], win);
       out[out_count].workspace_id = win->workspace_id;
       out[out_count].focus_history_id = win->focus_history_id;
       out[out_count].is_active = win->is_active;
       out[out_count].is_floating = true;
       out[out_count].group_count = 1;
+      copy_geometry(&out[out_count], win);
       out_count++;
     } else {
       int found = -1;
@@ -255,19 +357,21 @@ static void aggregate_context(AppState *state) {
         out[out_count].address = safe_strdup(win->address);
         out[out_count].title = safe_strdup(win->title);
         out[out_count].class_name = safe_strdup(win->class_name);
+        copy_identity(&out[out_count], win);
         out[out_count].workspace_id = win->workspace_id;
         out[out_count].focus_history_id = win->focus_history_id;
         out[out_count].is_active = win->is_active;
         out[out_count].is_floating = false;
         out[out_count].group_count = 1;
+        copy_geometry(&out[out_count], win);
         out_count++;
       }
     }
   }
 
-  for (int i = 0; i < count; i++)
-    window_info_free(&state->windows[i]);
-  free(state->windows);
+  /* The ungrouped list lives on for the minimap */
+  state->members = state->windows;
+  state->member_count = count;
 
   state->windows = out;
   state->count = out_count;
@@ -309,3 +413,134 @@ void switch_to_window(const char *address) {
   if (resp)
     free(resp);
 }
+
+/* --- Event Socket --- */
+
+int hyprland_get_event_fd(void) {
+  if (event_fd < 0) {
+    event_fd = connect_socket(".socket2.sock");
+    if (event_fd >= 0) {
+      fcntl(event_fd, F_SETFL, fcntl(event_fd, F_GETFL) | O_NONBLOCK);
+      event_len = 0;
+    }
+  }
+  return event_fd;
+}
+
+/* socket2 addresses lack the "0x" prefix used by j/clients */
+static void normalize_address(const char *raw, char *out, size_t size) {
+  if (strncmp(raw, "0x", 2) == 0)
+    snprintf(out, size, "%s", raw);
+  else
+    snprintf(out, size, "0x%s", raw);
+}
+
+/* Split off the next comma-separated field (the last field keeps commas) */
+static char *next_field(char **rest) {
+  char *field = *rest;
+  if (!field)
+    return NULL;
+  char *comma = strchr(field, ',');
+  if (comma) {
+    *comma = '\0';
+    *rest = comma + 1;
+  } else {
+    *rest = NULL;
+  }
+  return field;
+}
+
+static void handle_event_line(char *line, WindowEventHandler handler) {
+  char *data = strstr(line, ">>");
+  if (!data)
+    return;
+  *data = '\0';
+  data += 2;
+
+  char address[64];
+  WindowEvent ev = {0};
+  ev.address = address;
+
+  if (strcmp(line, "openwindow") == 0) {
+    /* openwindow>>ADDRESS,WORKSPACENAME,CLASS,TITLE */
+    char *addr = next_field(&data);
+    char *ws = next_field(&data);
+    char *cls = next_field(&data);
+    if (!addr || !ws || !cls)
+      return;
+    normalize_address(addr, address, sizeof(address));
+
+    char *end;
+    long wid = strtol(ws, &end, 10);
+    if (end == ws || *end != '\0') {
+      /* Named/special workspace: its id needs a full query */
+      ev.type = WINDOW_EVENT_RESYNC;
+    } else {
+      ev.type = WINDOW_EVENT_OPEN;
+      ev.workspace_id = (int)wid;
+      ev.class_name = cls;
+      ev.title = data ? data : "";
+    }
+  } else if (strcmp(line, "closewindow") == 0) {
+    normalize_address(data, address, sizeof(address));
+    ev.type = WINDOW_EVENT_CLOSE;
+  } else if (strcmp(line, "windowtitlev2") == 0) {
+    /* windowtitlev2>>ADDRESS,TITLE */
+    char *addr = next_field(&data);
+    if (!addr)
+      return;
+    normalize_address(addr, address, sizeof(address));
+    ev.type = WINDOW_EVENT_TITLE;
+    ev.title = data ? data : "";
+  } else if (strcmp(line, "activewindowv2") == 0) {
+    /* activewindowv2>>ADDRESS (empty when nothing is focused) */
+    if (!data[0] || strcmp(data, ",") == 0)
+      return;
+    normalize_address(data, address, sizeof(address));
+    ev.type = WINDOW_EVENT_FOCUS;
+  } else {
+    return;
+  }
+
+  if (handler)
+    handler(&ev);
+}
+
+void hyprland_dispatch_events(WindowEventHandler handler) {
+  if (event_fd < 0)
+    return;
+
+  while (1) {
+    ssize_t n = read(event_fd, event_buf + event_len,
+                     sizeof(event_buf) - event_len - 1);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+        break;
+    }
+    if (n <= 0) {
+      /* Compositor gone or restarted: reconnect on the next poll */
+      LOG("Event socket closed");
+      close(event_fd);
+      event_fd = -1;
+      event_len = 0;
+      return;
+    }
+    event_len += n;
+    event_buf[event_len] = '\0';
+
+    char *line = event_buf;
+    char *nl;
+    while ((nl = strchr(line, '\n')) != NULL) {
+      *nl = '\0';
+      handle_event_line(line, handler);
+      line = nl + 1;
+    }
+
+    event_len -= line - event_buf;
+    memmove(event_buf, line, event_len);
+    if (event_len >= sizeof(event_buf) - 1)
+      event_len = 0; /* Oversized line: drop it */
+  }
+}
@@ -2,6 +2,7 @@
 #ifndef HYPRLAND_H
 #define HYPRLAND_H
 
+#include "backend.h"
 #include "config.h"
 #include "data.h"
 
@@ -21,6 +22,12 @@ int update_window_list(AppState *state, Config *config);
 /* Switch focus to window address */
 void switch_to_window(const char *address);
 
+/* Event socket (.socket2.sock), reconnected on demand; -1 if unavailable */
+int hyprland_get_event_fd(void);
+
+/* Read pending socket2 lines and report window open/close/title changes */
+void hyprland_dispatch_events(WindowEventHandler handler);
+
 int hyprland_backend_init(void);
 void hyprland_backend_cleanup(void);
 const char *hyprland_get_name(void);
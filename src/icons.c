@@ -3,12 +3,24 @@
 #define _POSIX_C_SOURCE 200809L
 
 #include "icons.h"
+#include "scale.h"
+#include "util.h"
 #include <ctype.h>
 #include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <limits.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
@@ -17,7 +29,7 @@
 #endif
 
 #define LOG(fmt, ...) fprintf(stderr, "[Icons] " fmt "\n", ##__VA_ARGS__)
-#define MAX_CACHE 64
+#define CACHE_BUCKETS 256
 #define MAX_PATH 512
 
 /* =========================================================================
@@ -45,6 +57,7 @@ static const ClassMapping class_mappings[] = {
     {"jetbrains-goland", "goland"},
     {"jetbrains-rider", "rider"},
     {"jetbrains-datagrip", "datagrip"},
+    {"jetbrains-*", "*"}, /* Newer IDEs: jetbrains-rustrover -> rustrover */
 
     /* VS Code variants */
     {"code-oss", "visual-studio-code"},
@@ -87,19 +100,37 @@ static const ClassMapping class_mappings[] = {
  * INTERNAL TYPES
  * ========================================================================= */
 
-/* Icon cache entry */
-typedef struct {
+/* Icon cache entry: hashed by (class, size), on an LRU list. A NULL
+ * surface records a miss. */
+typedef struct IconCacheEntry {
   char class_name[128];
   int size;
   cairo_surface_t *surface;
+  size_t bytes;
+  double expires_ms; /* 0 = never */
+  struct IconCacheEntry *chain;
+  struct IconCacheEntry *newer, *older;
 } IconCacheEntry;
 
 /* =========================================================================
  * GLOBAL STATE
  * ========================================================================= */
 
-static IconCacheEntry icon_cache[MAX_CACHE];
-static int cache_count = 0;
+static struct {
+  IconCacheEntry *buckets[CACHE_BUCKETS];
+  IconCacheEntry *newest, *oldest;
+  size_t bytes;
+  size_t budget;
+  double ttl_ms, miss_ttl_ms;
+  unsigned hits, misses, evictions, expirations;
+  unsigned epoch; /* Bumped on clears: loads started before are dropped */
+  int icon_size;  /* Card icon size in the config last applied */
+} icon_cache = {.budget = 8u << 20, .ttl_ms = 0, .miss_ttl_ms = 300000};
+
+/* cache_lock guards icon_cache; resolve_lock everything behind it (theme
+ * and desktop indexes, path and raster caches). Never nest them. */
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t resolve_lock = PTHREAD_MUTEX_INITIALIZER;
 static char current_theme[64] = "Tela-dracula";
 static char fallback_theme_name[64] = "Tela-circle-dracula";
 
@@ -131,16 +162,262 @@ static int file_exists(const char *path) {
   return stat(path, &st) == 0 && S_ISREG(st.st_mode);
 }
 
+/*
+ * The built-ins and [icon_mappings] are compiled into case-folded hash
+ * tables: exact classes, and globs with a single * indexed by the text
+ * before it, so a lookup is one probe per prefix length of the class
+ * however many rules there are. Globs that don't fit that shape (*foo,
+ * ?, [...]) are tried in order with fnmatch. Answers are memoized per
+ * class, up to MAPPED_MAX classes. All of it is guarded by resolve_lock.
+ */
+
+#define RULE_BUCKETS 256
+#define MAPPED_MAX 1024 /* Memo entries; transient classes pile up past it */
+
+typedef struct ClassRule {
+  char *key;     /* Lowercase: the class, or the glob's text before its * */
+  char *suffix;  /* Single-* globs: lowercase text after the * */
+  char *pattern; /* Other globs: lowercase, for fnmatch */
+  char *icon;
+  struct ClassRule *next;
+} ClassRule;
+
+typedef struct MappedClass {
+  char *class_lc;
+  char *icon; /* NULL: no mapping */
+  struct MappedClass *next;
+} MappedClass;
+
+static ClassRule *exact_rules[RULE_BUCKETS];
+static ClassRule *prefix_rules[RULE_BUCKETS];
+static ClassRule *glob_rules; /* In config order */
+static MappedClass *mapped_classes[RULE_BUCKETS];
+static int mapped_count = 0;
+static bool rules_built = false;
+static uint32_t rules_stamp = 0; /* Hash of the [icon_mappings] in use */
+
+static unsigned fold_hash(const char *s, size_t len) {
+  unsigned h = 5381;
+  for (size_t i = 0; i < len; i++)
+    h = h * 33 + (unsigned char)tolower((unsigned char)s[i]);
+  return h & (RULE_BUCKETS - 1);
+}
+
+static char *fold_dup(const char *s, size_t len) {
+  char *out = malloc(len + 1);
+  if (!out)
+    return NULL;
+  for (size_t i = 0; i < len; i++)
+    out[i] = (char)tolower((unsigned char)s[i]);
+  out[len] = '\0';
+  return out;
+}
+
+static void free_rule_list(ClassRule *r) {
+  while (r) {
+    ClassRule *next = r->next;
+    free(r->key);
+    free(r->suffix);
+    free(r->pattern);
+    free(r->icon);
+    free(r);
+    r = next;
+  }
+}
+
+static void free_mapped_classes(void) {
+  for (int b = 0; b < RULE_BUCKETS; b++) {
+    MappedClass *m = mapped_classes[b];
+    while (m) {
+      MappedClass *next = m->next;
+      free(m->class_lc);
+      free(m->icon);
+      free(m);
+      m = next;
+    }
+    mapped_classes[b] = NULL;
+  }
+  mapped_count = 0;
+}
+
+static void free_class_rules(void) {
+  for (int b = 0; b < RULE_BUCKETS; b++) {
+    free_rule_list(exact_rules[b]);
+    free_rule_list(prefix_rules[b]);
+    exact_rules[b] = prefix_rules[b] = NULL;
+  }
+  free_mapped_classes();
+  free_rule_list(glob_rules);
+  glob_rules = NULL;
+  rules_built = false;
+}
+
+static bool same_text(const char *a, const char *b) {
+  return (!a && !b) || (a && b && strcmp(a, b) == 0);
+}
+
+/* Compile one rule; the first rule for a pattern wins, so user rules go in
+ * before the built-ins */
+static void add_class_rule(const char *pattern, const char *icon) {
+  ClassRule *r = calloc(1, sizeof(ClassRule));
+  if (!r)
+    return;
+  const char *star = strchr(pattern, '*');
+  bool simple = !strpbrk(pattern, "?[") && (!star || !strchr(star + 1, '*'));
+  ClassRule **list;
+  if (!star && simple) {
+    r->key = fold_dup(pattern, strlen(pattern));
+    list = &exact_rules[fold_hash(pattern, strlen(pattern))];
+  } else if (simple && star > pattern) {
+    r->key = fold_dup(pattern, star - pattern);
+    r->suffix = fold_dup(star + 1, strlen(star + 1));
+    list = &prefix_rules[fold_hash(pattern, star - pattern)];
+  } else {
+    r->key = fold_dup("", 0);
+    if (simple)
+      r->suffix = fold_dup(star + 1, strlen(star + 1));
+    else
+      r->pattern = fold_dup(pattern, strlen(pattern));
+    list = &glob_rules;
+  }
+  r->icon = strdup(icon);
+
+  bool duplicate = false;
+  for (ClassRule *o = *list; o && !duplicate; o = o->next)
+    duplicate = same_text(o->key, r->key) && same_text(o->suffix, r->suffix) &&
+                same_text(o->pattern, r->pattern);
+  if (duplicate || !r->key || !r->icon) {
+    free_rule_list(r);
+    return;
+  }
+  while (*list) /* Append: glob rules keep their order */
+    list = &(*list)->next;
+  *list = r;
+}
+
+static void build_class_rules(const Config *config) {
+  free_class_rules();
+  int n = config ? config->icon_mapping_count : 0;
+  for (int i = 0; i < n; i++)
+    add_class_rule(config->icon_mappings[i].pattern,
+                   config->icon_mappings[i].icon);
+  for (int i = 0; class_mappings[i].wm_class != NULL; i++)
+    add_class_rule(class_mappings[i].wm_class, class_mappings[i].icon_name);
+  rules_built = true;
+}
+
+/* Rule matching a lowercase class, and where its * match starts/ends */
+static const ClassRule *match_class_rule(const char *lc, size_t *stem,
+                                         size_t *stem_len) {
+  size_t len = strlen(lc);
+  for (ClassRule *r = exact_rules[fold_hash(lc, len)]; r; r = r->next) {
+    if (strcmp(r->key, lc) == 0) {
+      *stem = *stem_len = 0;
+      return r;
+    }
+  }
+
+  /* Longest prefix first: jetbrains-idea-* before jetbrains-* */
+  for (size_t plen = len; plen > 0; plen--) {
+    for (ClassRule *r = prefix_rules[fold_hash(lc, plen)]; r; r = r->next) {
+      size_t slen = strlen(r->suffix);
+      if (strlen(r->key) == plen && strncmp(r->key, lc, plen) == 0 &&
+          len - plen >= slen && strcmp(lc + len - slen, r->suffix) == 0) {
+        *stem = plen;
+        *stem_len = len - plen - slen;
+        return r;
+      }
+    }
+  }
+
+  for (ClassRule *r = glob_rules; r; r = r->next) {
+    if (r->suffix) {
+      size_t slen = strlen(r->suffix);
+      if (len >= slen && strcmp(lc + len - slen, r->suffix) == 0) {
+        *stem = 0;
+        *stem_len = len - slen;
+        return r;
+      }
+    } else if (fnmatch(r->pattern, lc, 0) == 0) {
+      *stem = *stem_len = 0;
+      return r;
+    }
+  }
+  return NULL;
+}
+
+/* Fingerprint of the user rules, so persisted resolutions made under
+ * other mappings are discarded */
+static uint32_t class_rules_stamp(const Config *config) {
+  uint32_t h = 2166136261u;
+  int n = config ? config->icon_mapping_count : 0;
+  for (int i = 0; i < n; i++) {
+    const char *parts[2] = {config->icon_mappings[i].pattern,
+                            config->icon_mappings[i].icon};
+    for (int p = 0; p < 2; p++) {
+      for (const char *s = parts[p];; s++) {
+        unsigned char ch = p == 0 ? tolower((unsigned char)*s) : *s;
+        h = (h ^ ch) * 16777619u;
+        if (!*s)
+          break;
+      }
+    }
+  }
+  return h;
+}
+
 /* Lookup mapped class name, returns NULL if no mapping exists */
 static const char *get_mapped_class(const char *class_name) {
-  for (int i = 0; class_mappings[i].wm_class != NULL; i++) {
-    if (strcasecmp(class_mappings[i].wm_class, class_name) == 0) {
-      return class_mappings[i].icon_name;
+  if (!rules_built) {
+    build_class_rules(NULL);
+    rules_stamp = class_rules_stamp(NULL);
+  }
+
+  size_t len = strlen(class_name);
+  unsigned h = fold_hash(class_name, len);
+  char *lc = fold_dup(class_name, len);
+  if (!lc)
+    return NULL;
+  for (MappedClass *m = mapped_classes[h]; m; m = m->next) {
+    if (strcmp(m->class_lc, lc) == 0) {
+      free(lc);
+      return m->icon;
     }
   }
-  return NULL;
+
+  size_t stem = 0, stem_len = 0;
+  const ClassRule *r = match_class_rule(lc, &stem, &stem_len);
+  char *icon = NULL;
+  if (r) {
+    /* "jetbrains-* = *": the * in the icon name takes the matched text
+     * (lowercase, like icon names) */
+    const char *star = strchr(r->icon, '*');
+    size_t n = strlen(r->icon) + stem_len + 1;
+    if (star && (icon = malloc(n)))
+      snprintf(icon, n, "%.*s%.*s%s", (int)(star - r->icon), r->icon,
+               (int)stem_len, lc + stem, star + 1);
+    else
+      icon = strdup(r->icon);
+  }
+
+  /* Answers are cheap to recompute: start over rather than grow forever */
+  if (mapped_count >= MAPPED_MAX)
+    free_mapped_classes();
+  MappedClass *m = calloc(1, sizeof(MappedClass));
+  if (!m) {
+    free(lc);
+    free(icon);
+    return NULL;
+  }
+  m->class_lc = lc;
+  m->icon = icon;
+  m->next = mapped_classes[h];
+  mapped_classes[h] = m;
+  mapped_count++;
+  return icon;
 }
 
+
 /* =========================================================================
  * PATH INITIALIZATION
  * ========================================================================= */
@@ -181,183 +458,920 @@ static void init_paths(void) {
   desktop_dirs[desktop_idx++] = "/usr/share/applications";
   desktop_dirs[desktop_idx++] = "/usr/local/share/applications";
   desktop_dirs[desktop_idx++] = "/var/lib/flatpak/exports/share/applications";
+  desktop_dirs[desktop_idx++] = "/var/lib/snapd/desktop/applications";
   desktop_dirs[desktop_idx] = NULL;
 }
 
 /* =========================================================================
- * ICON THEME SEARCH
+ * SOURCE WATCHES
  * ========================================================================= */
 
-static char *find_icon_in_theme(const char *theme, const char *icon_name,
-                                int size) {
-  static char path[MAX_PATH];
-  (void)size; /* Size hint not used currently */
+/*
+ * One inotify fd covers what lookups read: the applications dirs and the
+ * subdirectories indexed in them, the icon base dirs (themes installed or
+ * removed) and the roots of the indexed themes (index.theme, and
+ * icon-theme.cache, which installs rewrite after adding icons). A base dir
+ * that doesn't exist yet is covered by a watch on its nearest ancestor.
+ * Events only flag what changed; icons_refresh() acts. Guarded by
+ * resolve_lock, as dirs are added while indexing.
+ */
 
-  const char *sizes[] = {"scalable", "256x256", "128x128", "64x64", "48x48",
-                         "32x32",    "24x24",   "22x22",   "16x16"};
-  const char *categories[] = {"apps",   "applications", "mimetypes",
-                              "places", "devices",      "actions",
-                              "status", "categories"};
-  const char *extensions[] = {".svg", ".png", ".xpm"};
+typedef enum { WATCH_DESKTOP, WATCH_ICONS, WATCH_PARENT } WatchKind;
 
-  for (int d = 0; icon_dirs[d]; d++) {
-    if (!icon_dirs[d][0])
+typedef struct {
+  int wd;
+  WatchKind kind;
+} SourceWatch;
+
+#define WATCH_MASK                                                             \
+  (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_CLOSE_WRITE)
+
+static int source_watch_fd = -1;
+static bool source_watch_failed = false;
+static SourceWatch *source_watches = NULL;
+static int source_watch_count = 0;
+static int source_watch_capacity = 0;
+static bool desktop_changed = false; /* Pending for icons_refresh() */
+static bool themes_changed = false;
+
+/* 1 if newly watched, 0 if already, -1 if it can't be (missing) */
+static int watch_dir(const char *path, WatchKind kind) {
+  if (source_watch_fd < 0 || !path[0])
+    return -1;
+  uint32_t mask = kind == WATCH_PARENT ? IN_CREATE | IN_MOVED_TO : WATCH_MASK;
+  int wd = inotify_add_watch(source_watch_fd, path, mask);
+  if (wd < 0)
+    return -1;
+  for (int i = 0; i < source_watch_count; i++) {
+    if (source_watches[i].wd == wd)
+      return 0;
+  }
+  if (source_watch_count == source_watch_capacity) {
+    int cap = source_watch_capacity ? source_watch_capacity * 2 : 32;
+    SourceWatch *w = realloc(source_watches, cap * sizeof(SourceWatch));
+    if (!w)
+      return 0;
+    source_watches = w;
+    source_watch_capacity = cap;
+  }
+  source_watches[source_watch_count++] = (SourceWatch){wd, kind};
+  return 1;
+}
+
+/* Watch a base dir, or the nearest existing ancestor until it appears */
+static void watch_base_dir(const char *dir, WatchKind kind, bool notify) {
+  int added = watch_dir(dir, kind);
+  if (added > 0 && notify) {
+    if (kind == WATCH_DESKTOP)
+      desktop_changed = true;
+    else
+      themes_changed = true;
+  }
+  if (added >= 0 || !dir[0])
+    return;
+
+  char parent[MAX_PATH];
+  snprintf(parent, sizeof(parent), "%s", dir);
+  char *slash;
+  while ((slash = strrchr(parent, '/')) && slash > parent) {
+    *slash = '\0';
+    if (watch_dir(parent, WATCH_PARENT) >= 0)
+      return;
+  }
+}
+
+static void watch_base_dirs(bool notify) {
+  for (int d = 0; desktop_dirs[d]; d++)
+    watch_base_dir(desktop_dirs[d], WATCH_DESKTOP, notify);
+  for (int d = 0; icon_dirs[d]; d++)
+    watch_base_dir(icon_dirs[d], WATCH_ICONS, notify);
+}
+
+/* Set up on the first index build */
+static void watch_sources(void) {
+  if (source_watch_fd >= 0 || source_watch_failed)
+    return;
+  source_watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (source_watch_fd < 0) {
+    LOG("inotify unavailable, icon lookups won't refresh: %s",
+        strerror(errno));
+    source_watch_failed = true;
+    return;
+  }
+  watch_base_dirs(false);
+}
+
+static void unwatch_sources(void) {
+  if (source_watch_fd >= 0)
+    close(source_watch_fd);
+  source_watch_fd = -1;
+  source_watch_failed = false;
+  free(source_watches);
+  source_watches = NULL;
+  source_watch_count = source_watch_capacity = 0;
+  desktop_changed = themes_changed = false;
+}
+
+/* =========================================================================
+ * ICON THEME INDEX
+ * ========================================================================= */
+
+/*
+ * Each theme's index.theme is parsed once and every directory it lists is
+ * read with readdir into a name -> variants hash map, so a lookup is a
+ * hash probe per theme in the inheritance chain instead of thousands of
+ * stat() calls.
+ */
+
+typedef enum { DIR_FIXED, DIR_SCALABLE, DIR_THRESHOLD } IconDirType;
+
+typedef struct {
+  char *path; /* Relative to the theme root, "" for flat dirs */
+  int size;
+  int min_size;
+  int max_size;
+  int threshold;
+  int scale;
+  IconDirType type;
+  bool listed; /* Named in Directories= (other sections are ignored) */
+} IconDir;
+
+typedef struct {
+  unsigned short dir;  /* Index into ThemeIndex.dirs */
+  unsigned short root; /* Index into ThemeIndex.roots */
+  bool svg;
+} IconVariant;
+
+typedef struct IconName {
+  char *name;
+  IconVariant *variants;
+  int count;
+  int capacity;
+  struct IconName *next;
+} IconName;
+
+typedef struct ThemeIndex {
+  char name[64];
+  char *roots[8]; /* <base dir>/<theme> for every base that has it */
+  int root_count;
+  char *inherits[8];
+  int inherit_count;
+  IconDir *dirs;
+  int dir_count;
+  IconName **buckets;
+  unsigned bucket_count;
+  unsigned name_count;
+  struct ThemeIndex *next;
+} ThemeIndex;
+
+#define MAX_THEME_CHAIN 16
+#define INDEX_INITIAL_BUCKETS 1024
+
+static ThemeIndex *theme_indexes = NULL;
+static ThemeIndex *theme_chain[MAX_THEME_CHAIN];
+static int theme_chain_len = -1; /* -1: not resolved yet */
+
+static unsigned hash_name(const char *s) {
+  unsigned h = 5381;
+  while (*s)
+    h = h * 33 + (unsigned char)*s++;
+  return h;
+}
+
+static char *trim(char *s) {
+  while (isspace((unsigned char)*s))
+    s++;
+  char *end = s + strlen(s);
+  while (end > s && isspace((unsigned char)end[-1]))
+    *--end = '\0';
+  return s;
+}
+
+static IconName *index_find(ThemeIndex *t, const char *name) {
+  if (!t->bucket_count)
+    return NULL;
+  IconName *n = t->buckets[hash_name(name) & (t->bucket_count - 1)];
+  while (n && strcmp(n->name, name) != 0)
+    n = n->next;
+  return n;
+}
+
+static void index_grow(ThemeIndex *t) {
+  unsigned count = t->bucket_count ? t->bucket_count * 2 : INDEX_INITIAL_BUCKETS;
+  IconName **buckets = calloc(count, sizeof(IconName *));
+  if (!buckets)
+    return;
+  for (unsigned b = 0; b < t->bucket_count; b++) {
+    IconName *n = t->buckets[b];
+    while (n) {
+      IconName *next = n->next;
+      unsigned h = hash_name(n->name) & (count - 1);
+      n->next = buckets[h];
+      buckets[h] = n;
+      n = next;
+    }
+  }
+  free(t->buckets);
+  t->buckets = buckets;
+  t->bucket_count = count;
+}
+
+static void index_add(ThemeIndex *t, const char *name, int dir, int root,
+                      bool svg) {
+  IconName *n = index_find(t, name);
+  if (!n) {
+    if (t->name_count >= t->bucket_count)
+      index_grow(t);
+    if (!t->bucket_count)
+      return;
+    n = calloc(1, sizeof(IconName));
+    if (!n || !(n->name = strdup(name))) {
+      free(n);
+      return;
+    }
+    unsigned h = hash_name(name) & (t->bucket_count - 1);
+    n->next = t->buckets[h];
+    t->buckets[h] = n;
+    t->name_count++;
+  }
+
+  /* The same file in an earlier base dir wins */
+  for (int i = 0; i < n->count; i++) {
+    if (n->variants[i].dir == dir && n->variants[i].svg == svg)
+      return;
+  }
+  if (n->count == n->capacity) {
+    int cap = n->capacity ? n->capacity * 2 : 4;
+    IconVariant *v = realloc(n->variants, cap * sizeof(IconVariant));
+    if (!v)
+      return;
+    n->variants = v;
+    n->capacity = cap;
+  }
+  n->variants[n->count++] = (IconVariant){dir, root, svg};
+}
+
+/* Add every loadable icon file of one directory */
+static void index_directory(ThemeIndex *t, int dir, int root) {
+  char path[MAX_PATH];
+  if (t->dirs[dir].path[0])
+    snprintf(path, sizeof(path), "%s/%s", t->roots[root], t->dirs[dir].path);
+  else
+    snprintf(path, sizeof(path), "%s", t->roots[root]);
+
+  DIR *d = opendir(path);
+  if (!d)
+    return;
+  struct dirent *entry;
+  while ((entry = readdir(d)) != NULL) {
+    char name[256];
+    size_t len = strlen(entry->d_name);
+    if (len < 5 || len >= sizeof(name))
+      continue;
+    const char *ext = entry->d_name + len - 4;
+    bool svg = strcmp(ext, ".svg") == 0;
+#ifndef HAVE_RSVG
+    if (svg)
+      continue; /* Can't be rendered anyway */
+#endif
+    if (!svg && strcmp(ext, ".png") != 0)
       continue;
+    memcpy(name, entry->d_name, len - 4);
+    name[len - 4] = '\0';
+    index_add(t, name, dir, root, svg);
+  }
+  closedir(d);
+}
 
-    /* Try theme/size/category/icon format */
-    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
-      for (size_t c = 0; c < sizeof(categories) / sizeof(categories[0]); c++) {
-        for (size_t e = 0; e < sizeof(extensions) / sizeof(extensions[0]);
-             e++) {
-          snprintf(path, sizeof(path), "%s/%s/%s/%s/%s%s", icon_dirs[d], theme,
-                   sizes[s], categories[c], icon_name, extensions[e]);
-          if (file_exists(path))
-            return path;
-        }
-      }
+static int add_dir(ThemeIndex *t, const char *path) {
+  IconDir *dirs = realloc(t->dirs, (t->dir_count + 1) * sizeof(IconDir));
+  if (!dirs)
+    return -1;
+  t->dirs = dirs;
+  IconDir *d = &t->dirs[t->dir_count];
+  memset(d, 0, sizeof(*d));
+  if (!(d->path = strdup(path)))
+    return -1;
+  d->type = DIR_THRESHOLD;
+  d->threshold = 2;
+  d->scale = 1;
+  return t->dir_count++;
+}
+
+static int find_dir(ThemeIndex *t, const char *path) {
+  for (int i = 0; i < t->dir_count; i++) {
+    if (strcmp(t->dirs[i].path, path) == 0)
+      return i;
+  }
+  return -1;
+}
+
+static void add_dir_list(ThemeIndex *t, char *list) {
+  char *save;
+  for (char *tok = strtok_r(list, ",", &save); tok;
+       tok = strtok_r(NULL, ",", &save)) {
+    char *path = trim(tok);
+    if (!path[0])
+      continue;
+    int i = find_dir(t, path);
+    if (i < 0)
+      i = add_dir(t, path);
+    if (i >= 0)
+      t->dirs[i].listed = true;
+  }
+}
+
+/* Directories, Inherits and per-directory Size/Type/... from index.theme */
+static bool parse_index_theme(ThemeIndex *t, const char *path) {
+  FILE *fp = fopen(path, "r");
+  if (!fp)
+    return false;
+
+  char line[4096];
+  char section[MAX_PATH] = "";
+  IconDir *dir = NULL;
+  bool main_section = false;
+  while (fgets(line, sizeof(line), fp)) {
+    char *s = trim(line);
+    if (s[0] == '#' || !s[0])
+      continue;
+    if (s[0] == '[') {
+      char *end = strchr(s, ']');
+      if (end)
+        *end = '\0';
+      snprintf(section, sizeof(section), "%s", s + 1);
+      main_section = strcmp(section, "Icon Theme") == 0;
+      /* Directory sections follow the list in practice; tolerate either */
+      int i = main_section ? -1 : find_dir(t, section);
+      if (!main_section && i < 0)
+        i = add_dir(t, section);
+      dir = i >= 0 ? &t->dirs[i] : NULL;
+      continue;
     }
 
-    /* Try theme/category/size/icon format (alternate layout) */
-    for (size_t c = 0; c < sizeof(categories) / sizeof(categories[0]); c++) {
-      for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
-        for (size_t e = 0; e < sizeof(extensions) / sizeof(extensions[0]);
-             e++) {
-          snprintf(path, sizeof(path), "%s/%s/%s/%s/%s%s", icon_dirs[d], theme,
-                   categories[c], sizes[s], icon_name, extensions[e]);
-          if (file_exists(path))
-            return path;
+    char *eq = strchr(s, '=');
+    if (!eq)
+      continue;
+    *eq = '\0';
+    char *key = trim(s), *val = trim(eq + 1);
+
+    if (main_section) {
+      if (strcmp(key, "Directories") == 0 ||
+          strcmp(key, "ScaledDirectories") == 0) {
+        add_dir_list(t, val);
+      } else if (strcmp(key, "Inherits") == 0) {
+        char *save;
+        for (char *tok = strtok_r(val, ",", &save); tok;
+             tok = strtok_r(NULL, ",", &save)) {
+          char *name = trim(tok);
+          if (name[0] && t->inherit_count < 8)
+            t->inherits[t->inherit_count++] = strdup(name);
         }
       }
+    } else if (dir) {
+      if (strcmp(key, "Size") == 0)
+        dir->size = atoi(val);
+      else if (strcmp(key, "MinSize") == 0)
+        dir->min_size = atoi(val);
+      else if (strcmp(key, "MaxSize") == 0)
+        dir->max_size = atoi(val);
+      else if (strcmp(key, "Threshold") == 0)
+        dir->threshold = atoi(val);
+      else if (strcmp(key, "Scale") == 0)
+        dir->scale = atoi(val) > 0 ? atoi(val) : 1;
+      else if (strcmp(key, "Type") == 0)
+        dir->type = strcmp(val, "Fixed") == 0      ? DIR_FIXED
+                    : strcmp(val, "Scalable") == 0 ? DIR_SCALABLE
+                                                   : DIR_THRESHOLD;
     }
   }
+  fclose(fp);
 
-  /* Try pixmaps as last resort */
-  for (size_t e = 0; e < sizeof(extensions) / sizeof(extensions[0]); e++) {
-    snprintf(path, sizeof(path), "/usr/share/pixmaps/%s%s", icon_name,
-             extensions[e]);
-    if (file_exists(path))
-      return path;
+  /* Sections for directories the theme doesn't list are ignored by the
+   * spec; drop them so nothing is indexed from there */
+  for (int i = 0; i < t->dir_count; i++) {
+    if (!t->dirs[i].listed || t->dirs[i].size <= 0) {
+      free(t->dirs[i].path);
+      t->dirs[i--] = t->dirs[--t->dir_count];
+    } else {
+      if (!t->dirs[i].min_size)
+        t->dirs[i].min_size = t->dirs[i].size;
+      if (!t->dirs[i].max_size)
+        t->dirs[i].max_size = t->dirs[i].size;
+    }
   }
+  return true;
+}
 
-  return NULL;
+/* Size from a path component like "48x48", "48x48@2", "48" or
+ * "scalable" */
+static void guess_dir_size(IconDir *d) {
+  char buf[MAX_PATH], *save;
+  snprintf(buf, sizeof(buf), "%s", d->path);
+  for (char *tok = strtok_r(buf, "/", &save); tok;
+       tok = strtok_r(NULL, "/", &save)) {
+    int w, h, s;
+    char c;
+    if (strcmp(tok, "scalable") == 0) {
+      d->type = DIR_SCALABLE;
+      d->size = 128;
+      d->min_size = 1;
+      d->max_size = 512;
+      return;
+    }
+    if (sscanf(tok, "%dx%d@%d%c", &w, &h, &s, &c) == 3 && s > 0) {
+      d->size = d->min_size = d->max_size = w;
+      d->scale = s;
+      return;
+    }
+    if (sscanf(tok, "%dx%d%c", &w, &h, &c) == 2 ||
+        sscanf(tok, "%d%c", &w, &c) == 1) {
+      d->size = d->min_size = d->max_size = w;
+      return;
+    }
+  }
 }
 
-/* =========================================================================
- * DESKTOP FILE HANDLING
- * ========================================================================= */
+/* Themes without index.theme: index two levels (size/category or
+ * category/size) and guess sizes from the directory names */
+static void scan_theme_dirs(ThemeIndex *t, const char *root) {
+  DIR *d = opendir(root);
+  if (!d)
+    return;
+  struct dirent *a;
+  while ((a = readdir(d)) != NULL) {
+    if (a->d_name[0] == '.')
+      continue;
+    char path[MAX_PATH];
+    snprintf(path, sizeof(path), "%s/%s", root, a->d_name);
+    DIR *sub = opendir(path);
+    if (!sub)
+      continue;
+    if (find_dir(t, a->d_name) < 0)
+      add_dir(t, a->d_name);
+    struct dirent *b;
+    while ((b = readdir(sub)) != NULL) {
+      if (b->d_name[0] == '.' || b->d_type == DT_REG)
+        continue;
+      char rel[MAX_PATH];
+      snprintf(rel, sizeof(rel), "%s/%s", a->d_name, b->d_name);
+      if (find_dir(t, rel) < 0)
+        add_dir(t, rel);
+    }
+    closedir(sub);
+  }
+  closedir(d);
 
-/* Scan directory for desktop file matching class name */
-static char *find_desktop_file_by_scan(const char *class_name) {
-  static char found_path[MAX_PATH];
-  char lowercase_class[128];
-  to_lowercase(lowercase_class, class_name, sizeof(lowercase_class));
+  for (int i = 0; i < t->dir_count; i++)
+    guess_dir_size(&t->dirs[i]);
+}
 
-  for (int d = 0; desktop_dirs[d]; d++) {
-    DIR *dir = opendir(desktop_dirs[d]);
-    if (!dir)
+/* Parsed index for a theme, built on first use (an empty index for
+ * themes that aren't installed, so they aren't probed again) */
+static ThemeIndex *theme_index(const char *name) {
+  for (ThemeIndex *t = theme_indexes; t; t = t->next) {
+    if (strcmp(t->name, name) == 0)
+      return t;
+  }
+
+  ThemeIndex *t = calloc(1, sizeof(ThemeIndex));
+  if (!t)
+    return NULL;
+  snprintf(t->name, sizeof(t->name), "%s", name);
+  t->next = theme_indexes;
+  theme_indexes = t;
+
+  double t0 = now_ms();
+  struct stat st;
+  bool have_index = false;
+  for (int d = 0; icon_dirs[d] && t->root_count < 8; d++) {
+    if (!icon_dirs[d][0])
       continue;
+    char root[MAX_PATH];
+    snprintf(root, sizeof(root), "%s/%s", icon_dirs[d], name);
+    if (stat(root, &st) != 0 || !S_ISDIR(st.st_mode))
+      continue;
+    t->roots[t->root_count++] = strdup(root);
+    watch_dir(root, WATCH_ICONS);
+
+    /* The first index.theme found is the theme's description */
+    if (!have_index) {
+      char index[MAX_PATH + 16];
+      snprintf(index, sizeof(index), "%s/index.theme", root);
+      have_index = parse_index_theme(t, index);
+    }
+  }
+  if (!have_index && t->root_count > 0)
+    scan_theme_dirs(t, t->roots[0]);
 
-    struct dirent *entry;
-    while ((entry = readdir(dir)) != NULL) {
-      if (entry->d_type != DT_REG && entry->d_type != DT_LNK)
-        continue;
+  for (int r = 0; r < t->root_count; r++) {
+    if (!t->roots[r])
+      continue;
+    for (int i = 0; i < t->dir_count; i++)
+      index_directory(t, i, r);
+  }
 
-      const char *name = entry->d_name;
-      size_t len = strlen(name);
-      if (len < 9 || strcmp(name + len - 8, ".desktop") != 0)
-        continue;
+  if (t->root_count > 0)
+    LOG("Indexed theme %s: %d dirs, %u icons in %.1f ms", name, t->dir_count,
+        t->name_count, now_ms() - t0);
+  return t;
+}
 
-      /* Convert filename to lowercase for comparison */
-      char lowercase_name[256];
-      to_lowercase(lowercase_name, name, sizeof(lowercase_name));
+/* Flat /usr/share/pixmaps, consulted after every theme */
+static ThemeIndex *pixmaps_index(void) {
+  static const char *name = " pixmaps"; /* Can't clash with a theme */
+  for (ThemeIndex *t = theme_indexes; t; t = t->next) {
+    if (strcmp(t->name, name) == 0)
+      return t;
+  }
 
-      /* Check various patterns:
-       * 1. classname.desktop
-       * 2. org.something.classname.desktop
-       * 3. com.company.classname.desktop
-       */
-      if (strstr(lowercase_name, lowercase_class) != NULL) {
-        snprintf(found_path, sizeof(found_path), "%s/%s", desktop_dirs[d],
-                 name);
-        closedir(dir);
-        LOG("Found desktop file: %s", found_path);
-        return found_path;
-      }
+  ThemeIndex *t = calloc(1, sizeof(ThemeIndex));
+  if (!t)
+    return NULL;
+  snprintf(t->name, sizeof(t->name), "%s", name);
+  t->next = theme_indexes;
+  theme_indexes = t;
+  t->roots[t->root_count++] = strdup("/usr/share/pixmaps");
+  if (t->roots[0] && add_dir(t, "") == 0)
+    index_directory(t, 0, 0);
+  return t;
+}
+
+static void chain_add(const char *name, int depth) {
+  if (depth > 8 || theme_chain_len >= MAX_THEME_CHAIN)
+    return;
+  ThemeIndex *t = theme_index(name);
+  if (!t)
+    return;
+  for (int i = 0; i < theme_chain_len; i++) {
+    if (theme_chain[i] == t)
+      return;
+  }
+  theme_chain[theme_chain_len++] = t;
+  for (int i = 0; i < t->inherit_count; i++) {
+    if (t->inherits[i] && strcmp(t->inherits[i], "hicolor") != 0)
+      chain_add(t->inherits[i], depth + 1);
+  }
+}
+
+/* Configured theme and its Inherits=, then the fallback's, then hicolor
+ * (always last, per the spec), then pixmaps */
+static void resolve_theme_chain(void) {
+  watch_sources();
+  theme_chain_len = 0;
+  chain_add(current_theme, 0);
+  chain_add(fallback_theme_name, 0);
+  chain_add("hicolor", 0);
+  ThemeIndex *pixmaps = pixmaps_index();
+  if (pixmaps && theme_chain_len < MAX_THEME_CHAIN)
+    theme_chain[theme_chain_len++] = pixmaps;
+}
+
+/* DirectorySizeDistance from the icon theme spec, in device pixels (a
+ * 48x48@2 directory holds 96 px images) */
+static int dir_distance(const IconDir *d, int size) {
+  int s = d->scale;
+  switch (d->type) {
+  case DIR_FIXED:
+    return abs(d->size * s - size);
+  case DIR_SCALABLE:
+    if (size < d->min_size * s)
+      return d->min_size * s - size;
+    if (size > d->max_size * s)
+      return size - d->max_size * s;
+    return 0;
+  case DIR_THRESHOLD:
+    if (size < (d->size - d->threshold) * s)
+      return d->min_size * s - size;
+    if (size > (d->size + d->threshold) * s)
+      return size - d->max_size * s;
+    return 0;
+  }
+  return INT_MAX;
+}
+
+/* How a variant gets to `size` pixels, cheapest first */
+typedef enum {
+  FIT_EXACT,    /* Raster at exactly that size: no scaling pass */
+  FIT_RENDERED, /* Matching SVG, rasterized straight at size */
+  FIT_NEAR,     /* Matching raster within the directory's range */
+  FIT_OTHER     /* Closest non-matching directory */
+} VariantFit;
+
+static VariantFit variant_fit(const IconDir *d, const IconVariant *v,
+                              int size, int distance) {
+  if (distance > 0)
+    return FIT_OTHER;
+  if (v->svg)
+    return FIT_RENDERED;
+  return d->type != DIR_SCALABLE && d->size * d->scale == size ? FIT_EXACT
+                                                               : FIT_NEAR;
+}
+
+/*
+ * Variant closest to `size` device pixels: an exact raster first, then a
+ * matching SVG or raster, else the smallest size distance. Ties go to the
+ * larger image (downscaling beats upscaling), then SVG over PNG.
+ */
+static const IconVariant *pick_variant(ThemeIndex *t, IconName *n, int size,
+                                       bool raster_only) {
+  const IconVariant *best = NULL;
+  VariantFit best_fit = FIT_OTHER;
+  int best_dist = INT_MAX, best_px = 0;
+  for (int i = 0; i < n->count; i++) {
+    const IconVariant *v = &n->variants[i];
+    if (raster_only && v->svg)
+      continue;
+    const IconDir *d = &t->dirs[v->dir];
+    int dist = dir_distance(d, size);
+    VariantFit fit = variant_fit(d, v, size, dist);
+    int px = d->size * d->scale;
+    bool better;
+    if (!best)
+      better = true;
+    else if (fit != best_fit)
+      better = fit < best_fit;
+    else if (dist != best_dist)
+      better = dist < best_dist;
+    else if (px != best_px)
+      better = px > best_px;
+    else
+      better = v->svg && !best->svg;
+    if (better) {
+      best = v;
+      best_fit = fit;
+      best_dist = dist;
+      best_px = px;
     }
-    closedir(dir);
   }
+  return best;
+}
+
+static char *find_icon_path(const char *icon_name, int size,
+                            bool raster_only) {
+  static char path[MAX_PATH];
+
+  if (theme_chain_len < 0)
+    resolve_theme_chain();
 
+  for (int i = 0; i < theme_chain_len; i++) {
+    ThemeIndex *t = theme_chain[i];
+    IconName *n = index_find(t, icon_name);
+    const IconVariant *v = n ? pick_variant(t, n, size, raster_only) : NULL;
+    if (!v)
+      continue;
+    const char *dir = t->dirs[v->dir].path;
+    snprintf(path, sizeof(path), "%s%s%s/%s.%s", t->roots[v->root],
+             dir[0] ? "/" : "", dir, icon_name, v->svg ? "svg" : "png");
+    return path;
+  }
   return NULL;
 }
 
-/* Extract Icon= from desktop file */
-static char *extract_icon_from_desktop(const char *desktop_path) {
-  static char icon_name[256];
-  FILE *fp = fopen(desktop_path, "r");
+static void free_theme_indexes(void) {
+  while (theme_indexes) {
+    ThemeIndex *t = theme_indexes;
+    theme_indexes = t->next;
+    for (unsigned b = 0; b < t->bucket_count; b++) {
+      IconName *n = t->buckets[b];
+      while (n) {
+        IconName *next = n->next;
+        free(n->name);
+        free(n->variants);
+        free(n);
+        n = next;
+      }
+    }
+    free(t->buckets);
+    for (int i = 0; i < t->dir_count; i++)
+      free(t->dirs[i].path);
+    free(t->dirs);
+    for (int i = 0; i < t->root_count; i++)
+      free(t->roots[i]);
+    for (int i = 0; i < t->inherit_count; i++)
+      free(t->inherits[i]);
+    free(t);
+  }
+  theme_chain_len = -1;
+}
+
+/* =========================================================================
+ * DESKTOP FILE HANDLING
+ * ========================================================================= */
+
+/*
+ * All .desktop files are read once into a hash map keyed by lowercase
+ * StartupWMClass, desktop file ID and the last component of reverse-DNS
+ * IDs (org.gnome.Nautilus -> nautilus). A change in the applications dirs
+ * drops it; it is rebuilt on the next lookup.
+ */
+
+typedef enum {
+  KEY_WM_CLASS, /* StartupWMClass= (most specific) */
+  KEY_ID,       /* Desktop file ID */
+  KEY_ID_TAIL,  /* Last dot-separated component of the ID */
+} DesktopKeyKind;
+
+typedef struct {
+  char *id;   /* Desktop file ID, lowercase */
+  char *icon; /* Icon= value */
+} DesktopEntry;
+
+typedef struct DesktopKey {
+  char *key;
+  int entry;
+  DesktopKeyKind kind;
+  struct DesktopKey *next;
+} DesktopKey;
+
+#define DESKTOP_BUCKETS 1024
+#define DESKTOP_MAX_DEPTH 2 /* Subdirectories become "dir-name" IDs */
+
+static DesktopEntry *desktop_entries = NULL;
+static int desktop_count = 0;
+static int desktop_capacity = 0;
+static DesktopKey *desktop_map[DESKTOP_BUCKETS];
+static bool desktop_indexed = false;
+
+static DesktopKey *desktop_find(const char *key, DesktopKeyKind kind) {
+  DesktopKey *k = desktop_map[hash_name(key) % DESKTOP_BUCKETS];
+  while (k && (k->kind != kind || strcmp(k->key, key) != 0))
+    k = k->next;
+  return k;
+}
+
+/* First entry wins: user dirs are scanned before system dirs */
+static void desktop_add_key(const char *key, int entry, DesktopKeyKind kind) {
+  if (!key[0] || desktop_find(key, kind))
+    return;
+  DesktopKey *k = malloc(sizeof(DesktopKey));
+  if (!k || !(k->key = strdup(key))) {
+    free(k);
+    return;
+  }
+  unsigned h = hash_name(key) % DESKTOP_BUCKETS;
+  k->entry = entry;
+  k->kind = kind;
+  k->next = desktop_map[h];
+  desktop_map[h] = k;
+}
+
+/* Icon= and StartupWMClass= from the [Desktop Entry] group; false for
+ * hidden (deleted) entries and ones without an icon */
+static bool parse_desktop_file(const char *path, char *icon, size_t icon_size,
+                               char *wm_class, size_t class_size) {
+  FILE *fp = fopen(path, "r");
   if (!fp)
-    return NULL;
+    return false;
 
   char line[512];
+  bool in_entry = false, hidden = false;
+  icon[0] = wm_class[0] = '\0';
   while (fgets(line, sizeof(line), fp)) {
-    if (strncmp(line, "Icon=", 5) == 0) {
-      char *value = line + 5;
-      /* Remove newline and whitespace */
-      char *end = value + strlen(value) - 1;
-      while (end > value && (*end == '\n' || *end == '\r' || *end == ' ')) {
-        *end-- = '\0';
-      }
-      strncpy(icon_name, value, sizeof(icon_name) - 1);
-      icon_name[sizeof(icon_name) - 1] = '\0';
-      fclose(fp);
-      return icon_name;
+    if (line[0] == '[') {
+      if (in_entry)
+        break;
+      in_entry = strncmp(line, "[Desktop Entry]", 15) == 0;
+      continue;
     }
+    if (!in_entry)
+      continue;
+    if (strncmp(line, "Icon=", 5) == 0)
+      snprintf(icon, icon_size, "%s", trim(line + 5));
+    else if (strncmp(line, "StartupWMClass=", 15) == 0)
+      snprintf(wm_class, class_size, "%s", trim(line + 15));
+    else if (strncmp(line, "Hidden=", 7) == 0)
+      hidden = strncmp(trim(line + 7), "true", 4) == 0;
   }
   fclose(fp);
-  return NULL;
+  return !hidden && icon[0];
+}
+
+static void index_desktop_file(const char *path, const char *id) {
+  char lower_id[256];
+  to_lowercase(lower_id, id, sizeof(lower_id));
+  if (desktop_find(lower_id, KEY_ID))
+    return; /* Shadowed by an earlier dir */
+
+  char icon[256], wm_class[128];
+  if (!parse_desktop_file(path, icon, sizeof(icon), wm_class,
+                          sizeof(wm_class)))
+    return;
+
+  if (desktop_count == desktop_capacity) {
+    int cap = desktop_capacity ? desktop_capacity * 2 : 256;
+    DesktopEntry *e = realloc(desktop_entries, cap * sizeof(DesktopEntry));
+    if (!e)
+      return;
+    desktop_entries = e;
+    desktop_capacity = cap;
+  }
+  DesktopEntry *e = &desktop_entries[desktop_count];
+  e->id = strdup(lower_id);
+  e->icon = strdup(icon);
+  if (!e->id || !e->icon) {
+    free(e->id);
+    free(e->icon);
+    return;
+  }
+  int index = desktop_count++;
+
+  char lower_class[128];
+  to_lowercase(lower_class, wm_class, sizeof(lower_class));
+  desktop_add_key(lower_class, index, KEY_WM_CLASS);
+  desktop_add_key(lower_id, index, KEY_ID);
+  const char *tail = strrchr(lower_id, '.');
+  if (tail)
+    desktop_add_key(tail + 1, index, KEY_ID_TAIL);
+}
+
+/* `prefix` is the ID prefix for files in subdirectories ("kde4-") */
+static void index_desktop_dir(const char *dir, const char *prefix, int depth) {
+  DIR *d = opendir(dir);
+  if (!d)
+    return;
+
+  struct dirent *entry;
+  while ((entry = readdir(d)) != NULL) {
+    const char *name = entry->d_name;
+    if (name[0] == '.')
+      continue;
+
+    char path[MAX_PATH];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    size_t len = strlen(name);
+
+    if (entry->d_type == DT_DIR) {
+      if (depth < DESKTOP_MAX_DEPTH) {
+        char sub[256];
+        snprintf(sub, sizeof(sub), "%s%s-", prefix, name);
+        watch_dir(path, WATCH_DESKTOP);
+        index_desktop_dir(path, sub, depth + 1);
+      }
+      continue;
+    }
+    if (entry->d_type != DT_REG && entry->d_type != DT_LNK &&
+        entry->d_type != DT_UNKNOWN)
+      continue;
+    if (len < 9 || strcmp(name + len - 8, ".desktop") != 0)
+      continue;
+
+    char id[256];
+    snprintf(id, sizeof(id), "%s%.*s", prefix, (int)(len - 8), name);
+    index_desktop_file(path, id);
+  }
+  closedir(d);
+}
+
+static void free_desktop_index(void) {
+  for (int b = 0; b < DESKTOP_BUCKETS; b++) {
+    DesktopKey *k = desktop_map[b];
+    while (k) {
+      DesktopKey *next = k->next;
+      free(k->key);
+      free(k);
+      k = next;
+    }
+    desktop_map[b] = NULL;
+  }
+  for (int i = 0; i < desktop_count; i++) {
+    free(desktop_entries[i].id);
+    free(desktop_entries[i].icon);
+  }
+  free(desktop_entries);
+  desktop_entries = NULL;
+  desktop_count = desktop_capacity = 0;
+  desktop_indexed = false;
+}
+
+static void build_desktop_index(void) {
+  double t0 = now_ms();
+  watch_sources();
+  for (int d = 0; desktop_dirs[d]; d++) {
+    if (desktop_dirs[d][0])
+      index_desktop_dir(desktop_dirs[d], "", 0);
+  }
+  desktop_indexed = true;
+  LOG("Indexed %d desktop entries in %.1f ms", desktop_count,
+      now_ms() - t0);
 }
 
 /* Find icon name from desktop file for a class name */
 static char *find_desktop_icon(const char *class_name) {
   static char icon_name[256];
-  char desktop_path[MAX_PATH];
   char lowercase[128];
   to_lowercase(lowercase, class_name, sizeof(lowercase));
 
-  /* Method 1: Try direct match lowercase.desktop */
-  for (int d = 0; desktop_dirs[d]; d++) {
-    snprintf(desktop_path, sizeof(desktop_path), "%s/%s.desktop",
-             desktop_dirs[d], lowercase);
-    if (file_exists(desktop_path)) {
-      char *icon = extract_icon_from_desktop(desktop_path);
-      if (icon)
-        return icon;
-    }
-  }
-
-  /* Method 2: Scan directories for matching desktop file */
-  char *found = find_desktop_file_by_scan(class_name);
-  if (found) {
-    char *icon = extract_icon_from_desktop(found);
-    if (icon)
-      return icon;
-  }
-
-  /* Method 3: Try common flatpak patterns */
-  const char *flatpak_patterns[] = {"org.gnome.%s",   "org.kde.%s",
-                                    "org.mozilla.%s", "com.github.%s",
-                                    "io.github.%s",   NULL};
-  for (int p = 0; flatpak_patterns[p]; p++) {
-    for (int d = 0; desktop_dirs[d]; d++) {
-      snprintf(desktop_path, sizeof(desktop_path), flatpak_patterns[p],
-               class_name);
-      char full_path[768]; /* Larger to avoid truncation */
-      snprintf(full_path, sizeof(full_path), "%s/%s.desktop", desktop_dirs[d],
-               desktop_path);
-      if (file_exists(full_path)) {
-        char *icon = extract_icon_from_desktop(full_path);
-        if (icon)
-          return icon;
-      }
+  if (!desktop_indexed)
+    build_desktop_index();
+
+  /* StartupWMClass, then the file ID, then reverse-DNS tails */
+  for (int kind = KEY_WM_CLASS; kind <= KEY_ID_TAIL; kind++) {
+    DesktopKey *k = desktop_find(lowercase, kind);
+    if (k) {
+      snprintf(icon_name, sizeof(icon_name), "%s",
+               desktop_entries[k->entry].icon);
+      return icon_name;
     }
   }
 
@@ -370,6 +1384,41 @@ static char *find_desktop_icon(const char *class_name) {
  * ICON LOADERS
  * ========================================================================= */
 
+/* Downscale into a centered size x size box, or NULL if the kernel can't */
+static cairo_surface_t *reduce_icon(cairo_surface_t *src, int size) {
+  cairo_format_t format = cairo_image_surface_get_format(src);
+  int sw = cairo_image_surface_get_width(src);
+  int sh = cairo_image_surface_get_height(src);
+  if ((format != CAIRO_FORMAT_ARGB32 && format != CAIRO_FORMAT_RGB24) ||
+      (sw <= size && sh <= size))
+    return NULL;
+
+  double s = fmin((double)size / sw, (double)size / sh);
+  int w = (int)lround(sw * s), h = (int)lround(sh * s);
+  if (w < 1 || h < 1)
+    return NULL;
+
+  cairo_surface_t *dst =
+      cairo_image_surface_create(CAIRO_FORMAT_ARGB32, size, size);
+  if (cairo_surface_status(dst) != CAIRO_STATUS_SUCCESS) {
+    cairo_surface_destroy(dst);
+    return NULL;
+  }
+  cairo_surface_flush(src);
+  cairo_surface_flush(dst);
+  int stride = cairo_image_surface_get_stride(dst);
+  unsigned char *out = cairo_image_surface_get_data(dst) +
+                       (size_t)((size - h) / 2) * stride + (size - w) / 2 * 4;
+  if (!scale_argb32(cairo_image_surface_get_data(src), sw, sh,
+                    cairo_image_surface_get_stride(src), out, w, h, stride,
+                    format == CAIRO_FORMAT_RGB24)) {
+    cairo_surface_destroy(dst);
+    return NULL;
+  }
+  cairo_surface_mark_dirty(dst);
+  return dst;
+}
+
 /* Load PNG icon with high-quality scaling */
 static cairo_surface_t *load_png_icon(const char *path, int size) {
   cairo_surface_t *surface = cairo_image_surface_create_from_png(path);
@@ -381,6 +1430,14 @@ static cairo_surface_t *load_png_icon(const char *path, int size) {
   int orig_w = cairo_image_surface_get_width(surface);
   int orig_h = cairo_image_surface_get_height(surface);
 
+  /* Reductions (the common case: 128/256 px art on a 56 px card) take the
+   * box-filter kernel; cairo handles the rest */
+  cairo_surface_t *reduced = reduce_icon(surface, size);
+  if (reduced) {
+    cairo_surface_destroy(surface);
+    return reduced;
+  }
+
   if (orig_w != size || orig_h != size) {
     cairo_surface_t *scaled =
         cairo_image_surface_create(CAIRO_FORMAT_ARGB32, size, size);
@@ -505,165 +1562,1076 @@ static cairo_surface_t *load_svg_icon(const char *path, int size) {
 #endif
 
 /* =========================================================================
- * PUBLIC API
+ * PERSISTENT PATH CACHE
  * ========================================================================= */
 
-/* Initialize icon system */
-void icons_init(const char *theme_name, const char *fallback) {
-  init_paths();
+/*
+ * Resolved class -> icon file paths (and misses) outlive the daemon in
+ * $XDG_CACHE_HOME/snappy-switcher/icon-paths.cache. The file is trusted
+ * while the theme/fallback names match and none of the recorded dirs (icon
+ * and applications base dirs, theme roots in the chain) changed mtime, so
+ * a cold start loads icons without indexing themes or desktop files.
+ */
 
-  if (theme_name && theme_name[0]) {
-    strncpy(current_theme, theme_name, sizeof(current_theme) - 1);
-    current_theme[sizeof(current_theme) - 1] = '\0';
-  }
-  if (fallback && fallback[0]) {
-    strncpy(fallback_theme_name, fallback, sizeof(fallback_theme_name) - 1);
-    fallback_theme_name[sizeof(fallback_theme_name) - 1] = '\0';
-  }
+#define PATH_CACHE_MAGIC "SNPYIP05" /* Bumped when lookups pick differently */
+#define PATH_CACHE_BUCKETS 256
+#define MAX_STAMPS 8192 /* Sanity bound when reading */
 
-  cache_count = 0;
-  LOG("Initialized: theme=%s, fallback=%s", current_theme, fallback_theme_name);
+typedef struct PathEntry {
+  char *class_name;
+  int size;
+  char *path; /* "" for a miss */
+  struct PathEntry *next;
+} PathEntry;
+
+typedef struct {
+  char *path;
+  int64_t sec;
+  int64_t nsec;
+} DirStamp;
+
+static PathEntry *path_cache[PATH_CACHE_BUCKETS];
+static DirStamp *stamps = NULL;
+static int stamp_count = 0;
+static int stamp_capacity = 0;
+static bool path_cache_enabled = false; /* Daemon only, not the bench */
+static bool path_cache_dirty = false;
+static unsigned path_epoch = 0; /* Bumped on drops, like icon_cache.epoch */
+static char path_cache_file[MAX_PATH];
+static char raster_file[MAX_PATH];
+
+static unsigned path_bucket(const char *class_name, int size) {
+  return (hash_name(class_name) + (unsigned)size * 31) % PATH_CACHE_BUCKETS;
 }
 
-/* Load app icon by class name */
-cairo_surface_t *load_app_icon(const char *class_name, int size) {
-  if (!class_name || !class_name[0])
-    return NULL;
+static PathEntry *path_cache_find(const char *class_name, int size) {
+  PathEntry *e = path_cache[path_bucket(class_name, size)];
+  while (e && (e->size != size || strcmp(e->class_name, class_name) != 0))
+    e = e->next;
+  return e;
+}
 
-  /* Apply class name mapping first */
-  const char *effective_class = get_mapped_class(class_name);
-  if (effective_class) {
-    LOG("Mapped class '%s' -> '%s'", class_name, effective_class);
+static void path_cache_put(const char *class_name, int size,
+                           const char *path) {
+  if (!path_cache_enabled)
+    return;
+  PathEntry *e = path_cache_find(class_name, size);
+  if (e) {
+    if (strcmp(e->path, path) == 0)
+      return;
+    char *copy = strdup(path);
+    if (!copy)
+      return;
+    free(e->path);
+    e->path = copy;
   } else {
-    effective_class = class_name;
+    e = calloc(1, sizeof(PathEntry));
+    if (!e || !(e->class_name = strdup(class_name)) ||
+        !(e->path = strdup(path))) {
+      if (e)
+        free(e->class_name);
+      free(e);
+      return;
+    }
+    unsigned b = path_bucket(class_name, size);
+    e->size = size;
+    e->next = path_cache[b];
+    path_cache[b] = e;
   }
+  path_cache_dirty = true;
+}
 
-  /* Check cache using ORIGINAL class name (for consistency) */
-  for (int i = 0; i < cache_count; i++) {
-    if (strcmp(icon_cache[i].class_name, class_name) == 0 &&
-        icon_cache[i].size == size) {
-      if (icon_cache[i].surface) {
-        cairo_surface_reference(icon_cache[i].surface);
+/* Drop misses (all_entries: everything) */
+static void path_cache_drop(bool all_entries) {
+  path_epoch++;
+  for (int b = 0; b < PATH_CACHE_BUCKETS; b++) {
+    PathEntry **link = &path_cache[b];
+    while (*link) {
+      PathEntry *e = *link;
+      if (all_entries || !e->path[0]) {
+        *link = e->next;
+        free(e->class_name);
+        free(e->path);
+        free(e);
+        path_cache_dirty = true;
+      } else {
+        link = &e->next;
       }
-      return icon_cache[i].surface;
     }
   }
+}
 
-  /* Find icon name from desktop file using effective (mapped) class */
-  char *icon_name = find_desktop_icon(effective_class);
-  LOG("Class '%s' -> icon '%s'", effective_class,
-      icon_name ? icon_name : "(null)");
+static void clear_stamps(void) {
+  for (int i = 0; i < stamp_count; i++)
+    free(stamps[i].path);
+  free(stamps);
+  stamps = NULL;
+  stamp_count = stamp_capacity = 0;
+}
+
+static bool push_stamp(const char *path, int64_t sec, int64_t nsec) {
+  if (stamp_count >= MAX_STAMPS)
+    return false;
+  if (stamp_count == stamp_capacity) {
+    int cap = stamp_capacity ? stamp_capacity * 2 : 256;
+    DirStamp *s = realloc(stamps, cap * sizeof(DirStamp));
+    if (!s)
+      return false;
+    stamps = s;
+    stamp_capacity = cap;
+  }
+  if (!(stamps[stamp_count].path = strdup(path)))
+    return false;
+  stamps[stamp_count].sec = sec;
+  stamps[stamp_count].nsec = nsec;
+  stamp_count++;
+  return true;
+}
+
+static void add_stamp(const char *path) {
+  struct stat st;
+  if (!path[0])
+    return;
+  /* A missing dir is recorded too: creating it invalidates the cache */
+  bool found = stat(path, &st) == 0;
+  push_stamp(path, found ? (int64_t)st.st_mtim.tv_sec : -1,
+             found ? (int64_t)st.st_mtim.tv_nsec : -1);
+}
+
+/* Subdirectories index_desktop_dir() reads */
+static void add_desktop_stamps(const char *dir, int depth) {
+  DIR *d = opendir(dir);
+  if (!d)
+    return;
+  struct dirent *entry;
+  while ((entry = readdir(d)) != NULL) {
+    if (entry->d_name[0] == '.' || entry->d_type != DT_DIR)
+      continue;
+    char path[MAX_PATH];
+    snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+    add_stamp(path);
+    if (depth + 1 < DESKTOP_MAX_DEPTH)
+      add_desktop_stamps(path, depth + 1);
+  }
+  closedir(d);
+}
+
+/* Every dir the indexes read: adding an icon or a desktop file changes
+ * the mtime of the dir it lands in, not of the base dir */
+static void collect_stamps(void) {
+  clear_stamps();
+  if (theme_chain_len < 0)
+    resolve_theme_chain();
+  for (int d = 0; icon_dirs[d]; d++)
+    add_stamp(icon_dirs[d]);
+  for (int d = 0; desktop_dirs[d]; d++) {
+    add_stamp(desktop_dirs[d]);
+    if (desktop_dirs[d][0])
+      add_desktop_stamps(desktop_dirs[d], 0);
+  }
+  for (int i = 0; i < theme_chain_len; i++) {
+    ThemeIndex *t = theme_chain[i];
+    for (int r = 0; r < t->root_count; r++) {
+      if (!t->roots[r])
+        continue;
+      add_stamp(t->roots[r]);
+      for (int dir = 0; dir < t->dir_count; dir++) {
+        if (!t->dirs[dir].path[0])
+          continue; /* The root itself (pixmaps) */
+        char path[MAX_PATH];
+        snprintf(path, sizeof(path), "%s/%s", t->roots[r], t->dirs[dir].path);
+        add_stamp(path);
+      }
+    }
+  }
+}
+
+static bool stamps_valid(void) {
+  for (int i = 0; i < stamp_count; i++) {
+    struct stat st;
+    bool found = stat(stamps[i].path, &st) == 0;
+    if ((found ? (int64_t)st.st_mtim.tv_sec : -1) != stamps[i].sec ||
+        (found ? (int64_t)st.st_mtim.tv_nsec : -1) != stamps[i].nsec)
+      return false;
+  }
+  return true;
+}
+
+static void write_str(FILE *fp, const char *s) {
+  uint16_t len = (uint16_t)strlen(s);
+  fwrite(&len, sizeof(len), 1, fp);
+  fwrite(s, 1, len, fp);
+}
+
+static bool read_str(FILE *fp, char *buf, size_t size) {
+  uint16_t len;
+  if (fread(&len, sizeof(len), 1, fp) != 1 || len >= size ||
+      fread(buf, 1, len, fp) != len)
+    return false;
+  buf[len] = '\0';
+  return true;
+}
+
+static bool read_path_cache(FILE *fp) {
+  char magic[8], buf[MAX_PATH], path[MAX_PATH];
+  if (fread(magic, 1, 8, fp) != 8 || memcmp(magic, PATH_CACHE_MAGIC, 8) != 0)
+    return false;
+  if (!read_str(fp, buf, sizeof(buf)) || strcmp(buf, current_theme) != 0 ||
+      !read_str(fp, path, sizeof(path)) ||
+      strcmp(path, fallback_theme_name) != 0)
+    return false;
+
+  uint32_t n;
+  if (fread(&n, sizeof(n), 1, fp) != 1 || n != rules_stamp)
+    return false;
+  if (fread(&n, sizeof(n), 1, fp) != 1 || n > MAX_STAMPS)
+    return false;
+  for (uint32_t i = 0; i < n; i++) {
+    int64_t t[2];
+    if (!read_str(fp, buf, sizeof(buf)) || fread(t, sizeof(t), 1, fp) != 1 ||
+        !push_stamp(buf, t[0], t[1]))
+      return false;
+  }
+  if (!stamps_valid())
+    return false;
+
+  if (fread(&n, sizeof(n), 1, fp) != 1)
+    return false;
+  for (uint32_t i = 0; i < n; i++) {
+    int32_t size;
+    if (!read_str(fp, buf, sizeof(buf)) ||
+        fread(&size, sizeof(size), 1, fp) != 1 ||
+        !read_str(fp, path, sizeof(path)))
+      return false;
+    path_cache_put(buf, size, path);
+  }
+  return true;
+}
+
+static void load_path_cache(void) {
+  const char *cache_home = getenv("XDG_CACHE_HOME");
+  const char *home = getenv("HOME");
+  char dir[MAX_PATH];
+  if (cache_home && cache_home[0])
+    snprintf(dir, sizeof(dir), "%s", cache_home);
+  else if (home)
+    snprintf(dir, sizeof(dir), "%s/.cache", home);
+  else
+    return;
+  mkdir(dir, 0755);
+  strncat(dir, "/snappy-switcher", sizeof(dir) - strlen(dir) - 1);
+  if (mkdir(dir, 0755) < 0 && errno != EEXIST) {
+    LOG("Cannot create cache dir %s: %s", dir, strerror(errno));
+    return;
+  }
+  snprintf(path_cache_file, sizeof(path_cache_file), "%s/icon-paths.cache",
+           dir);
+  snprintf(raster_file, sizeof(raster_file), "%s/icons.bin", dir);
+
+  path_cache_enabled = true;
+  path_cache_drop(true);
+  clear_stamps();
+
+  FILE *fp = fopen(path_cache_file, "rb");
+  if (!fp)
+    return;
+  bool ok = read_path_cache(fp);
+  fclose(fp);
+  if (ok) {
+    LOG("Icon path cache loaded: %s", path_cache_file);
+    path_cache_dirty = false;
+  } else {
+    LOG("Icon path cache is stale, resolving afresh");
+    path_cache_drop(true);
+    clear_stamps();
+    path_cache_dirty = false; /* Rewritten once something resolves */
+  }
+}
+
+static void save_path_cache(void) {
+  if (!path_cache_dirty)
+    return;
+
+  /* Re-stamp only when something was resolved against the themes; a
+   * session served entirely from the file keeps its stamps */
+  if (theme_chain_len >= 0 || stamp_count == 0)
+    collect_stamps();
+
+  char tmp[MAX_PATH + 8];
+  snprintf(tmp, sizeof(tmp), "%s.tmp", path_cache_file);
+  FILE *fp = fopen(tmp, "wb");
+  if (!fp) {
+    LOG("Cannot write %s: %s", tmp, strerror(errno));
+    return;
+  }
+
+  fwrite(PATH_CACHE_MAGIC, 1, 8, fp);
+  write_str(fp, current_theme);
+  write_str(fp, fallback_theme_name);
+  fwrite(&rules_stamp, sizeof(rules_stamp), 1, fp);
+  uint32_t n = (uint32_t)stamp_count;
+  fwrite(&n, sizeof(n), 1, fp);
+  for (int i = 0; i < stamp_count; i++) {
+    int64_t t[2] = {stamps[i].sec, stamps[i].nsec};
+    write_str(fp, stamps[i].path);
+    fwrite(t, sizeof(t), 1, fp);
+  }
+
+  n = 0;
+  for (int b = 0; b < PATH_CACHE_BUCKETS; b++) {
+    for (PathEntry *e = path_cache[b]; e; e = e->next)
+      n++;
+  }
+  fwrite(&n, sizeof(n), 1, fp);
+  for (int b = 0; b < PATH_CACHE_BUCKETS; b++) {
+    for (PathEntry *e = path_cache[b]; e; e = e->next) {
+      int32_t size = e->size;
+      write_str(fp, e->class_name);
+      fwrite(&size, sizeof(size), 1, fp);
+      write_str(fp, e->path);
+    }
+  }
+
+  bool ok = !ferror(fp);
+  if (fclose(fp) != 0)
+    ok = false;
+  if (ok && rename(tmp, path_cache_file) == 0) {
+    path_cache_dirty = false;
+  } else {
+    LOG("Failed to save icon path cache");
+    unlink(tmp);
+  }
+}
+
+/* =========================================================================
+ * PRE-RASTERIZED ICON CACHE
+ * ========================================================================= */
+
+/*
+ * Decoded icons (premultiplied ARGB32 at the device-pixel size they were
+ * drawn at) are kept in icons.bin next to the path cache. The file is
+ * mmap'd at startup and a hit is a zero-copy image surface over the
+ * mapping, valid while its source file keeps the recorded mtime. Records
+ * are hashed by (class, size) when mapped. Saves are written by a
+ * short-lived thread from a snapshot, outside resolve_lock.
+ */
+
+static cairo_surface_t *load_icon_file(const char *path, int size);
+
+#define RASTER_MAGIC "SNPYRI01"
+#define RASTER_MAX_ENTRIES 512
+#define RASTER_BUCKETS 1024
+#define RASTER_ALIGN 64
+
+typedef struct {
+  char magic[8];
+  uint32_t count;
+  uint32_t reserved;
+} RasterHeader;
+
+typedef struct {
+  char class_name[128];
+  char path[256];   /* Source icon file */
+  int32_t size;     /* Device pixels (icon_size x scale) */
+  uint32_t stride;
+  int64_t mtime_sec; /* Source file mtime at rasterization */
+  int64_t mtime_nsec;
+  uint64_t offset; /* Pixels, from the start of the file */
+} RasterRecord;
+
+/* Icons decoded this session, written out on the next save */
+typedef struct {
+  RasterRecord rec;
+  cairo_surface_t *surface;
+} RasterNote;
+
+typedef struct {
+  unsigned char *base;
+  size_t len;
+  int refs;     /* Surfaces viewing the mapping */
+  bool retired; /* Unmap once the last view is gone */
+} RasterMap;
+
+/* A save in progress: what it writes, and the sources it reads from */
+typedef struct {
+  RasterNote notes[RASTER_MAX_ENTRIES]; /* References taken */
+  int note_count;
+  RasterMap *map; /* Referenced while its records are copied out */
+  RasterRecord out[RASTER_MAX_ENTRIES];
+  const unsigned char *src[RASTER_MAX_ENTRIES];
+  uint32_t count;
+} RasterSave;
+
+static RasterMap *raster_map = NULL;
+static const RasterRecord *raster_records = NULL;
+static uint32_t raster_count = 0;
+static int32_t raster_buckets[RASTER_BUCKETS]; /* First record, -1: none */
+static int32_t raster_chain[RASTER_MAX_ENTRIES];
+static RasterNote raster_notes[RASTER_MAX_ENTRIES];
+static int raster_note_count = 0;
+static cairo_user_data_key_t raster_key;
+static pthread_t raster_writer;
+static bool raster_writing = false; /* Main thread only */
+static bool raster_written = false; /* Writer finished; resolve_lock */
+
+/* Views are destroyed on whichever thread drew them last */
+static pthread_mutex_t map_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void raster_map_unref(void *data) {
+  RasterMap *m = data;
+  pthread_mutex_lock(&map_lock);
+  bool last = --m->refs == 0 && m->retired;
+  pthread_mutex_unlock(&map_lock);
+  if (last) {
+    munmap(m->base, m->len);
+    free(m);
+  }
+}
 
-  if (!icon_name) {
-    /* Cache NULL result */
-    if (cache_count < MAX_CACHE) {
-      strncpy(icon_cache[cache_count].class_name, class_name, 127);
-      icon_cache[cache_count].size = size;
-      icon_cache[cache_count].surface = NULL;
-      cache_count++;
+static void raster_map_retire(void) {
+  if (!raster_map)
+    return;
+  pthread_mutex_lock(&map_lock);
+  raster_map->retired = true;
+  raster_map->refs++;
+  pthread_mutex_unlock(&map_lock);
+  raster_map_unref(raster_map);
+  raster_map = NULL;
+  raster_records = NULL;
+  raster_count = 0;
+}
+
+static unsigned raster_bucket(const char *class_name, int size) {
+  return (hash_name(class_name) + (unsigned)size * 31) % RASTER_BUCKETS;
+}
+
+/* Index of the mapped record for (class, size), -1 if none */
+static int32_t raster_find(const char *class_name, int size) {
+  if (!raster_map)
+    return -1;
+  int32_t i = raster_buckets[raster_bucket(class_name, size)];
+  while (i >= 0 && (raster_records[i].size != size ||
+                    strcmp(raster_records[i].class_name, class_name) != 0))
+    i = raster_chain[i];
+  return i;
+}
+
+/* Strings terminated and pixels inside the mapping */
+static bool raster_record_valid(const RasterRecord *r, size_t len) {
+  return memchr(r->class_name, '\0', sizeof(r->class_name)) &&
+         memchr(r->path, '\0', sizeof(r->path)) && r->size > 0 &&
+         r->stride >= (uint32_t)r->size * 4 && r->offset % 4 == 0 &&
+         r->offset <= len && (uint64_t)r->stride * r->size <= len - r->offset;
+}
+
+static bool file_mtime(const char *path, int64_t *sec, int64_t *nsec) {
+  struct stat st;
+  if (stat(path, &st) != 0)
+    return false;
+  *sec = st.st_mtim.tv_sec;
+  *nsec = st.st_mtim.tv_nsec;
+  return true;
+}
+
+static void load_raster_cache(void) {
+  raster_map_retire();
+  int fd = open(raster_file, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(RasterHeader)) {
+    close(fd);
+    return;
+  }
+  /* Private and writable: a stray write copies a page instead of faulting */
+  void *base = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd,
+                    0);
+  close(fd);
+  if (base == MAP_FAILED)
+    return;
+
+  const RasterHeader *h = base;
+  size_t table = sizeof(RasterHeader) + (size_t)h->count * sizeof(RasterRecord);
+  if (memcmp(h->magic, RASTER_MAGIC, 8) != 0 ||
+      h->count > RASTER_MAX_ENTRIES || table > (size_t)st.st_size) {
+    LOG("Ignoring invalid raster cache %s", raster_file);
+    munmap(base, st.st_size);
+    return;
+  }
+
+  raster_map = calloc(1, sizeof(RasterMap));
+  if (!raster_map) {
+    munmap(base, st.st_size);
+    return;
+  }
+  raster_map->base = base;
+  raster_map->len = st.st_size;
+  raster_records = (const RasterRecord *)(h + 1);
+  raster_count = h->count;
+
+  /* Broken records are left out of the hash, so never read */
+  uint32_t skipped = 0;
+  memset(raster_buckets, 0xff, sizeof(raster_buckets));
+  for (uint32_t i = 0; i < raster_count; i++) {
+    const RasterRecord *r = &raster_records[i];
+    raster_chain[i] = -1;
+    if (!raster_record_valid(r, raster_map->len)) {
+      skipped++;
+      continue;
     }
+    unsigned b = raster_bucket(r->class_name, r->size);
+    raster_chain[i] = raster_buckets[b];
+    raster_buckets[b] = (int32_t)i;
+  }
+  if (skipped)
+    LOG("Skipped %u invalid raster records", skipped);
+  LOG("Raster cache mapped: %u icons, %zu KiB", raster_count - skipped,
+      raster_map->len / 1024);
+}
+
+/* Zero-copy view of a cached raster of `path`, or NULL */
+static cairo_surface_t *mapped_icon(const char *class_name, int size,
+                                    const char *path) {
+  int32_t i = raster_find(class_name, size);
+  if (i < 0)
     return NULL;
+  const RasterRecord *r = &raster_records[i];
+  int64_t sec, nsec;
+  if (strcmp(r->path, path) != 0 || !file_mtime(path, &sec, &nsec) ||
+      sec != r->mtime_sec || nsec != r->mtime_nsec)
+    return NULL; /* Source changed: decode again */
+
+  cairo_surface_t *s = cairo_image_surface_create_for_data(
+      raster_map->base + r->offset, CAIRO_FORMAT_ARGB32, size, size,
+      r->stride);
+  if (cairo_surface_status(s) != CAIRO_STATUS_SUCCESS ||
+      cairo_surface_set_user_data(s, &raster_key, raster_map,
+                                  raster_map_unref) != CAIRO_STATUS_SUCCESS) {
+    cairo_surface_destroy(s);
+    return NULL;
+  }
+  pthread_mutex_lock(&map_lock);
+  raster_map->refs++;
+  pthread_mutex_unlock(&map_lock);
+  return s;
+}
+
+/* Remember a freshly decoded icon for the next save */
+static void note_raster(const char *class_name, int size, const char *path,
+                        cairo_surface_t *surface) {
+  if (!path_cache_enabled || raster_note_count >= RASTER_MAX_ENTRIES ||
+      cairo_image_surface_get_format(surface) != CAIRO_FORMAT_ARGB32 ||
+      cairo_image_surface_get_width(surface) != size ||
+      cairo_image_surface_get_height(surface) != size)
+    return;
+
+  RasterNote *n = &raster_notes[raster_note_count];
+  memset(n, 0, sizeof(*n));
+  if (!file_mtime(path, &n->rec.mtime_sec, &n->rec.mtime_nsec))
+    return;
+  snprintf(n->rec.class_name, sizeof(n->rec.class_name), "%s", class_name);
+  snprintf(n->rec.path, sizeof(n->rec.path), "%s", path);
+  n->rec.size = size;
+  n->rec.stride = cairo_image_surface_get_stride(surface);
+  n->surface = cairo_surface_reference(surface);
+  raster_note_count++;
+}
+
+static void clear_raster_notes(void) {
+  for (int i = 0; i < raster_note_count; i++)
+    cairo_surface_destroy(raster_notes[i].surface);
+  raster_note_count = 0;
+}
+
+static bool write_padding(FILE *fp, uint64_t *pos) {
+  static const unsigned char zero[RASTER_ALIGN];
+  size_t pad = (RASTER_ALIGN - *pos % RASTER_ALIGN) % RASTER_ALIGN;
+  *pos += pad;
+  return fwrite(zero, 1, pad, fp) == pad;
+}
+
+static void free_raster_save(RasterSave *save) {
+  for (int i = 0; i < save->note_count; i++)
+    cairo_surface_destroy(save->notes[i].surface);
+  if (save->map)
+    raster_map_unref(save->map);
+  free(save);
+}
+
+/* Write the snapshot, then map the new file. Runs on its own thread. */
+static void *write_rasters(void *arg) {
+  RasterSave *save = arg;
+  RasterRecord *out = save->out;
+  uint32_t n = save->count;
+
+  char tmp[MAX_PATH + 8];
+  snprintf(tmp, sizeof(tmp), "%s.tmp", raster_file);
+  FILE *fp = fopen(tmp, "wb");
+  bool ok = fp != NULL;
+  if (!fp)
+    LOG("Cannot write %s: %s", tmp, strerror(errno));
+
+  RasterHeader h = {.count = n};
+  memcpy(h.magic, RASTER_MAGIC, 8);
+  uint64_t pos = sizeof(h) + (uint64_t)n * sizeof(RasterRecord);
+  for (uint32_t i = 0; i < n; i++) {
+    pos += (RASTER_ALIGN - pos % RASTER_ALIGN) % RASTER_ALIGN;
+    out[i].offset = pos;
+    pos += (uint64_t)out[i].stride * out[i].size;
+  }
+  ok = ok && fwrite(&h, sizeof(h), 1, fp) == 1 &&
+       fwrite(out, sizeof(RasterRecord), n, fp) == n;
+  pos = sizeof(h) + (uint64_t)n * sizeof(RasterRecord);
+  for (uint32_t i = 0; i < n && ok; i++) {
+    size_t bytes = (size_t)out[i].stride * out[i].size;
+    ok = write_padding(fp, &pos) &&
+         fwrite(save->src[i], 1, bytes, fp) == bytes;
+    pos += bytes;
+  }
+  if (fp && fclose(fp) != 0)
+    ok = false;
+  ok = ok && rename(tmp, raster_file) == 0;
+  if (!ok && fp) {
+    LOG("Failed to save raster cache");
+    unlink(tmp);
+  }
+
+  free_raster_save(save);
+
+  pthread_mutex_lock(&resolve_lock);
+  if (ok) {
+    LOG("Raster cache saved: %u icons", n);
+    /* Surfaces handed out keep the old mapping alive; later lookups use
+     * the new file */
+    load_raster_cache();
+  }
+  raster_written = true;
+  pthread_mutex_unlock(&resolve_lock);
+  return NULL;
+}
+
+/* Reap a finished writer (wait: block until it is) */
+static void join_raster_writer(bool wait) {
+  if (!raster_writing)
+    return;
+  pthread_mutex_lock(&resolve_lock);
+  bool done = raster_written;
+  pthread_mutex_unlock(&resolve_lock);
+  if (!done && !wait)
+    return;
+  pthread_join(raster_writer, NULL);
+  raster_writing = false;
+}
+
+/* New rasters plus the still-mapped ones they don't replace. Only the
+ * snapshot is taken here, under resolve_lock; a thread writes it. */
+static void save_raster_cache(void) {
+  if (raster_note_count == 0 || raster_writing)
+    return;
+  RasterSave *save = malloc(sizeof(RasterSave));
+  if (!save)
+    return;
+
+  bool replaced[RASTER_MAX_ENTRIES] = {false};
+  uint32_t n = 0;
+  for (int i = 0; i < raster_note_count; i++) {
+    cairo_surface_flush(raster_notes[i].surface);
+    save->notes[i] = raster_notes[i];
+    save->out[n] = raster_notes[i].rec;
+    save->src[n++] = cairo_image_surface_get_data(raster_notes[i].surface);
+    int32_t old = raster_find(raster_notes[i].rec.class_name,
+                              raster_notes[i].rec.size);
+    if (old >= 0)
+      replaced[old] = true;
   }
+  save->note_count = raster_note_count;
+  raster_note_count = 0; /* The snapshot owns the references now */
+
+  save->map = raster_map;
+  if (raster_map) {
+    pthread_mutex_lock(&map_lock);
+    raster_map->refs++;
+    pthread_mutex_unlock(&map_lock);
+    for (uint32_t i = 0; i < raster_count && n < RASTER_MAX_ENTRIES; i++) {
+      const RasterRecord *r = &raster_records[i];
+      if (replaced[i] || !raster_record_valid(r, raster_map->len))
+        continue;
+      save->out[n] = *r;
+      save->src[n++] = raster_map->base + r->offset;
+    }
+  }
+  save->count = n;
+
+  raster_written = false;
+  if (pthread_create(&raster_writer, NULL, write_rasters, save) != 0) {
+    LOG("Cannot start the raster cache writer");
+    free_raster_save(save); /* Decoded again next session */
+    return;
+  }
+  raster_writing = true;
+}
 
+void icons_load_cache(void) {
+  pthread_mutex_lock(&resolve_lock);
+  load_path_cache();
+  if (path_cache_enabled)
+    load_raster_cache();
+  pthread_mutex_unlock(&resolve_lock);
+}
+
+void icons_save_cache(void) {
+  join_raster_writer(false);
+  pthread_mutex_lock(&resolve_lock);
+  if (path_cache_enabled) {
+    save_path_cache();
+    save_raster_cache();
+  }
+  pthread_mutex_unlock(&resolve_lock);
+}
+
+/* =========================================================================
+ * PUBLIC API
+ * ========================================================================= */
+
+/* =========================================================================
+ * MEMORY CACHE
+ * ========================================================================= */
+
+/* Callers hold cache_lock */
+
+static unsigned cache_bucket(const char *class_name, int size) {
+  return (hash_name(class_name) ^ (unsigned)size * 2654435761u) &
+         (CACHE_BUCKETS - 1);
+}
+
+static IconCacheEntry **cache_link(const char *class_name, int size) {
+  IconCacheEntry **link = &icon_cache.buckets[cache_bucket(class_name, size)];
+  for (; *link; link = &(*link)->chain) {
+    if ((*link)->size == size && strcmp((*link)->class_name, class_name) == 0)
+      break;
+  }
+  return link;
+}
+
+static void cache_unlink(IconCacheEntry *e) {
+  if (e->newer)
+    e->newer->older = e->older;
+  else
+    icon_cache.newest = e->older;
+  if (e->older)
+    e->older->newer = e->newer;
+  else
+    icon_cache.oldest = e->newer;
+  e->newer = e->older = NULL;
+}
+
+static void cache_push(IconCacheEntry *e) {
+  e->older = icon_cache.newest;
+  e->newer = NULL;
+  if (icon_cache.newest)
+    icon_cache.newest->newer = e;
+  icon_cache.newest = e;
+  if (!icon_cache.oldest)
+    icon_cache.oldest = e;
+}
+
+static void cache_remove(IconCacheEntry *e) {
+  IconCacheEntry **link = cache_link(e->class_name, e->size);
+  *link = e->chain;
+  cache_unlink(e);
+  icon_cache.bytes -= e->bytes;
+  if (e->surface)
+    cairo_surface_destroy(e->surface);
+  free(e);
+}
+
+static void cache_evict_to(size_t budget) {
+  while (icon_cache.bytes > budget && icon_cache.oldest) {
+    cache_remove(icon_cache.oldest);
+    icon_cache.evictions++;
+  }
+}
+
+/* Drop everything, or only the misses */
+static void cache_clear(bool misses_only) {
+  icon_cache.epoch++;
+  IconCacheEntry *e = icon_cache.newest;
+  while (e) {
+    IconCacheEntry *older = e->older;
+    if (!misses_only || !e->surface)
+      cache_remove(e);
+    e = older;
+  }
+}
+
+/* Every size of one class */
+static void cache_forget(const char *class_name) {
+  IconCacheEntry *e = icon_cache.newest;
+  while (e) {
+    IconCacheEntry *older = e->older;
+    if (strcmp(e->class_name, class_name) == 0)
+      cache_remove(e);
+    e = older;
+  }
+}
+
+void icons_set_config(Config *config) {
+  int mb = config ? config->icon_cache_mb : 8;
+  int ttl = config ? config->icon_cache_ttl : 0;
+  int miss_ttl = config ? config->icon_miss_ttl : 300;
+  int icon_size = config ? config->icon_size : 64;
+
+  /* Different mappings invalidate everything resolved through the old ones */
+  pthread_mutex_lock(&resolve_lock);
+  uint32_t stamp = class_rules_stamp(config);
+  bool remapped = rules_built && stamp != rules_stamp;
+  build_class_rules(config);
+  rules_stamp = stamp;
+  if (remapped)
+    path_cache_drop(true);
+  pthread_mutex_unlock(&resolve_lock);
+
+  /* Cards only ask for the new size from now on */
+  pthread_mutex_lock(&cache_lock);
+  if (remapped || (icon_cache.icon_size && icon_size != icon_cache.icon_size))
+    cache_clear(false);
+  icon_cache.icon_size = icon_size;
+  icon_cache.budget = (size_t)mb << 20;
+  icon_cache.ttl_ms = ttl * 1000.0;
+  icon_cache.miss_ttl_ms = miss_ttl * 1000.0;
+  cache_evict_to(icon_cache.budget);
+  pthread_mutex_unlock(&cache_lock);
+}
+
+void icons_log_stats(void) {
+  pthread_mutex_lock(&cache_lock);
+  if (icon_cache.hits || icon_cache.misses)
+    LOG("Icon cache: %u hits, %u misses, %u evictions, %u expired "
+        "(%zu KiB of %zu)",
+        icon_cache.hits, icon_cache.misses, icon_cache.evictions,
+        icon_cache.expirations, icon_cache.bytes >> 10,
+        icon_cache.budget >> 10);
+  pthread_mutex_unlock(&cache_lock);
+}
+
+/* Initialize icon system */
+void icons_init(const char *theme_name, const char *fallback) {
+  pthread_mutex_lock(&resolve_lock);
+  init_paths();
+
+  /* On a reload, paths resolved against the old themes are stale */
+  bool renamed =
+      (theme_name && theme_name[0] && strcmp(theme_name, current_theme)) ||
+      (fallback && fallback[0] && strcmp(fallback, fallback_theme_name));
+  if (renamed)
+    path_cache_drop(true);
+  if (theme_name && theme_name[0]) {
+    strncpy(current_theme, theme_name, sizeof(current_theme) - 1);
+    current_theme[sizeof(current_theme) - 1] = '\0';
+  }
+  if (fallback && fallback[0]) {
+    strncpy(fallback_theme_name, fallback, sizeof(fallback_theme_name) - 1);
+    fallback_theme_name[sizeof(fallback_theme_name) - 1] = '\0';
+  }
+
+  theme_chain_len = -1; /* Re-resolved against the (new) theme names */
+  pthread_mutex_unlock(&resolve_lock);
+
+  pthread_mutex_lock(&cache_lock);
+  cache_clear(false);
+  pthread_mutex_unlock(&cache_lock);
+  LOG("Initialized: theme=%s, fallback=%s", current_theme, fallback_theme_name);
+}
+
+/* Cached result as a new reference; false if not resolved yet */
+static bool cache_lookup(const char *class_name, int size,
+                         cairo_surface_t **surface) {
+  *surface = NULL;
+  pthread_mutex_lock(&cache_lock);
+  IconCacheEntry *e = *cache_link(class_name, size);
+  if (e && e->expires_ms > 0 && now_ms() >= e->expires_ms) {
+    cache_remove(e);
+    icon_cache.expirations++;
+    e = NULL;
+  }
+  if (e) {
+    cache_unlink(e);
+    cache_push(e);
+    if (e->surface)
+      *surface = cairo_surface_reference(e->surface);
+    icon_cache.hits++;
+  } else {
+    icon_cache.misses++;
+  }
+  pthread_mutex_unlock(&cache_lock);
+  return e != NULL;
+}
+
+cairo_surface_t *cached_app_icon(const char *class_name, int size,
+                                 bool *known) {
   cairo_surface_t *surface = NULL;
+  *known = class_name && class_name[0] &&
+           cache_lookup(class_name, size, &surface);
+  return surface;
+}
 
-  /* Check if icon_name is an absolute path */
-  if (icon_name[0] == '/' && file_exists(icon_name)) {
-    LOG("Loading absolute path icon: %s", icon_name);
-    const char *ext = strrchr(icon_name, '.');
-    if (ext) {
-      if (strcasecmp(ext, ".png") == 0) {
-        surface = load_png_icon(icon_name, size);
-      }
+/* PNG or SVG by extension (NULL for anything else) */
+static cairo_surface_t *load_icon_file(const char *path, int size) {
+  const char *ext = strrchr(path, '.');
+  if (!ext)
+    return NULL;
+  if (strcasecmp(ext, ".png") == 0)
+    return load_png_icon(path, size);
 #ifdef HAVE_RSVG
-      else if (strcasecmp(ext, ".svg") == 0) {
-        surface = load_svg_icon(icon_name, size);
-      }
+  if (strcasecmp(ext, ".svg") == 0)
+    return load_svg_icon(path, size);
 #endif
-    }
-    if (surface) {
-      /* Cache result */
-      if (cache_count < MAX_CACHE) {
-        strncpy(icon_cache[cache_count].class_name, class_name, 127);
-        icon_cache[cache_count].size = size;
-        icon_cache[cache_count].surface = surface;
-        cairo_surface_reference(surface);
-        cache_count++;
-      }
-      return surface;
-    }
-    /* SVG/PNG load failed - fall through to theme search */
-    LOG("Direct load failed, trying theme search for: %s", icon_name);
-  }
+  return NULL;
+}
 
-  /* Find icon file in themes */
-  char *icon_path = find_icon_in_theme(current_theme, icon_name, size);
-  if (!icon_path) {
-    icon_path = find_icon_in_theme(fallback_theme_name, icon_name, size);
+static unsigned cache_epoch(void) {
+  pthread_mutex_lock(&cache_lock);
+  unsigned epoch = icon_cache.epoch;
+  pthread_mutex_unlock(&cache_lock);
+  return epoch;
+}
+
+/* Cache result (under the original class name for lookup consistency),
+ * unless the cache was cleared since `epoch` was read */
+static void remember_icon(const char *class_name, int size,
+                          cairo_surface_t *surface, unsigned epoch) {
+  size_t bytes = sizeof(IconCacheEntry);
+  if (surface)
+    bytes += (size_t)cairo_image_surface_get_stride(surface) *
+             cairo_image_surface_get_height(surface);
+
+  pthread_mutex_lock(&cache_lock);
+  IconCacheEntry **link = cache_link(class_name, size);
+  IconCacheEntry *e = NULL;
+  if (!*link && bytes <= icon_cache.budget && epoch == icon_cache.epoch) {
+    cache_evict_to(icon_cache.budget - bytes);
+    link = cache_link(class_name, size); /* Eviction may have moved it */
+    e = calloc(1, sizeof(IconCacheEntry));
+  }
+  if (e) {
+    snprintf(e->class_name, sizeof(e->class_name), "%s", class_name);
+    e->size = size;
+    e->surface = surface ? cairo_surface_reference(surface) : NULL;
+    e->bytes = bytes;
+    double ttl = surface ? icon_cache.ttl_ms : icon_cache.miss_ttl_ms;
+    e->expires_ms = ttl > 0 ? now_ms() + ttl : 0;
+    *link = e;
+    cache_push(e);
+    icon_cache.bytes += bytes;
   }
-  if (!icon_path) {
-    icon_path = find_icon_in_theme("hicolor", icon_name, size);
+  pthread_mutex_unlock(&cache_lock);
+}
+
+#define MAX_CANDIDATES 3
+
+/* Files to try for a class, best first: the path cache's answer, or the
+ * desktop entry's absolute Icon=, the theme chain's pick and a raster
+ * stand-in for a broken SVG. 0 for a miss. Caller holds resolve_lock. */
+static int icon_candidates(const char *class_name, int size, bool use_known,
+                           char cand[][MAX_PATH]) {
+  int n = 0;
+  PathEntry *known = use_known ? path_cache_find(class_name, size) : NULL;
+  if (known) {
+    if (known->path[0])
+      snprintf(cand[n++], MAX_PATH, "%s", known->path);
+    return n;
   }
-  if (!icon_path) {
-    icon_path = find_icon_in_theme("Adwaita", icon_name, size);
+
+  /* Apply class name mapping first */
+  const char *effective_class = get_mapped_class(class_name);
+  if (effective_class) {
+    LOG("Mapped class '%s' -> '%s'", class_name, effective_class);
+  } else {
+    effective_class = class_name;
   }
 
-  surface = NULL;
+  /* Find icon name from desktop file using effective (mapped) class */
+  char *icon_name = find_desktop_icon(effective_class);
+  LOG("Class '%s' -> icon '%s'", effective_class,
+      icon_name ? icon_name : "(null)");
+  if (!icon_name)
+    return 0;
+
+  if (icon_name[0] == '/' && file_exists(icon_name))
+    snprintf(cand[n++], MAX_PATH, "%s", icon_name);
 
+  char *icon_path = find_icon_path(icon_name, size, false);
   if (icon_path) {
-    LOG("Loading icon: %s", icon_path);
+    snprintf(cand[n++], MAX_PATH, "%s", icon_path);
+    if (strcmp(icon_path + strlen(icon_path) - 4, ".svg") == 0) {
+      char *png = find_icon_path(icon_name, size, true);
+      if (png)
+        snprintf(cand[n++], MAX_PATH, "%s", png);
+    }
+  }
+  return n;
+}
 
-    const char *ext = strrchr(icon_path, '.');
-    if (ext) {
-      if (strcasecmp(ext, ".png") == 0) {
-        surface = load_png_icon(icon_path, size);
-      }
-#ifdef HAVE_RSVG
-      else if (strcasecmp(ext, ".svg") == 0) {
-        surface = load_svg_icon(icon_path, size);
-        /* If SVG fails, try to find a PNG fallback */
-        if (!surface) {
-          LOG("SVG load failed, trying PNG fallback for: %s", icon_name);
-          /* Force PNG by checking raster sizes first */
-          const char *raster_sizes[] = {"256x256", "128x128", "64x64", "48x48"};
-          for (size_t rs = 0;
-               rs < sizeof(raster_sizes) / sizeof(raster_sizes[0]) && !surface;
-               rs++) {
-            char png_try[MAX_PATH];
-            for (int d = 0; icon_dirs[d] && !surface; d++) {
-              const char *cats[] = {"apps", "applications"};
-              for (size_t cat = 0;
-                   cat < sizeof(cats) / sizeof(cats[0]) && !surface; cat++) {
-                snprintf(png_try, sizeof(png_try), "%s/%s/%s/%s/%s.png",
-                         icon_dirs[d], "hicolor", raster_sizes[rs], cats[cat],
-                         icon_name);
-                if (file_exists(png_try)) {
-                  surface = load_png_icon(png_try, size);
-                  if (surface) {
-                    LOG("PNG fallback loaded: %s", png_try);
-                  }
-                }
-              }
-            }
-          }
+/*
+ * Resolve and decode one icon. Lookups and cache bookkeeping hold
+ * resolve_lock; the decode itself doesn't, so workers rasterize in
+ * parallel. A cached path that no longer loads is resolved again.
+ */
+static cairo_surface_t *resolve_icon(const char *class_name, int size) {
+  char cand[MAX_CANDIDATES][MAX_PATH];
+  for (int pass = 0; pass < 2; pass++) {
+    pthread_mutex_lock(&resolve_lock);
+    unsigned epoch = path_epoch;
+    bool from_cache = pass == 0 && path_cache_find(class_name, size);
+    int n = icon_candidates(class_name, size, pass == 0, cand);
+    cairo_surface_t *surface = NULL;
+    int hit = 0;
+    for (; hit < n; hit++) {
+      if ((surface = mapped_icon(class_name, size, cand[hit])))
+        break;
+    }
+    pthread_mutex_unlock(&resolve_lock);
+
+    bool decoded = false;
+    if (!surface) {
+      for (hit = 0; hit < n; hit++) {
+        LOG("Loading icon: %s", cand[hit]);
+        if ((surface = load_icon_file(cand[hit], size))) {
+          decoded = true;
+          break;
         }
       }
-#endif
     }
-  }
+    if (!surface && from_cache && n > 0) {
+      LOG("Cached icon path failed, resolving again: %s", cand[0]);
+      continue;
+    }
 
-  /* Cache result (including original class_name for cache lookup consistency)
-   */
-  if (cache_count < MAX_CACHE) {
-    strncpy(icon_cache[cache_count].class_name, class_name, 127);
-    icon_cache[cache_count].size = size;
-    icon_cache[cache_count].surface = surface;
-    if (surface) {
-      cairo_surface_reference(surface);
+    /* Not recorded if the themes or mappings changed meanwhile */
+    pthread_mutex_lock(&resolve_lock);
+    if (epoch == path_epoch) {
+      if (decoded)
+        note_raster(class_name, size, cand[hit], surface);
+      path_cache_put(class_name, size, surface ? cand[hit] : "");
     }
-    cache_count++;
+    pthread_mutex_unlock(&resolve_lock);
+    return surface;
   }
+  return NULL;
+}
+
+/* Load app icon by class name */
+cairo_surface_t *load_app_icon(const char *class_name, int size) {
+  if (!class_name || !class_name[0])
+    return NULL;
 
+  cairo_surface_t *surface;
+  if (cache_lookup(class_name, size, &surface))
+    return surface;
+
+  unsigned epoch = cache_epoch();
+  surface = resolve_icon(class_name, size);
+  remember_icon(class_name, size, surface, epoch);
   return surface;
 }
 
@@ -672,12 +2640,6 @@ bool has_app_icon(const char *class_name) {
   if (!class_name)
     return false;
 
-  for (int i = 0; i < cache_count; i++) {
-    if (strcmp(icon_cache[i].class_name, class_name) == 0) {
-      return icon_cache[i].surface != NULL;
-    }
-  }
-
   cairo_surface_t *s = load_app_icon(class_name, 48);
   if (s) {
     cairo_surface_destroy(s);
@@ -686,14 +2648,342 @@ bool has_app_icon(const char *class_name) {
   return false;
 }
 
-/* Cleanup all cached icons */
-void icons_cleanup(void) {
-  for (int i = 0; i < cache_count; i++) {
-    if (icon_cache[i].surface) {
-      cairo_surface_destroy(icon_cache[i].surface);
-      icon_cache[i].surface = NULL;
+/* =========================================================================
+ * ASYNC LOADING
+ * ========================================================================= */
+
+/*
+ * With async loading on (the daemon), cards ask for icons they don't have
+ * yet and draw the letter meanwhile. Workers resolve and decode in the
+ * background and signal an eventfd; the main loop then repaints just the
+ * cards showing those classes.
+ *
+ * Prefetches (icons of open windows, before the first show) queue behind
+ * every card request and only ever occupy one worker, so a visible
+ * switcher's icons never wait on them.
+ */
+
+#define ICON_WORKERS 2
+
+typedef enum { JOB_WAITING, JOB_RUNNING, JOB_DONE } IconJobState;
+
+typedef struct IconJob {
+  char class_name[128];
+  int size;
+  IconJobState state;
+  bool background; /* Prefetch nobody is waiting for yet */
+  struct IconJob *next;
+} IconJob;
+
+static struct {
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  pthread_t threads[ICON_WORKERS];
+  int nthreads;
+  bool enabled;
+  bool stop;
+  IconJob *jobs; /* FIFO of waiting, running and finished jobs */
+  int background_running;
+  int event_fd;
+} loader = {.lock = PTHREAD_MUTEX_INITIALIZER,
+            .wake = PTHREAD_COND_INITIALIZER,
+            .event_fd = -1};
+
+/* Oldest waiting card request, else the oldest prefetch if no other
+ * worker is on one */
+static IconJob *next_waiting(void) {
+  IconJob *background = NULL;
+  for (IconJob *j = loader.jobs; j; j = j->next) {
+    if (j->state != JOB_WAITING)
+      continue;
+    if (!j->background)
+      return j;
+    if (!background)
+      background = j;
+  }
+  return loader.background_running > 0 ? NULL : background;
+}
+
+static void *icon_worker(void *arg) {
+  (void)arg;
+  pthread_mutex_lock(&loader.lock);
+  while (!loader.stop) {
+    IconJob *job = next_waiting();
+    if (!job) {
+      pthread_cond_wait(&loader.wake, &loader.lock);
+      continue;
+    }
+    job->state = JOB_RUNNING;
+    bool background = job->background;
+    if (background)
+      loader.background_running++;
+    pthread_mutex_unlock(&loader.lock);
+
+    unsigned epoch = cache_epoch();
+    cairo_surface_t *surface = resolve_icon(job->class_name, job->size);
+    remember_icon(job->class_name, job->size, surface, epoch);
+    if (surface)
+      cairo_surface_destroy(surface);
+
+    pthread_mutex_lock(&loader.lock);
+    job->state = JOB_DONE;
+    if (background) {
+      loader.background_running--;
+      pthread_cond_signal(&loader.wake); /* Next prefetch may go now */
     }
+    uint64_t one = 1;
+    if (write(loader.event_fd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+      LOG("Icon ready signal failed: %s", strerror(errno));
   }
-  cache_count = 0;
+  pthread_mutex_unlock(&loader.lock);
+  return NULL;
+}
+
+void icons_set_async(bool enabled) {
+  if (enabled && loader.event_fd < 0) {
+    loader.event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (loader.event_fd < 0) {
+      LOG("eventfd failed, icons load synchronously: %s", strerror(errno));
+      return;
+    }
+  }
+  loader.enabled = enabled;
+}
+
+bool icons_async(void) { return loader.enabled; }
+
+static void queue_icon(const char *class_name, int size, bool background) {
+  if (!loader.enabled || !class_name || !class_name[0])
+    return;
+
+  pthread_mutex_lock(&loader.lock);
+  IconJob **tail = &loader.jobs;
+  for (IconJob *j = loader.jobs; j; j = j->next) {
+    if (j->size == size && strcmp(j->class_name, class_name) == 0) {
+      /* Already queued or just landed; a card now waits on a prefetch */
+      if (!background && j->state == JOB_WAITING && j->background) {
+        j->background = false;
+        pthread_cond_signal(&loader.wake);
+      }
+      pthread_mutex_unlock(&loader.lock);
+      return;
+    }
+    tail = &j->next;
+  }
+
+  IconJob *job = calloc(1, sizeof(IconJob));
+  if (job) {
+    snprintf(job->class_name, sizeof(job->class_name), "%s", class_name);
+    job->size = size;
+    job->background = background;
+    *tail = job;
+
+    /* Workers start with the first request */
+    while (loader.nthreads < ICON_WORKERS &&
+           pthread_create(&loader.threads[loader.nthreads], NULL, icon_worker,
+                          NULL) == 0)
+      loader.nthreads++;
+    pthread_cond_signal(&loader.wake);
+  }
+  pthread_mutex_unlock(&loader.lock);
+}
+
+void icons_request(const char *class_name, int size) {
+  queue_icon(class_name, size, false);
+}
+
+void icons_prefetch(const char *class_name, int size) {
+  bool known;
+  cairo_surface_t *icon = cached_app_icon(class_name, size, &known);
+  if (icon)
+    cairo_surface_destroy(icon);
+  if (!known)
+    queue_icon(class_name, size, true);
+}
+
+int icons_get_ready_fd(void) { return loader.event_fd; }
+
+void icons_dispatch_ready(void (*handler)(const char *class_name)) {
+  uint64_t count;
+  if (read(loader.event_fd, &count, sizeof(count)) < 0)
+    return;
+
+  /* Unlink finished jobs first: the handler may request more icons */
+  IconJob *done = NULL;
+  pthread_mutex_lock(&loader.lock);
+  IconJob **link = &loader.jobs;
+  while (*link) {
+    IconJob *j = *link;
+    if (j->state == JOB_DONE) {
+      *link = j->next;
+      j->next = done;
+      done = j;
+    } else {
+      link = &j->next;
+    }
+  }
+  pthread_mutex_unlock(&loader.lock);
+
+  while (done) {
+    IconJob *next = done->next;
+    if (handler)
+      handler(done->class_name);
+    free(done);
+    done = next;
+  }
+}
+
+static void stop_workers(void) {
+  pthread_mutex_lock(&loader.lock);
+  loader.stop = true;
+  pthread_cond_broadcast(&loader.wake);
+  pthread_mutex_unlock(&loader.lock);
+  for (int i = 0; i < loader.nthreads; i++)
+    pthread_join(loader.threads[i], NULL);
+  loader.nthreads = 0;
+  loader.stop = false;
+  loader.background_running = 0;
+
+  while (loader.jobs) {
+    IconJob *next = loader.jobs->next;
+    free(loader.jobs);
+    loader.jobs = next;
+  }
+  if (loader.event_fd >= 0) {
+    close(loader.event_fd);
+    loader.event_fd = -1;
+  }
+  loader.enabled = false;
+}
+
+int icons_get_watch_fd(void) { return source_watch_fd; }
+
+bool icons_handle_watch(void) {
+  char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+  ssize_t n;
+  bool rearm = false;
+  pthread_mutex_lock(&resolve_lock);
+  while ((n = read(source_watch_fd, buf, sizeof(buf))) > 0) {
+    for (char *p = buf; p < buf + n;) {
+      const struct inotify_event *ev = (const struct inotify_event *)p;
+      p += sizeof(struct inotify_event) + ev->len;
+      if (ev->mask & IN_Q_OVERFLOW)
+        desktop_changed = themes_changed = rearm = true;
+      for (int i = 0; i < source_watch_count; i++) {
+        if (source_watches[i].wd != ev->wd)
+          continue;
+        /* A parent only matters when a directory shows up in it */
+        if (source_watches[i].kind == WATCH_PARENT)
+          rearm |= (ev->mask & IN_ISDIR) != 0;
+        else if (source_watches[i].kind == WATCH_DESKTOP)
+          desktop_changed = true;
+        else
+          themes_changed = true;
+        if (ev->mask & IN_IGNORED) { /* Directory gone */
+          source_watches[i] = source_watches[--source_watch_count];
+          rearm = true;
+        }
+        break;
+      }
+    }
+  }
+  if (rearm)
+    watch_base_dirs(true);
+  bool changed = desktop_changed || themes_changed;
+  pthread_mutex_unlock(&resolve_lock);
+  return changed;
+}
+
+/* Drop misses and every found path the lookup no longer picks first, such
+ * as after an Icon= edit. Returns the found ones, unlinked, for the memory
+ * cache to forget too. Caller holds resolve_lock. */
+static PathEntry *revalidate_paths(void) {
+  PathEntry *moved = NULL;
+  path_epoch++; /* Lookups in flight resolved against the old indexes */
+  for (int b = 0; b < PATH_CACHE_BUCKETS; b++) {
+    PathEntry **link = &path_cache[b];
+    while (*link) {
+      PathEntry *e = *link;
+      char cand[MAX_CANDIDATES][MAX_PATH];
+      if (e->path[0] &&
+          icon_candidates(e->class_name, e->size, false, cand) > 0 &&
+          strcmp(cand[0], e->path) == 0) {
+        link = &e->next;
+        continue;
+      }
+      *link = e->next;
+      path_cache_dirty = true;
+      if (e->path[0]) {
+        LOG("Icon for '%s' changed", e->class_name);
+        e->next = moved;
+        moved = e;
+      } else {
+        free(e->class_name);
+        free(e->path);
+        free(e);
+      }
+    }
+  }
+  return moved;
+}
+
+/*
+ * Apply what the watch flagged. Apps install icons next to their desktop
+ * files, often deep in hicolor where no watch reaches, so any change
+ * re-indexes the themes too. Resolved paths are checked against the new
+ * indexes; misses are forgotten, they may resolve now.
+ */
+bool icons_refresh(void) {
+  pthread_mutex_lock(&resolve_lock);
+  bool desktop = desktop_changed;
+  bool themes = desktop_changed || themes_changed;
+  desktop_changed = themes_changed = false;
+  if (desktop)
+    free_desktop_index();
+  if (themes) {
+    LOG("%s changed, re-indexing", desktop ? "Applications" : "Icon themes");
+    free_theme_indexes();
+  }
+  PathEntry *moved = themes ? revalidate_paths() : NULL;
+  pthread_mutex_unlock(&resolve_lock);
+
+  if (!themes)
+    return false;
+  /* Without the path cache (bench) nothing tells which icons moved */
+  bool all = !path_cache_enabled;
+  bool dropped = all || moved;
+  pthread_mutex_lock(&cache_lock);
+  cache_clear(!all);
+  while (moved) {
+    PathEntry *next = moved->next;
+    cache_forget(moved->class_name);
+    free(moved->class_name);
+    free(moved->path);
+    free(moved);
+    moved = next;
+  }
+  pthread_mutex_unlock(&cache_lock);
+  return dropped;
+}
+
+/* Cleanup all cached icons */
+void icons_cleanup(void) {
+  stop_workers();
+  icons_log_stats();
+  cache_clear(false);
+  icon_cache.hits = icon_cache.misses = 0;
+  icon_cache.evictions = icon_cache.expirations = 0;
+  join_raster_writer(true);
+  icons_save_cache();
+  join_raster_writer(true);
+  path_cache_drop(true);
+  clear_stamps();
+  clear_raster_notes();
+  raster_map_retire();
+  path_cache_enabled = false;
+  free_theme_indexes();
+  free_class_rules();
+  free_desktop_index();
+  unwatch_sources();
   LOG("Cache cleared");
 }
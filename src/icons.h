@@ -2,15 +2,64 @@
 #ifndef ICONS_H
 #define ICONS_H
 
+#include "config.h"
 #include <cairo/cairo.h>
 #include <stdbool.h>
 
 /* Initialize icon cache and theme lookup */
 void icons_init(const char *theme_name, const char *fallback_theme);
 
+/* Apply the memory cache budget and TTLs (NULL: defaults) */
+void icons_set_config(Config *config);
+
+/* Log memory cache hit/miss/eviction counters */
+void icons_log_stats(void);
+
 /* Load an app icon by class name (returns NULL if not found) */
 cairo_surface_t *load_app_icon(const char *class_name, int size);
 
+/*
+ * Cache-only lookup: never touches the disk. *known is false when the
+ * icon hasn't been resolved at this size yet; a known but missing icon
+ * returns NULL with *known set.
+ */
+cairo_surface_t *cached_app_icon(const char *class_name, int size,
+                                 bool *known);
+
+/*
+ * Persistent class -> icon path cache in $XDG_CACHE_HOME/snappy-switcher
+ * (daemon only). Load after icons_init(); save is a no-op unless new
+ * icons were resolved.
+ */
+void icons_load_cache(void);
+void icons_save_cache(void);
+
+/*
+ * Background loading (daemon only): with async on, icons_request() queues
+ * a class for the worker pool instead of decoding on the caller's thread.
+ * The ready fd becomes readable as icons land; icons_dispatch_ready()
+ * calls the handler once per finished class so its cards can repaint.
+ */
+void icons_set_async(bool enabled);
+bool icons_async(void);
+void icons_request(const char *class_name, int size);
+
+/* Same at background priority, skipped if already cached: warms icons for
+ * windows the switcher hasn't shown yet */
+void icons_prefetch(const char *class_name, int size);
+int icons_get_ready_fd(void);
+void icons_dispatch_ready(void (*handler)(const char *class_name));
+
+/* inotify fd on the applications and icon theme dirs (-1 until the first
+ * index is built); call icons_handle_watch() when it is readable */
+int icons_get_watch_fd(void);
+
+/* Drain watch events; true if a lookup source changed. Then, once things
+ * settle, icons_refresh() re-indexes and drops what no longer resolves the
+ * same; true if icons cards may show were dropped (prefetch them again). */
+bool icons_handle_watch(void);
+bool icons_refresh(void);
+
 /* Free all cached icons */
 void icons_cleanup(void);
 
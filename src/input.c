@@ -1,10 +1,11 @@
-/* src/input.c - Keyboard Input Implementation */
+/* src/input.c - Keyboard & Pointer Input Implementation */
 #define _POSIX_C_SOURCE 200809L
 
 #include "input.h"
 #include "hyprland.h"
 #include "render.h"
 #include <fcntl.h>
+#include <linux/input-event-codes.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -116,7 +117,7 @@ static void keyboard_key(void *data, struct wl_keyboard *keyboard,
         if (app_state->selected_index >= app_state->count)
           app_state->selected_index = 0;
       }
-      render_ui(app_state, app_state->width, app_state->height);
+      render_selection(app_state);
     }
     break;
 
@@ -190,6 +191,91 @@ const struct wl_keyboard_listener *get_keyboard_listener(void) {
   return &keyboard_listener;
 }
 
+/* --- Pointer --- */
+
+/* Hit-test the pointer position and repaint hover changes */
+static void pointer_update_hover(AppState *state, double x, double y) {
+  if (!state)
+    return;
+  int index = -1;
+  if (x >= 0 && y >= 0)
+    index = layout_hit_test(render_layout(state), state->scroll_row, x, y);
+  if (index == state->hover_index)
+    return;
+
+  int previous = state->hover_index;
+  state->hover_index = index;
+  render_hover(state, previous);
+}
+
+static void pointer_enter(void *data, struct wl_pointer *pointer,
+                          uint32_t serial, struct wl_surface *surface,
+                          wl_fixed_t sx, wl_fixed_t sy) {
+  (void)pointer;
+  (void)serial;
+  (void)surface;
+  pointer_update_hover((AppState *)data, wl_fixed_to_double(sx),
+                       wl_fixed_to_double(sy));
+}
+
+static void pointer_leave(void *data, struct wl_pointer *pointer,
+                          uint32_t serial, struct wl_surface *surface) {
+  (void)pointer;
+  (void)serial;
+  (void)surface;
+  pointer_update_hover((AppState *)data, -1, -1);
+}
+
+static void pointer_motion(void *data, struct wl_pointer *pointer,
+                           uint32_t time, wl_fixed_t sx, wl_fixed_t sy) {
+  (void)pointer;
+  (void)time;
+  pointer_update_hover((AppState *)data, wl_fixed_to_double(sx),
+                       wl_fixed_to_double(sy));
+}
+
+static void pointer_button(void *data, struct wl_pointer *pointer,
+                           uint32_t serial, uint32_t time, uint32_t button,
+                           uint32_t state_w) {
+  (void)pointer;
+  (void)serial;
+  (void)time;
+  AppState *state = (AppState *)data;
+
+  if (!state || button != BTN_LEFT ||
+      state_w != WL_POINTER_BUTTON_STATE_PRESSED)
+    return;
+
+  /* Click: select the card under the pointer and switch to it */
+  if (state->hover_index >= 0 && state->hover_index < state->count) {
+    state->selected_index = state->hover_index;
+    render_selection(state);
+    if (on_alt_release)
+      on_alt_release();
+  }
+}
+
+static void pointer_axis(void *data, struct wl_pointer *pointer,
+                         uint32_t time, uint32_t axis, wl_fixed_t value) {
+  (void)data;
+  (void)pointer;
+  (void)time;
+  (void)axis;
+  (void)value;
+}
+
+static const struct wl_pointer_listener pointer_listener = {
+    .enter = pointer_enter,
+    .leave = pointer_leave,
+    .motion = pointer_motion,
+    .button = pointer_button,
+    .axis = pointer_axis,
+};
+
+const struct wl_pointer_listener *get_pointer_listener(void) {
+  return &pointer_listener;
+}
+
 void input_cleanup(void) {
   if (xkb_st)
     xkb_state_unref(xkb_st);
@@ -1,4 +1,4 @@
-/* src/input.h - Keyboard Input Handling */
+/* src/input.h - Keyboard & Pointer Input Handling */
 #ifndef INPUT_H
 #define INPUT_H
 
@@ -19,6 +19,9 @@ void input_reset_alt_state(void);
 /* Get keyboard listener for Wayland seat */
 const struct wl_keyboard_listener *get_keyboard_listener(void);
 
+/* Get pointer listener: hover highlights cards, click selects and switches */
+const struct wl_pointer_listener *get_pointer_listener(void);
+
 /* Cleanup input resources */
 void input_cleanup(void);
 
@@ -0,0 +1,137 @@
+/* src/live.c - Live window list updates while the switcher is open */
+#define _POSIX_C_SOURCE 200809L
+
+#include "live.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LOG(fmt, ...) fprintf(stderr, "[Live] " fmt "\n", ##__VA_ARGS__)
+
+/* Tiled card of the same workspace + class (context mode grouping) */
+static int find_group(AppState *state, const WindowEvent *ev) {
+  for (int i = 0; i < state->count; i++) {
+    WindowInfo *win = &state->windows[i];
+    if (!win->is_floating && win->workspace_id == ev->workspace_id &&
+        strcmp(win->class_name, ev->class_name) == 0)
+      return i;
+  }
+  return -1;
+}
+
+static LiveResult apply_open(AppState *state, Config *config,
+                             const WindowEvent *ev, int *first, int *last) {
+  if (app_state_find(state, ev->address) >= 0)
+    return LIVE_NONE;
+
+  /* Socket events don't say whether the window floats: assume tiled */
+  if (config && config->mode == MODE_CONTEXT) {
+    int group = find_group(state, ev);
+    if (group >= 0) {
+      state->windows[group].group_count++;
+      *first = group;
+      *last = group + 1;
+      return LIVE_CARDS;
+    }
+  }
+
+  WindowInfo info;
+  memset(&info, 0, sizeof(info));
+  info.address = strdup(ev->address);
+  info.title = strdup(ev->title ? ev->title : "");
+  info.class_name = strdup(ev->class_name ? ev->class_name : "");
+  info.workspace_id = ev->workspace_id;
+  info.focus_history_id = 9999;
+  info.group_count = 1;
+  info.monitor_id = -1;
+
+  /* Append: keeps every existing card (and the MRU order being cycled)
+   * where it is */
+  if (!info.address || !info.title || !info.class_name ||
+      app_state_add(state, &info) < 0) {
+    window_info_free(&info);
+    return LIVE_REFETCH;
+  }
+
+  LOG("Window opened: %s", ev->address);
+  *first = state->count - 1;
+  *last = state->count;
+  return LIVE_CARDS;
+}
+
+static LiveResult apply_close(AppState *state, Config *config,
+                              const WindowEvent *ev, int *first, int *last) {
+  bool context = config && config->mode == MODE_CONTEXT;
+  int index = app_state_find(state, ev->address);
+
+  /* A hidden group member, or a group losing its face window: which card
+   * represents the group is only known after re-aggregation */
+  if (index < 0)
+    return context ? LIVE_REFETCH : LIVE_NONE;
+  if (state->windows[index].group_count > 1)
+    return LIVE_REFETCH;
+
+  int old_count = state->count;
+  int old_selected = state->selected_index;
+  int old_hover = state->hover_index;
+  app_state_remove(state, index);
+  app_state_remove_member(state, ev->address);
+
+  if (state->selected_index > index)
+    state->selected_index--;
+  if (state->selected_index >= state->count)
+    state->selected_index = state->count > 0 ? state->count - 1 : 0;
+  /* Cards slid under the pointer, and the grid may re-centre: no card is
+   * hovered until the pointer moves again */
+  state->hover_index = -1;
+
+  LOG("Window closed: %s", ev->address);
+  *first = index < old_selected ? index : old_selected;
+  if (state->selected_index < *first)
+    *first = state->selected_index;
+  if (old_hover >= 0 && old_hover < *first)
+    *first = old_hover;
+  *last = old_count;
+  return LIVE_CARDS;
+}
+
+static LiveResult apply_title(AppState *state, const WindowEvent *ev,
+                              int *first, int *last) {
+  int index = app_state_find(state, ev->address);
+  if (index < 0 || !ev->title)
+    return LIVE_NONE;
+
+  WindowInfo *win = &state->windows[index];
+  if (win->title && strcmp(win->title, ev->title) == 0)
+    return LIVE_NONE;
+
+  char *title = strdup(ev->title);
+  if (!title)
+    return LIVE_NONE;
+  free(win->title);
+  win->title = title;
+
+  *first = index;
+  *last = index + 1;
+  return LIVE_CARDS;
+}
+
+LiveResult live_apply(AppState *state, Config *config, const WindowEvent *ev,
+                      int *first, int *last) {
+  if (!state || !ev || !ev->address)
+    return LIVE_NONE;
+
+  switch (ev->type) {
+  case WINDOW_EVENT_OPEN:
+    return apply_open(state, config, ev, first, last);
+  case WINDOW_EVENT_CLOSE:
+    return apply_close(state, config, ev, first, last);
+  case WINDOW_EVENT_TITLE:
+    return apply_title(state, ev, first, last);
+  case WINDOW_EVENT_FOCUS:
+    return LIVE_NONE; /* MRU order is kept while cycling */
+  case WINDOW_EVENT_RESYNC:
+    return LIVE_REFETCH;
+  }
+  return LIVE_NONE;
+}
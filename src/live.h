@@ -0,0 +1,24 @@
+/* src/live.h - Live window list updates while the switcher is open */
+#ifndef LIVE_H
+#define LIVE_H
+
+#include "backend.h"
+#include "config.h"
+#include "data.h"
+
+typedef enum {
+  LIVE_NONE,   /* Event doesn't affect the visible list */
+  LIVE_CARDS,  /* Cards in [first, last) changed */
+  LIVE_REFETCH /* Can't be applied incrementally: re-fetch the list */
+} LiveResult;
+
+/*
+ * Apply a backend change event to the window list in place. The selection
+ * stays on the same window (or the card that takes a closed one's place).
+ * Card slots that need repainting are returned in [*first, *last); a
+ * removal includes the old last slot, which is now empty.
+ */
+LiveResult live_apply(AppState *state, Config *config, const WindowEvent *ev,
+                      int *first, int *last);
+
+#endif /* LIVE_H */
@@ -1,13 +1,21 @@
 /* src/main.c - Snappy Switcher Daemon (v2.0) */
 #define _POSIX_C_SOURCE 200809L
 
+#include "appid.h"
 #include "backend.h"
+#include "bench.h"
 #include "config.h"
 #include "icons.h"
 #include "input.h"
+#include "live.h"
 #include "render.h"
 #include "socket.h"
+#include "thumbnails.h"
+#include "util.h"
+#include "fractional-scale-v1-client-protocol.h"
+#include "viewporter-client-protocol.h"
 #include "wlr-layer-shell-unstable-v1-client-protocol.h"
+#include "xdg-output-unstable-v1-client-protocol.h"
 #include "xdg-shell-client-protocol.h"
 
 #include <errno.h>
@@ -35,6 +43,11 @@
 #define TAKEOVER_TIMEOUT_MS 1000
 #define TAKEOVER_POLL_MS 100
 
+/* Editors write in several steps: reload once the config settles */
+#define RELOAD_DEBOUNCE_MS 200
+/* Package installs touch many files: re-index icons once they are done */
+#define ICONS_DEBOUNCE_MS 1000
+
 /* Global State */
 struct wl_display *display = NULL;
 struct wl_compositor *compositor = NULL;
@@ -42,18 +55,48 @@ struct wl_shm *shm = NULL;
 struct zwlr_layer_shell_v1 *layer_shell = NULL;
 struct wl_surface *surface = NULL;
 struct zwlr_layer_surface_v1 *layer_surface = NULL;
+struct wl_subcompositor *subcompositor = NULL;
+struct wl_surface *highlight_surface = NULL;
+struct wl_subsurface *highlight_subsurface = NULL;
+struct wp_fractional_scale_manager_v1 *fractional_scale_manager = NULL;
+struct wp_viewporter *viewporter = NULL;
+struct wp_fractional_scale_v1 *fractional_scale = NULL;
+struct wp_viewport *panel_viewport = NULL;
+struct wp_viewport *highlight_viewport = NULL;
+struct zxdg_output_manager_v1 *xdg_output_manager = NULL;
 struct wl_seat *seat = NULL;
 struct wl_keyboard *keyboard = NULL;
+struct wl_pointer *pointer = NULL;
 
 static bool running = true;
 static bool visible = false;
 
 static AppState app_state;
 static Config *config = NULL;
+static double reload_due = 0; /* now_ms() to reload at; 0: no change */
+static double icons_due = 0;  /* Same for icon sources */
 static int socket_fd = -1;
 
 static Backend *backend = NULL;
 
+/* Outputs, tracked to cap the panel height to the one it is shown on */
+#define MAX_OUTPUTS 8
+static struct {
+  struct wl_output *output;
+  struct zxdg_output_v1 *xdg_output;
+  int32_t mode_width, mode_height; /* Current mode (device pixels) */
+  int32_t transform;
+  int32_t scale;
+  int32_t logical_width, logical_height; /* From xdg-output, 0 if unknown */
+} outputs[MAX_OUTPUTS];
+static int output_count = 0;
+static struct wl_output *panel_output = NULL;
+static uint32_t panel_scale120 = 0; /* Preferred fractional scale, 0 = none */
+
+/* Icons are warmed before the panel has ever been on an output */
+static int prefetch_scale120 = 0; /* Scale of the last prefetch, 0 = none */
+static bool prefetch_pending = false; /* Outputs changed that scale */
+
 /* Startup Race Condition Fix */
 // static bool first_show_done = false;
 
@@ -71,6 +114,258 @@ static void sleep_ms(int ms) {
   nanosleep(&ts, NULL);
 }
 
+/* --- Outputs --- */
+
+static int find_output(struct wl_output *output) {
+  for (int i = 0; i < output_count; i++) {
+    if (outputs[i].output == output)
+      return i;
+  }
+  return -1;
+}
+
+/* Logical height as xdg-output reports it. Without xdg-output: the mode
+ * height (width on outputs rotated 90/270) over the panel's fractional
+ * scale, or the integer wl_output scale, which rounds fractional ones up */
+static uint32_t logical_height(int i) {
+  if (outputs[i].logical_height > 0)
+    return outputs[i].logical_height;
+  int32_t h = (outputs[i].transform & 1) ? outputs[i].mode_width
+                                         : outputs[i].mode_height;
+  if (h <= 0)
+    return 0;
+  if (outputs[i].output == panel_output && panel_scale120 > 0)
+    return (uint32_t)h * 120 / panel_scale120;
+  return h / (outputs[i].scale > 0 ? outputs[i].scale : 1);
+}
+
+/* Largest scale among the known outputs (120 = 1x): mode over logical
+ * size where xdg-output reports it, else the integer wl_output scale */
+static int max_output_scale120(void) {
+  int best = 0;
+  for (int i = 0; i < output_count; i++) {
+    int32_t w = (outputs[i].transform & 1) ? outputs[i].mode_height
+                                           : outputs[i].mode_width;
+    int32_t lw = outputs[i].logical_width;
+    int s = (lw > 0 && w > 0) ? (w * 120 + lw / 2) / lw
+                              : (outputs[i].scale > 0 ? outputs[i].scale : 1) *
+                                    120;
+    if (s > best)
+      best = s;
+  }
+  return best > 0 ? best : 120;
+}
+
+static void check_prefetch_scale(void) {
+  if (prefetch_scale120 && max_output_scale120() != prefetch_scale120)
+    prefetch_pending = true;
+}
+
+/* Push the logical height of the panel's output (or the smallest known
+ * output until the compositor tells us where the panel is) to the renderer */
+static void update_output_height(void) {
+  uint32_t best = 0;
+  for (int i = 0; i < output_count; i++) {
+    uint32_t h = logical_height(i);
+    if (h == 0)
+      continue;
+    if (outputs[i].output == panel_output) {
+      best = h;
+      break;
+    }
+    if (best == 0 || h < best)
+      best = h;
+  }
+  render_set_output_height(best);
+}
+
+/* Integer fallback when the compositor has no fractional scale support:
+ * follow the wl_output scale of the panel's output */
+static void update_output_scale(void) {
+  if (fractional_scale)
+    return;
+  int i = find_output(panel_output);
+  int factor = (i >= 0 && outputs[i].scale > 0) ? outputs[i].scale : 1;
+  render_set_scale(factor * 120);
+}
+
+static void output_geometry(void *data, struct wl_output *output, int32_t x,
+                            int32_t y, int32_t phys_w, int32_t phys_h,
+                            int32_t subpixel, const char *make,
+                            const char *model, int32_t transform) {
+  (void)data;
+  (void)x;
+  (void)y;
+  (void)phys_w;
+  (void)phys_h;
+  (void)subpixel;
+  (void)make;
+  (void)model;
+  int i = find_output(output);
+  if (i >= 0)
+    outputs[i].transform = transform;
+}
+
+static void output_mode(void *data, struct wl_output *output, uint32_t flags,
+                        int32_t w, int32_t h, int32_t refresh) {
+  (void)data;
+  (void)refresh;
+  int i = find_output(output);
+  if (i >= 0 && (flags & WL_OUTPUT_MODE_CURRENT)) {
+    outputs[i].mode_width = w;
+    outputs[i].mode_height = h;
+  }
+}
+
+static void output_done(void *data, struct wl_output *output) {
+  (void)data;
+  (void)output;
+  update_output_height();
+  update_output_scale();
+  check_prefetch_scale();
+}
+
+static void output_scale(void *data, struct wl_output *output,
+                         int32_t factor) {
+  (void)data;
+  int i = find_output(output);
+  if (i >= 0)
+    outputs[i].scale = factor;
+}
+
+static const struct wl_output_listener output_listener = {
+    .geometry = output_geometry,
+    .mode = output_mode,
+    .done = output_done,
+    .scale = output_scale,
+};
+
+static void xdg_output_position(void *data, struct zxdg_output_v1 *xdg_output,
+                                int32_t x, int32_t y) {
+  (void)data;
+  (void)xdg_output;
+  (void)x;
+  (void)y;
+}
+
+static void xdg_output_size(void *data, struct zxdg_output_v1 *xdg_output,
+                            int32_t w, int32_t h) {
+  (void)xdg_output;
+  int i = find_output(data);
+  if (i >= 0) {
+    outputs[i].logical_width = w;
+    outputs[i].logical_height = h;
+  }
+}
+
+/* Only sent before v3; later the wl_output done covers it */
+static void xdg_output_done(void *data, struct zxdg_output_v1 *xdg_output) {
+  (void)data;
+  (void)xdg_output;
+  update_output_height();
+  check_prefetch_scale();
+}
+
+static void xdg_output_name(void *data, struct zxdg_output_v1 *xdg_output,
+                            const char *name) {
+  (void)data;
+  (void)xdg_output;
+  (void)name;
+}
+
+static void xdg_output_description(void *data,
+                                   struct zxdg_output_v1 *xdg_output,
+                                   const char *description) {
+  (void)data;
+  (void)xdg_output;
+  (void)description;
+}
+
+static const struct zxdg_output_v1_listener xdg_output_listener = {
+    .logical_position = xdg_output_position,
+    .logical_size = xdg_output_size,
+    .done = xdg_output_done,
+    .name = xdg_output_name,
+    .description = xdg_output_description,
+};
+
+/* Outputs and the manager may be announced in either order */
+static void watch_xdg_output(int i) {
+  if (!xdg_output_manager || outputs[i].xdg_output)
+    return;
+  outputs[i].xdg_output = zxdg_output_manager_v1_get_xdg_output(
+      xdg_output_manager, outputs[i].output);
+  zxdg_output_v1_add_listener(outputs[i].xdg_output, &xdg_output_listener,
+                              outputs[i].output);
+}
+
+static void surface_enter(void *data, struct wl_surface *wl_surface,
+                          struct wl_output *output) {
+  (void)data;
+  (void)wl_surface;
+  panel_output = output;
+  update_output_height();
+  update_output_scale();
+  if (visible && !fractional_scale)
+    render_ui(&app_state, app_state.width, app_state.height);
+}
+
+static void surface_leave(void *data, struct wl_surface *wl_surface,
+                          struct wl_output *output) {
+  (void)data;
+  (void)wl_surface;
+  if (panel_output == output)
+    panel_output = NULL;
+}
+
+static const struct wl_surface_listener surface_listener = {
+    .enter = surface_enter,
+    .leave = surface_leave,
+};
+
+static void preferred_scale(void *data,
+                            struct wp_fractional_scale_v1 *fractional,
+                            uint32_t scale) {
+  (void)data;
+  (void)fractional;
+  render_set_scale((int)scale);
+  panel_scale120 = scale;
+  update_output_height();
+  if (visible)
+    render_ui(&app_state, app_state.width, app_state.height);
+}
+
+static const struct wp_fractional_scale_v1_listener fractional_scale_listener =
+    {
+        .preferred_scale = preferred_scale,
+};
+
+/* Fractional scaling needs both protocols: the preferred scale says what
+ * to render, the viewport maps the device-pixel buffer back to surface
+ * size. Without them, buffer_scale follows the output's integer scale. */
+static void create_scale_objects(void) {
+  if (!surface || !viewporter)
+    return;
+  panel_viewport = wp_viewporter_get_viewport(viewporter, surface);
+  if (fractional_scale_manager) {
+    fractional_scale = wp_fractional_scale_manager_v1_get_fractional_scale(
+        fractional_scale_manager, surface);
+    wp_fractional_scale_v1_add_listener(fractional_scale,
+                                        &fractional_scale_listener, NULL);
+  }
+}
+
+static void destroy_scale_objects(void) {
+  if (fractional_scale) {
+    wp_fractional_scale_v1_destroy(fractional_scale);
+    fractional_scale = NULL;
+  }
+  if (panel_viewport) {
+    wp_viewport_destroy(panel_viewport);
+    panel_viewport = NULL;
+  }
+}
+
 /* --- Wayland Events --- */
 static void layer_surface_configure(void *data,
                                     struct zwlr_layer_surface_v1 *layer_surf,
@@ -109,6 +404,11 @@ static void seat_capabilities(void *data, struct wl_seat *wl_seat,
     wl_keyboard_add_listener(keyboard, get_keyboard_listener(), state);
     LOG("Keyboard listener attached");
   }
+  if ((caps & WL_SEAT_CAPABILITY_POINTER) && !pointer) {
+    pointer = wl_seat_get_pointer(seat);
+    wl_pointer_add_listener(pointer, get_pointer_listener(), state);
+    LOG("Pointer listener attached");
+  }
 }
 
 static void seat_name(void *data, struct wl_seat *wl_seat, const char *name) {
@@ -125,17 +425,44 @@ static const struct wl_seat_listener seat_listener = {
 static void registry_global(void *data, struct wl_registry *registry,
                             uint32_t name, const char *interface,
                             uint32_t version) {
-  (void)version;
   AppState *state = (AppState *)data;
 
+  if (thumbnails_bind(registry, name, interface, version))
+    return;
+
   if (strcmp(interface, wl_compositor_interface.name) == 0)
     compositor = wl_registry_bind(registry, name, &wl_compositor_interface, 4);
   else if (strcmp(interface, wl_shm_interface.name) == 0)
     shm = wl_registry_bind(registry, name, &wl_shm_interface, 1);
+  else if (strcmp(interface, wl_subcompositor_interface.name) == 0)
+    subcompositor =
+        wl_registry_bind(registry, name, &wl_subcompositor_interface, 1);
   else if (strcmp(interface, zwlr_layer_shell_v1_interface.name) == 0)
     layer_shell =
         wl_registry_bind(registry, name, &zwlr_layer_shell_v1_interface, 1);
-  else if (strcmp(interface, wl_seat_interface.name) == 0) {
+  else if (strcmp(interface, wp_fractional_scale_manager_v1_interface.name) ==
+           0)
+    fractional_scale_manager = wl_registry_bind(
+        registry, name, &wp_fractional_scale_manager_v1_interface, 1);
+  else if (strcmp(interface, wp_viewporter_interface.name) == 0)
+    viewporter = wl_registry_bind(registry, name, &wp_viewporter_interface, 1);
+  else if (strcmp(interface, zxdg_output_manager_v1_interface.name) == 0) {
+    xdg_output_manager =
+        wl_registry_bind(registry, name, &zxdg_output_manager_v1_interface,
+                         version < 3 ? version : 3);
+    for (int i = 0; i < output_count; i++)
+      watch_xdg_output(i);
+  } else if (strcmp(interface, wl_output_interface.name) == 0) {
+    if (output_count < MAX_OUTPUTS) {
+      struct wl_output *output =
+          wl_registry_bind(registry, name, &wl_output_interface, 2);
+      memset(&outputs[output_count], 0, sizeof(outputs[output_count]));
+      outputs[output_count].output = output;
+      outputs[output_count].scale = 1;
+      wl_output_add_listener(output, &output_listener, NULL);
+      watch_xdg_output(output_count++);
+    }
+  } else if (strcmp(interface, wl_seat_interface.name) == 0) {
     seat = wl_registry_bind(registry, name, &wl_seat_interface, 4);
     wl_seat_add_listener(seat, &seat_listener, state);
   }
@@ -153,7 +480,56 @@ static const struct wl_registry_listener registry_listener = {
 
 /* --- Logic --- */
 
+/* Selection highlight lives in a sync subsurface of the panel so that
+ * navigation is a position update instead of a repaint */
+static void create_highlight(void) {
+  if (!subcompositor || !surface || highlight_surface)
+    return;
+
+  highlight_surface = wl_compositor_create_surface(compositor);
+  if (!highlight_surface)
+    return;
+
+  highlight_subsurface = wl_subcompositor_get_subsurface(
+      subcompositor, highlight_surface, surface);
+  if (!highlight_subsurface) {
+    LOG("Failed to create highlight subsurface");
+    wl_surface_destroy(highlight_surface);
+    highlight_surface = NULL;
+    return;
+  }
+  wl_subsurface_place_above(highlight_subsurface, surface);
+  wl_subsurface_set_sync(highlight_subsurface);
+
+  /* Empty input region: input goes to the grid underneath */
+  struct wl_region *region = wl_compositor_create_region(compositor);
+  wl_surface_set_input_region(highlight_surface, region);
+  wl_region_destroy(region);
+
+  if (viewporter)
+    highlight_viewport = wp_viewporter_get_viewport(viewporter,
+                                                    highlight_surface);
+}
+
+static void destroy_highlight(void) {
+  render_reset_highlight();
+  if (highlight_viewport) {
+    wp_viewport_destroy(highlight_viewport);
+    highlight_viewport = NULL;
+  }
+  if (highlight_subsurface) {
+    wl_subsurface_destroy(highlight_subsurface);
+    highlight_subsurface = NULL;
+  }
+  if (highlight_surface) {
+    wl_surface_destroy(highlight_surface);
+    highlight_surface = NULL;
+  }
+}
+
 static void destroy_panel(void) {
+  destroy_highlight();
+  destroy_scale_objects();
   if (layer_surface) {
     zwlr_layer_surface_v1_destroy(layer_surface);
     layer_surface = NULL;
@@ -162,6 +538,7 @@ static void destroy_panel(void) {
     wl_surface_destroy(surface);
     surface = NULL;
   }
+  panel_output = NULL;
   visible = false;
   LOG("Panel destroyed");
 }
@@ -177,6 +554,8 @@ static void create_panel(void) {
     LOG("Failed to create surface");
     return;
   }
+  wl_surface_add_listener(surface, &surface_listener, NULL);
+  create_scale_objects();
 
   layer_surface = zwlr_layer_shell_v1_get_layer_surface(
       layer_shell, surface, NULL, ZWLR_LAYER_SHELL_V1_LAYER_OVERLAY,
@@ -193,6 +572,7 @@ static void create_panel(void) {
   zwlr_layer_surface_v1_set_keyboard_interactivity(layer_surface, 0);
   zwlr_layer_surface_v1_add_listener(layer_surface, &layer_surface_listener,
                                      NULL);
+  create_highlight();
 
   wl_surface_commit(surface);
   wl_display_roundtrip(display);
@@ -205,6 +585,9 @@ static void hide_switcher(void) {
     return;
 
   visible = false;
+  app_state.hover_index = -1; /* A late pointer leave must not repaint */
+  render_log_stats();
+  icons_log_stats();
 
   if (config && config->follow_monitor) {
     destroy_panel();
@@ -214,6 +597,8 @@ static void hide_switcher(void) {
     wl_display_flush(display);
     LOG("Panel hidden (not destroyed)");
   }
+
+  icons_save_cache(); /* Off the show path; no-op when nothing is new */
 }
 
 static void show_switcher(void) {
@@ -245,6 +630,7 @@ static void show_switcher(void) {
   }
 
   app_state.selected_index = (app_state.count > 1) ? 1 : 0;
+  render_invalidate(); /* Fresh window list: prepared frames are outdated */
 
   calculate_dimensions(&app_state, &app_state.width, &app_state.height);
   zwlr_layer_surface_v1_set_size(layer_surface, app_state.width,
@@ -265,6 +651,198 @@ static void select_and_hide(void) {
   hide_switcher();
 }
 
+/* --- Live Updates --- */
+
+/* Changes batched over one backend dispatch, repainted once afterwards */
+static struct {
+  bool dirty;
+  bool refetch;
+  int first, last;
+} live_pending;
+
+static void handle_window_event(const WindowEvent *event) {
+  thumbnails_window_event(event); /* Previews refresh while hidden too */
+  if (event->type == WINDOW_EVENT_OPEN && event->class_name)
+    render_prefetch_icon(event->class_name, max_output_scale120());
+  if (!visible)
+    return;
+
+  int first, last;
+  switch (live_apply(&app_state, config, event, &first, &last)) {
+  case LIVE_CARDS:
+    if (!live_pending.dirty || first < live_pending.first)
+      live_pending.first = first;
+    if (!live_pending.dirty || last > live_pending.last)
+      live_pending.last = last;
+    live_pending.dirty = true;
+    break;
+  case LIVE_REFETCH:
+    live_pending.refetch = true;
+    break;
+  case LIVE_NONE:
+    break;
+  }
+}
+
+/* Warm icons for every open window so the first show doesn't decode them.
+ * The panel hasn't been on an output yet, so this goes by the largest
+ * output scale, and runs again when outputs change it. */
+static void prefetch_icons(void) {
+  prefetch_pending = false;
+  prefetch_scale120 = max_output_scale120();
+  AppState windows;
+  app_state_init(&windows);
+  if (backend->get_windows(&windows, config) >= 0) {
+    for (int i = 0; i < windows.count; i++) {
+      WindowInfo *win = &windows.windows[i];
+      render_prefetch_icon(win->app_id ? win->app_id : win->class_name,
+                           prefetch_scale120);
+    }
+    LOG("Prefetching icons for %d windows at %.2fx", windows.count,
+        prefetch_scale120 / 120.0);
+  }
+  app_state_free(&windows);
+}
+
+/*
+ * config.ini or its theme changed. The new Config is parsed completely
+ * before anything switches to it, so a half-written file never shows, and
+ * only caches fed by changed keys are dropped: the icon cache survives a
+ * color tweak but not a new icon theme or size. Runs while hidden only.
+ */
+static void reload_config(void) {
+  reload_due = 0;
+  Config *fresh = reload_config_files();
+  if (!fresh) {
+    LOG("No config to reload, keeping the current one");
+    return;
+  }
+
+  Config *old = config;
+  bool icon_theme = strcmp(old->icon_theme, fresh->icon_theme) != 0 ||
+                    strcmp(old->icon_fallback, fresh->icon_fallback) != 0;
+  bool icon_size = old->icon_size != fresh->icon_size;
+  config = fresh;
+
+  render_set_config(config);
+  thumbnails_set_config(config); /* Drops previews if the card box changed */
+  if (icon_theme)
+    icons_init(config->icon_theme, config->icon_fallback);
+  icons_set_config(config); /* Drops icons on a new size or mappings */
+  config_watch(config);       /* The theme file may have changed */
+
+  /* Panel lifetime follows follow_monitor */
+  if (old->follow_monitor != config->follow_monitor) {
+    if (config->follow_monitor)
+      destroy_panel();
+    else
+      create_panel();
+  }
+  free_config(old);
+  LOG("Config reloaded");
+
+  if (icon_theme || icon_size)
+    prefetch_icons();
+}
+
+/* Poll timeout shortened to wake at due (0: nothing due) */
+static int timeout_until(double due, int timeout) {
+  if (due <= 0)
+    return timeout;
+  int wait = (int)(due - now_ms()) + 1;
+  return wait < 0 ? 0 : wait < timeout ? wait : timeout;
+}
+
+/* Full re-fetch fallback, keeping the selection on the same window */
+static void refetch_window_list(void) {
+  AppState fresh;
+  app_state_init(&fresh);
+  if (backend->get_windows(&fresh, config) < 0) {
+    LOG("Failed to update window list");
+    app_state_free(&fresh);
+    return;
+  }
+
+  int sel = -1;
+  if (app_state.count > 0)
+    sel = app_state_find(&fresh,
+                         app_state.windows[app_state.selected_index].address);
+  if (sel < 0)
+    sel = app_state.selected_index < fresh.count ? app_state.selected_index
+                                                 : fresh.count - 1;
+  fresh.selected_index = sel < 0 ? 0 : sel;
+  fresh.scroll_row = app_state.scroll_row;
+  fresh.width = app_state.width;
+  fresh.height = app_state.height;
+
+  app_state_free(&app_state);
+  app_state = fresh;
+}
+
+static void flush_live_updates(void) {
+  if (!live_pending.dirty && !live_pending.refetch)
+    return;
+
+  bool full = live_pending.refetch;
+  if (full)
+    refetch_window_list();
+
+  /* Grid grew or shrank: resize, the configure event repaints */
+  uint32_t w, h;
+  calculate_dimensions(&app_state, &w, &h);
+  if (w != app_state.width || h != app_state.height) {
+    render_invalidate();
+    zwlr_layer_surface_v1_set_size(layer_surface, w, h);
+    wl_surface_commit(surface);
+  } else if (full) {
+    render_invalidate();
+    render_ui(&app_state, app_state.width, app_state.height);
+  } else {
+    render_cards(&app_state, live_pending.first, live_pending.last);
+  }
+
+  memset(&live_pending, 0, sizeof(live_pending));
+}
+
+/* A preview landed: repaint its card if the switcher is showing it */
+static void on_thumbnail_ready(const char *address) {
+  if (!visible)
+    return;
+  int index = app_state_find(&app_state, address);
+  if (index >= 0)
+    render_cards(&app_state, index, index + 1);
+}
+
+/* An icon finished loading: repaint the cards showing that class or app
+ * ID */
+static void on_icon_ready(const char *class_name) {
+  if (!visible || app_state.count == 0)
+    return;
+  int (*ranges)[2] = malloc(app_state.count * sizeof(*ranges));
+  if (!ranges)
+    return;
+
+  /* One range per run of adjacent matching cards */
+  int n = 0;
+  for (int i = 0; i < app_state.count; i++) {
+    const char *cls = app_state.windows[i].class_name;
+    const char *app_id = app_state.windows[i].app_id;
+    if ((!cls || strcmp(cls, class_name) != 0) &&
+        (!app_id || strcmp(app_id, class_name) != 0))
+      continue;
+    if (n > 0 && ranges[n - 1][1] == i) {
+      ranges[n - 1][1] = i + 1;
+    } else {
+      ranges[n][0] = i;
+      ranges[n][1] = i + 1;
+      n++;
+    }
+  }
+  if (n > 0)
+    render_card_ranges(&app_state, (const int(*)[2])ranges, n);
+  free(ranges);
+}
+
 static void handle_command(const char *cmd) {
   if (strcmp(cmd, CMD_QUIT) == 0) {
     should_quit = 1;
@@ -297,7 +875,7 @@ static void handle_command(const char *cmd) {
     if (dir != 0 && app_state.count > 0) {
       app_state.selected_index =
           (app_state.selected_index + dir + app_state.count) % app_state.count;
-      render_ui(&app_state, app_state.width, app_state.height);
+      render_selection(&app_state);
     } else if (strcmp(cmd, CMD_SELECT) == 0) {
       select_and_hide();
     }
@@ -399,7 +977,13 @@ static int run_daemon(void) {
   if (!config)
     config = get_default_config();
   render_set_config(config);
+  thumbnails_set_config(config);
+  thumbnails_set_ready_handler(on_thumbnail_ready);
   icons_init(config->icon_theme, config->icon_fallback);
+  icons_set_config(config);
+  icons_load_cache();
+  icons_set_async(true);
+  config_watch(config);
   app_state_init(&app_state);
 
   backend = backend_init();
@@ -444,6 +1028,8 @@ static int run_daemon(void) {
 
   /* 5. Surface Setup */
   surface = wl_compositor_create_surface(compositor);
+  wl_surface_add_listener(surface, &surface_listener, NULL);
+  create_scale_objects();
   layer_surface = zwlr_layer_shell_v1_get_layer_surface(
       layer_shell, surface, NULL, ZWLR_LAYER_SHELL_V1_LAYER_OVERLAY,
       "snappy-switcher");
@@ -453,6 +1039,7 @@ static int run_daemon(void) {
   zwlr_layer_surface_v1_set_keyboard_interactivity(layer_surface, 0);
   zwlr_layer_surface_v1_add_listener(layer_surface, &layer_surface_listener,
                                      NULL);
+  create_highlight();
   wl_surface_commit(surface);
   wl_display_roundtrip(display);
 
@@ -464,12 +1051,18 @@ static int run_daemon(void) {
   }
 
   LOG("Daemon Started (PID: %d)", getpid());
+  prefetch_icons();
 
-  struct pollfd fds[2];
+  struct pollfd fds[6];
+  bool speculating = false;
   fds[0].fd = wl_display_get_fd(display);
   fds[0].events = POLLIN;
   fds[1].fd = socket_fd;
   fds[1].events = POLLIN;
+  fds[2].events = POLLIN;
+  fds[3].events = POLLIN;
+  fds[4].events = POLLIN;
+  fds[5].events = POLLIN;
 
   while (running && !should_quit) {
     while (wl_display_prepare_read(display) != 0) {
@@ -477,7 +1070,28 @@ static int run_daemon(void) {
     }
     wl_display_flush(display);
 
-    if (poll(fds, 2, 100) < 0) {
+    /* Backend change events (-1 is ignored by poll) */
+    fds[2].fd = backend->get_event_fd ? backend->get_event_fd() : -1;
+    fds[2].revents = 0;
+    fds[3].fd = icons_get_watch_fd();
+    fds[3].revents = 0;
+    fds[4].fd = icons_get_ready_fd();
+    fds[4].revents = 0;
+    fds[5].fd = config_get_watch_fd();
+    fds[5].revents = 0;
+
+    /* Don't block while there are speculative frames left to prepare;
+     * wake up in time to refine a fast-tier frame */
+    int timeout = speculating ? 0 : 100;
+    int refine = visible ? render_refine_delay() : -1;
+    if (refine >= 0 && refine < timeout)
+      timeout = refine;
+    if (!visible) {
+      timeout = timeout_until(reload_due, timeout);
+      timeout = timeout_until(icons_due, timeout);
+    }
+    int ready = poll(fds, 6, timeout);
+    if (ready < 0) {
       if (errno == EINTR) {
         wl_display_cancel_read(display);
         continue;
@@ -517,6 +1131,40 @@ static int run_daemon(void) {
         close(client);
       }
     }
+
+    if (fds[2].fd >= 0 && (fds[2].revents & (POLLIN | POLLHUP))) {
+      backend->dispatch_events(handle_window_event);
+      flush_live_updates();
+    }
+
+    if (fds[3].fd >= 0 && (fds[3].revents & POLLIN) && icons_handle_watch())
+      icons_due = now_ms() + ICONS_DEBOUNCE_MS;
+
+    if (fds[4].fd >= 0 && (fds[4].revents & POLLIN))
+      icons_dispatch_ready(on_icon_ready);
+
+    if (fds[5].fd >= 0 && (fds[5].revents & POLLIN) && config_handle_watch())
+      reload_due = now_ms() + RELOAD_DEBOUNCE_MS;
+
+    /* Never under a visible switcher: applied once it hides */
+    if (reload_due > 0 && !visible && now_ms() >= reload_due)
+      reload_config();
+    if (icons_due > 0 && !visible && now_ms() >= icons_due) {
+      icons_due = 0;
+      if (icons_refresh())
+        prefetch_pending = true;
+    }
+    if (prefetch_pending)
+      prefetch_icons();
+
+    /* Idle: pre-render the likely next frame. After any event, check
+     * again on the next non-blocking pass. */
+    if (!visible)
+      speculating = false;
+    else if (ready == 0)
+      speculating = render_speculate(&app_state);
+    else
+      speculating = true;
   }
 
   /* 8. Cleanup */
@@ -528,8 +1176,12 @@ static int run_daemon(void) {
 
   cleanup_server(socket_fd);
   input_cleanup();
+  render_cleanup();
+  thumbnails_cleanup();
   icons_cleanup();
+  appid_cleanup();
   app_state_free(&app_state);
+  config_unwatch();
   free_config(config);
 
   if (backend) {
@@ -537,14 +1189,29 @@ static int run_daemon(void) {
     backend = NULL;
   }
 
+  destroy_highlight();
+  destroy_scale_objects();
   if (layer_surface)
     zwlr_layer_surface_v1_destroy(layer_surface);
   if (surface)
     wl_surface_destroy(surface);
+  for (int i = 0; i < output_count; i++) {
+    if (outputs[i].xdg_output)
+      zxdg_output_v1_destroy(outputs[i].xdg_output);
+    wl_output_destroy(outputs[i].output);
+  }
+  if (xdg_output_manager)
+    zxdg_output_manager_v1_destroy(xdg_output_manager);
   if (keyboard)
     wl_keyboard_destroy(keyboard);
+  if (pointer)
+    wl_pointer_destroy(pointer);
   if (seat)
     wl_seat_destroy(seat);
+  if (fractional_scale_manager)
+    wp_fractional_scale_manager_v1_destroy(fractional_scale_manager);
+  if (viewporter)
+    wp_viewporter_destroy(viewporter);
   if (display)
     wl_display_disconnect(display);
 
@@ -557,6 +1224,11 @@ static void print_help(const char *prog) {
   printf("Usage: %s [OPTION] | <command>\n\n", prog);
   printf("Options:\n");
   printf("  --daemon       Start the switcher daemon\n");
+  printf("  --render-bench Benchmark offscreen rendering for all themes\n");
+  printf("                 [--themes DIR] [--out DIR] [--frames N]\n");
+  printf("                 [--golden DIR [--update-golden]] [--scale S]\n");
+  printf("                 [--threads N]\n");
+  printf("  --scale-bench  Benchmark the icon/preview downscaler [--frames N]\n");
   printf("  --help, -h     Show this help message\n\n");
   printf("Commands (requires daemon running):\n");
   printf("  next           Select next window\n");
@@ -583,6 +1255,12 @@ int main(int argc, char **argv) {
     if (strcmp(argv[1], "--daemon") == 0) {
       return run_daemon();
     }
+    if (strcmp(argv[1], "--render-bench") == 0) {
+      return run_render_bench(argc - 2, argv + 2);
+    }
+    if (strcmp(argv[1], "--scale-bench") == 0) {
+      return run_scale_bench(argc - 2, argv + 2);
+    }
     return run_client(argv[1]);
   }
 
@@ -5,11 +5,17 @@
 #include "render.h"
 #include "config.h"
 #include "icons.h"
+#include "thumbnails.h"
+#include "util.h"
+#include "viewporter-client-protocol.h"
 #include <cairo/cairo.h>
 #include <ctype.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <math.h>
 #include <pango/pangocairo.h>
+#include <pixman.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -25,6 +31,129 @@
 
 static Config *cfg = NULL;
 
+/* Selection highlight buffer (attached to highlight_surface, see main.c) */
+static struct wl_buffer *highlight_buffer = NULL;
+static bool highlight_dirty = true;
+static bool highlight_mapped = false;
+static int highlight_margin = 0;
+static int highlight_w = 0, highlight_h = 0; /* Logical size */
+
+/* Output scale in 1/120 steps (wp_fractional_scale_v1 units). Buffers are
+ * rasterized in device pixels; layout stays in logical (surface) units. */
+static int scale120 = 120;
+static double scale = 1.0;
+
+/* Scale-dependent assets, rasterized in device pixels. A few scales are
+ * kept so moving between outputs reuses what was already built. */
+#define MAX_SCALE_ASSETS 4
+#define ATLAS_INITIAL_COLS 8
+
+typedef struct {
+  int scale120; /* 0 = unused slot */
+  unsigned last_used;
+
+  /* Rounded-corner coverage masks (see ensure_masks) */
+  pixman_image_t *card_mask;
+  pixman_image_t *icon_mask;
+
+  /* Letter-icon atlas: one row per palette color, one column per letter
+   * actually seen; cells are rasterized lazily at the icon size */
+  cairo_surface_t *atlas_surface;
+  pixman_image_t *atlas_img;
+  bool *atlas_ready; /* [col * NUM_ICON_COLORS + color] */
+  int atlas_cols;
+  int atlas_used;
+  int16_t atlas_slot[256]; /* letter -> column + 1 (0 = unassigned) */
+} ScaleAssets;
+
+static ScaleAssets scale_assets[MAX_SCALE_ASSETS];
+static ScaleAssets *assets = NULL; /* Current scale's set */
+static unsigned assets_clock = 0;
+
+static void free_all_assets(void);
+
+/* Drawing target: cairo for text and strokes, pixman for mask fills and
+ * blits. Both wrap the same pixels; (ox, oy) is its device-pixel origin in
+ * panel space. Tiles carry private views of the shared masks (NULL: use
+ * the current assets directly). */
+typedef struct {
+  cairo_t *cr;
+  pixman_image_t *img;
+  int ox, oy;
+  pixman_image_t *card_mask, *icon_mask, *atlas;
+} Canvas;
+
+/* Row tiles rasterized in parallel for large grids. While a parallel pass
+ * runs, shared caches are read-only: everything a card needs is resolved
+ * by a serial prepass first. */
+#define MAX_TILE_THREADS 8
+#define PARALLEL_MIN_CARDS 24 /* Below this, thread handoff costs more */
+
+static int tile_threads = -1; /* Helper threads; -1 = pick from CPU count */
+static bool parallel_pass = false;
+static pthread_mutex_t source_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Quality tiers: fast while cycling over budget, best otherwise. Cached
+ * assets (masks, atlas, icons) are built at best quality either way. */
+typedef enum { QUALITY_FAST = 0, QUALITY_BEST = 1 } RenderQuality;
+
+#define REFINE_IDLE_MS 100 /* Input pause before a fast frame is refined */
+
+static RenderQuality quality = QUALITY_BEST; /* Tier of the frame in work */
+static double frame_ms[2] = {0, 0}; /* Smoothed full-frame time per tier */
+static double last_input_ms = 0;    /* Last selection change */
+static bool refine_pending = false; /* Front frame was drawn fast */
+static unsigned fast_frames = 0;
+static unsigned refined_frames = 0;
+
+/* Persistent shm buffers. Besides the front buffer, idle ones hold
+ * speculatively pre-rendered frames for the predicted next selection. */
+#define POOL_SIZE 4
+
+typedef struct {
+  unsigned generation; /* Window list / config revision */
+  uint32_t width, height;
+  int scale120;
+  int scroll_row;
+  int selected; /* -1 when the highlight subsurface draws the selection */
+  int hovered;
+  RenderQuality quality; /* Not part of identity: best satisfies fast */
+} FrameKey;
+
+typedef struct {
+  struct wl_buffer *buffer;
+  unsigned char *data;
+  int size;
+  int stride;
+  uint32_t width, height; /* Logical size */
+  uint32_t px_w, px_h;    /* Device pixels at scale120 */
+  int scale120;
+  bool busy;  /* Attached and not yet released by the compositor */
+  bool stale; /* Free on release */
+  bool valid; /* Holds the frame described by key */
+  FrameKey key;
+  int grid_x, grid_y; /* Where card 0 was drawn (-1: "No windows") */
+} PoolBuffer;
+
+static PoolBuffer buffer_pool[POOL_SIZE];
+static PoolBuffer *front_buffer = NULL;
+static unsigned frame_generation = 0;
+static unsigned spec_hits = 0;
+static unsigned spec_misses = 0;
+
+static void pool_destroy_all(void);
+static void tile_pool_stop(void);
+
+/* Grid geometry shared by rendering, damage and pointer hit testing */
+static Layout cached_layout;
+static bool layout_dirty = true;
+
+/* Logical height of the output the panel is on (0 = unknown, no cap) */
+static uint32_t output_height = 0;
+
+/* Selected-card tint drawn by the highlight over the (unselected) card */
+#define HIGHLIGHT_TINT_ALPHA 0.35
+
 /* Palette for letter icon fallbacks */
 static const uint32_t icon_colors[] = {
     0xe78284, /* Red */
@@ -37,7 +166,75 @@ static const uint32_t icon_colors[] = {
 };
 #define NUM_ICON_COLORS (sizeof(icon_colors) / sizeof(icon_colors[0]))
 
-void render_set_config(Config *config) { cfg = config; }
+void render_set_config(Config *config) {
+  cfg = config;
+  highlight_dirty = true;
+  free_all_assets();
+  frame_generation++;
+  layout_dirty = true;
+}
+
+void render_set_scale(int scale_120) {
+  if (scale_120 <= 0)
+    scale_120 = 120;
+  if (scale_120 == scale120)
+    return;
+  LOG("Output scale %.3f", scale_120 / 120.0);
+  scale120 = scale_120;
+  scale = scale_120 / 120.0;
+  highlight_dirty = true;
+}
+
+/* Fast tier only while selection changes keep coming and a best-quality
+ * frame is known not to fit the budget */
+static void choose_quality(void) {
+  int budget = cfg ? cfg->frame_budget : 16;
+  bool cycling = now_ms() - last_input_ms < REFINE_IDLE_MS;
+  quality = (budget > 0 && cycling && frame_ms[QUALITY_BEST] > budget)
+                ? QUALITY_FAST
+                : QUALITY_BEST;
+}
+
+/* Per-frame drawing state for the current tier */
+static void apply_quality(cairo_t *cr) {
+  bool fast = quality == QUALITY_FAST;
+  cairo_set_antialias(cr, fast ? CAIRO_ANTIALIAS_FAST : CAIRO_ANTIALIAS_BEST);
+  cairo_font_options_t *fo = cairo_font_options_create();
+  cairo_font_options_set_antialias(fo, fast ? CAIRO_ANTIALIAS_GRAY
+                                            : CAIRO_ANTIALIAS_DEFAULT);
+  cairo_font_options_set_hint_metrics(fo, fast ? CAIRO_HINT_METRICS_OFF
+                                               : CAIRO_HINT_METRICS_DEFAULT);
+  cairo_set_font_options(cr, fo);
+  cairo_font_options_destroy(fo);
+}
+
+/* Logical length -> device pixels at the current scale */
+static int px(double v) { return (int)lround(v * scale); }
+
+/* Preview box below the title, in logical units relative to the card */
+static void thumbnail_box(int *x, int *y, int *w, int *h) {
+  int cw = cfg ? cfg->card_width : 200;
+  int ch = cfg ? cfg->card_height : 160;
+  *x = 10;
+  *y = 10 + 20 + 10;
+  *w = cw - 20;
+  *h = ch - *y - 10;
+}
+
+void render_thumbnail_size(int *w, int *h) {
+  int bx, by, bw, bh;
+  thumbnail_box(&bx, &by, &bw, &bh);
+  *w = px(bw);
+  *h = px(bh);
+}
+
+void render_buffer_size(uint32_t width, uint32_t height, uint32_t *px_w,
+                        uint32_t *px_h) {
+  *px_w = px(width);
+  *px_h = px(height);
+}
+
+void render_set_output_height(uint32_t height) { output_height = height; }
 
 int create_shm_file(off_t size) {
   char name[] = "/tmp/snappy-shm-XXXXXX";
@@ -96,76 +293,498 @@ static void draw_rounded_rect(cairo_t *cr, double x, double y, double w,
   cairo_close_path(cr);
 }
 
-static void draw_letter_icon(cairo_t *cr, const char *cls, double cx, double cy,
-                             int size, int radius, int letter_size) {
+/* --- Precomputed Masks & Pixman Fast Paths --- */
+
+/* Card and icon geometry is fixed per config, so their rounded-corner
+ * coverage is rasterized once into A8 masks. Fills, stack layers and icon
+ * clipping are then plain (SIMD) pixman composites, no path tessellation. */
+static pixman_image_t *build_rounded_mask(int w, int h, double r) {
+  pixman_image_t *mask = pixman_image_create_bits(PIXMAN_a8, w, h, NULL, 0);
+  if (!mask)
+    return NULL;
+
+  cairo_surface_t *surf = cairo_image_surface_create_for_data(
+      (unsigned char *)pixman_image_get_data(mask), CAIRO_FORMAT_A8, w, h,
+      pixman_image_get_stride(mask));
+  cairo_t *cr = cairo_create(surf);
+  cairo_set_antialias(cr, CAIRO_ANTIALIAS_BEST);
+  cairo_set_source_rgba(cr, 0, 0, 0, 1);
+  draw_rounded_rect(cr, 0, 0, w, h, r);
+  cairo_fill(cr);
+  cairo_destroy(cr);
+  cairo_surface_flush(surf);
+  cairo_surface_destroy(surf);
+  return mask;
+}
+
+static void free_letter_atlas(ScaleAssets *a);
+
+static void free_assets(ScaleAssets *a) {
+  if (a->card_mask)
+    pixman_image_unref(a->card_mask);
+  if (a->icon_mask)
+    pixman_image_unref(a->icon_mask);
+  free_letter_atlas(a);
+  memset(a, 0, sizeof(*a));
+}
+
+static void free_all_assets(void) {
+  for (int i = 0; i < MAX_SCALE_ASSETS; i++)
+    free_assets(&scale_assets[i]);
+  assets = NULL;
+}
+
+/* Asset set for the current scale, evicting the least recently used one
+ * when all slots hold other scales */
+static ScaleAssets *current_assets(void) {
+  if (!assets || assets->scale120 != scale120) {
+    ScaleAssets *pick = NULL;
+    for (int i = 0; i < MAX_SCALE_ASSETS; i++) {
+      ScaleAssets *a = &scale_assets[i];
+      if (a->scale120 == scale120) {
+        pick = a;
+        break;
+      }
+      if (!pick || (pick->scale120 && (!a->scale120 ||
+                                       a->last_used < pick->last_used)))
+        pick = a;
+    }
+    if (pick->scale120 != scale120) {
+      free_assets(pick);
+      pick->scale120 = scale120;
+    }
+    assets = pick;
+  }
+  assets->last_used = ++assets_clock;
+  return assets;
+}
+
+static void ensure_masks(void) {
+  ScaleAssets *a = current_assets();
+  if (a->card_mask && a->icon_mask)
+    return;
+
+  int cw = cfg ? cfg->card_width : 200;
+  int ch = cfg ? cfg->card_height : 160;
+  int isz = cfg ? cfg->icon_size : 64;
+  if (!a->card_mask)
+    a->card_mask = build_rounded_mask(px(cw), px(ch),
+                                      (cfg ? cfg->card_radius : 12) * scale);
+  if (!a->icon_mask)
+    a->icon_mask = build_rounded_mask(px(isz), px(isz),
+                                      (cfg ? cfg->icon_radius : 12) * scale);
+}
+
+static pixman_image_t *card_mask(Canvas *cv) {
+  return cv->card_mask ? cv->card_mask : assets->card_mask;
+}
+
+static pixman_image_t *icon_mask(Canvas *cv) {
+  return cv->icon_mask ? cv->icon_mask : assets->icon_mask;
+}
+
+/* Composite a solid color through a mask at logical (x, y) in panel
+ * coordinates */
+static void fill_mask(Canvas *cv, pixman_image_t *mask, int x, int y,
+                      uint32_t rgb, double alpha) {
+  /* pixman wants premultiplied 16-bit channels */
+  uint16_t a = (uint16_t)(alpha * 0xffff);
+  pixman_color_t color = {
+      .red = (uint16_t)(((rgb >> 16) & 0xff) * 0x101 * alpha),
+      .green = (uint16_t)(((rgb >> 8) & 0xff) * 0x101 * alpha),
+      .blue = (uint16_t)((rgb & 0xff) * 0x101 * alpha),
+      .alpha = a,
+  };
+  pixman_image_t *src = pixman_image_create_solid_fill(&color);
+  if (!src)
+    return;
+
+  cairo_surface_flush(cairo_get_target(cv->cr));
+  pixman_image_composite32(PIXMAN_OP_OVER, src, mask, cv->img, 0, 0, 0, 0,
+                           px(x) - cv->ox, px(y) - cv->oy,
+                           pixman_image_get_width(mask),
+                           pixman_image_get_height(mask));
+  cairo_surface_mark_dirty(cairo_get_target(cv->cr));
+  pixman_image_unref(src);
+}
+
+/* Blit a device-resolution icon surface clipped by the icon mask at logical
+ * (x, y). Returns false if the surface isn't a plain image the fast path
+ * can read. */
+static bool blit_icon(Canvas *cv, cairo_surface_t *icon, int x, int y) {
+  cairo_format_t fmt = cairo_image_surface_get_format(icon);
+  if (fmt != CAIRO_FORMAT_ARGB32 && fmt != CAIRO_FORMAT_RGB24)
+    return false;
+
+  if (!parallel_pass)
+    cairo_surface_flush(icon); /* Icons are never drawn to after loading */
+  pixman_image_t *src = pixman_image_create_bits(
+      fmt == CAIRO_FORMAT_ARGB32 ? PIXMAN_a8r8g8b8 : PIXMAN_x8r8g8b8,
+      cairo_image_surface_get_width(icon),
+      cairo_image_surface_get_height(icon),
+      (uint32_t *)cairo_image_surface_get_data(icon),
+      cairo_image_surface_get_stride(icon));
+  if (!src)
+    return false;
+
+  cairo_surface_flush(cairo_get_target(cv->cr));
+  pixman_image_t *mask = icon_mask(cv);
+  pixman_image_composite32(PIXMAN_OP_OVER, src, mask, cv->img, 0, 0, 0, 0,
+                           px(x) - cv->ox, px(y) - cv->oy,
+                           pixman_image_get_width(mask),
+                           pixman_image_get_height(mask));
+  cairo_surface_mark_dirty(cairo_get_target(cv->cr));
+  pixman_image_unref(src);
+  return true;
+}
+
+/* Rounded square in a palette color with one white letter */
+static void paint_letter_icon(cairo_t *cr, int x, int y, int size, int radius,
+                              uint32_t color, char letter, int letter_size) {
   cairo_save(cr);
-  cairo_new_path(cr);
 
-  /* Background */
-  uint32_t color = icon_colors[hash_string(cls) % NUM_ICON_COLORS];
   double r, g, b;
   color_to_rgb(color, &r, &g, &b);
-
   cairo_set_source_rgb(cr, r, g, b);
-  draw_rounded_rect(cr, cx - size / 2.0, cy - size / 2.0, size, size, radius);
+  draw_rounded_rect(cr, x, y, size, size, radius);
   cairo_fill(cr);
 
-  /* Letter */
-  char letter[2] = {cls && cls[0] ? toupper(cls[0]) : '?', 0};
+  char text[2] = {letter, 0};
   PangoLayout *layout = create_layout(cr, letter_size);
-  pango_layout_set_text(layout, letter, -1);
+  pango_layout_set_text(layout, text, -1);
 
   int lw, lh;
   pango_layout_get_pixel_size(layout, &lw, &lh);
 
   cairo_set_source_rgb(cr, 1, 1, 1);
-  cairo_move_to(cr, cx - lw / 2.0, cy - lh / 2.0);
+  cairo_move_to(cr, x + (size - lw) / 2.0, y + (size - lh) / 2.0);
   pango_cairo_show_layout(cr, layout);
 
   g_object_unref(layout);
   cairo_restore(cr);
 }
 
-static void draw_icon(cairo_t *cr, const char *cls, double cx, double cy) {
+/* --- Letter Icon Atlas --- */
+
+static void free_letter_atlas(ScaleAssets *a) {
+  if (a->atlas_img) {
+    pixman_image_unref(a->atlas_img);
+    a->atlas_img = NULL;
+  }
+  if (a->atlas_surface) {
+    cairo_surface_destroy(a->atlas_surface);
+    a->atlas_surface = NULL;
+  }
+  free(a->atlas_ready);
+  a->atlas_ready = NULL;
+  a->atlas_cols = 0;
+  a->atlas_used = 0;
+  memset(a->atlas_slot, 0, sizeof(a->atlas_slot));
+}
+
+/* Column assigned to `letter`, growing the atlas as needed (-1 on error) */
+static int atlas_column(ScaleAssets *a, unsigned char letter) {
+  if (a->atlas_slot[letter])
+    return a->atlas_slot[letter] - 1;
+
+  if (a->atlas_used == a->atlas_cols) {
+    int size = px(cfg ? cfg->icon_size : 64);
+    int cols = a->atlas_cols ? a->atlas_cols * 2 : ATLAS_INITIAL_COLS;
+
+    cairo_surface_t *grown = cairo_image_surface_create(
+        CAIRO_FORMAT_ARGB32, cols * size, NUM_ICON_COLORS * size);
+    if (cairo_surface_status(grown) != CAIRO_STATUS_SUCCESS) {
+      cairo_surface_destroy(grown);
+      return -1;
+    }
+    bool *ready =
+        realloc(a->atlas_ready, cols * NUM_ICON_COLORS * sizeof(bool));
+    if (!ready) {
+      cairo_surface_destroy(grown);
+      return -1;
+    }
+    memset(ready + a->atlas_cols * NUM_ICON_COLORS, 0,
+           (cols - a->atlas_cols) * NUM_ICON_COLORS * sizeof(bool));
+    a->atlas_ready = ready;
+
+    if (a->atlas_surface) {
+      cairo_t *cr = cairo_create(grown);
+      cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
+      cairo_set_source_surface(cr, a->atlas_surface, 0, 0);
+      cairo_paint(cr);
+      cairo_destroy(cr);
+      cairo_surface_destroy(a->atlas_surface);
+    }
+    if (a->atlas_img)
+      pixman_image_unref(a->atlas_img);
+
+    cairo_surface_flush(grown);
+    a->atlas_surface = grown;
+    a->atlas_img = pixman_image_create_bits(
+        PIXMAN_a8r8g8b8, cols * size, NUM_ICON_COLORS * size,
+        (uint32_t *)cairo_image_surface_get_data(grown),
+        cairo_image_surface_get_stride(grown));
+    a->atlas_cols = cols;
+  }
+
+  a->atlas_slot[letter] = (int16_t)(a->atlas_used + 1);
+  return a->atlas_used++;
+}
+
+/* Locate (rasterizing on first use, unless read-only) the atlas cell for
+ * letter × color, in device pixels */
+static bool atlas_cell(ScaleAssets *a, unsigned char letter, int color,
+                       bool read_only, int *sx, int *sy) {
+  if (read_only && !a->atlas_slot[letter])
+    return false;
+  int col = atlas_column(a, letter);
+  if (col < 0 || !a->atlas_img)
+    return false;
+
+  int size = px(cfg ? cfg->icon_size : 64);
+  *sx = col * size;
+  *sy = color * size;
+
+  bool *ready = &a->atlas_ready[col * NUM_ICON_COLORS + color];
+  if (!*ready && read_only)
+    return false;
+  if (!*ready) {
+    cairo_t *cr = cairo_create(a->atlas_surface);
+    cairo_set_antialias(cr, CAIRO_ANTIALIAS_BEST);
+    paint_letter_icon(cr, *sx, *sy, size, px(cfg ? cfg->icon_radius : 12),
+                      icon_colors[color], (char)letter,
+                      px(cfg ? cfg->icon_letter_size : 28));
+    cairo_destroy(cr);
+    cairo_surface_flush(a->atlas_surface);
+    *ready = true;
+  }
+  return true;
+}
+
+static void letter_of(const char *cls, unsigned char *letter, int *color) {
+  *color = hash_string(cls) % NUM_ICON_COLORS;
+  *letter = cls && cls[0] ? toupper((unsigned char)cls[0]) : '?';
+}
+
+static void draw_letter_icon(Canvas *cv, const char *cls, int x, int y,
+                             int size, int letter_size) {
+  int color;
+  unsigned char letter;
+  letter_of(cls, &letter, &color);
+
+  /* Parallel tiles only read cells the prepass made; a miss (cache full)
+   * paints directly */
+  int sx, sy;
+  if (atlas_cell(assets, letter, color, parallel_pass, &sx, &sy)) {
+    pixman_image_t *atlas = cv->atlas ? cv->atlas : assets->atlas_img;
+    cairo_surface_flush(cairo_get_target(cv->cr));
+    pixman_image_composite32(PIXMAN_OP_OVER, atlas, NULL, cv->img, sx,
+                             sy, 0, 0, px(x) - cv->ox, px(y) - cv->oy,
+                             px(size), px(size));
+    cairo_surface_mark_dirty(cairo_get_target(cv->cr));
+    return;
+  }
+
+  paint_letter_icon(cv->cr, x, y, size, cfg ? cfg->icon_radius : 12,
+                    icon_colors[color], (char)letter, letter_size);
+}
+
+/*
+ * Icon for a key at device size, or NULL to draw the letter. With async
+ * loading (the daemon) nothing here touches the disk: a missing icon is
+ * queued and its card repainted when it lands. Otherwise the fast tier
+ * and tile threads stay cache-only and the refinement frame loads.
+ * *known is false while the answer is still pending.
+ */
+static cairo_surface_t *icon_for(const char *key, int size, bool cache_only,
+                                 bool *known) {
+  if (icons_async()) {
+    cairo_surface_t *icon = cached_app_icon(key, size, known);
+    if (!*known)
+      icons_request(key, size);
+    return icon;
+  }
+  if (cache_only)
+    return cached_app_icon(key, size, known);
+  *known = true;
+  return load_app_icon(key, size);
+}
+
+/* A sandboxed app's own ID goes first; its WM class is only tried once
+ * the ID is known to have no icon */
+static cairo_surface_t *card_icon(const WindowInfo *win, int size,
+                                  bool cache_only) {
+  bool known;
+  if (win->app_id) {
+    cairo_surface_t *icon = icon_for(win->app_id, size, cache_only, &known);
+    if (icon || !known)
+      return icon;
+  }
+  return icon_for(win->class_name, size, cache_only, &known);
+}
+
+/* Draw the window's icon with its top-left corner at (x, y) */
+static void draw_icon(Canvas *cv, const WindowInfo *win, int x, int y) {
   int size = cfg ? cfg->icon_size : 64;
   int radius = cfg ? cfg->icon_radius : 12;
 
-  cairo_save(cr);
-
-  cairo_surface_t *icon = load_app_icon(cls, size);
+  /* Loaded at device resolution, so the icon cache is keyed by scale */
+  cairo_surface_t *icon =
+      card_icon(win, px(size), quality == QUALITY_FAST || parallel_pass);
   if (icon && cairo_surface_status(icon) == CAIRO_STATUS_SUCCESS) {
-    /* Clip mask */
-    draw_rounded_rect(cr, cx - size / 2.0, cy - size / 2.0, size, size, radius);
-    cairo_clip(cr);
-
-    cairo_set_source_surface(cr, icon, cx - size / 2.0, cy - size / 2.0);
-    cairo_paint(cr);
+    if (!blit_icon(cv, icon, x, y)) {
+      /* Slow path for non-image surfaces (shared as a cairo source, so
+       * tiles take turns) */
+      cairo_t *cr = cv->cr;
+      pthread_mutex_lock(&source_lock);
+      cairo_save(cr);
+      draw_rounded_rect(cr, x, y, size, size, radius);
+      cairo_clip(cr);
+      cairo_translate(cr, x, y);
+      cairo_scale(cr, 1.0 / scale, 1.0 / scale);
+      cairo_set_source_surface(cr, icon, 0, 0);
+      cairo_pattern_set_filter(cairo_get_source(cr),
+                               quality == QUALITY_FAST ? CAIRO_FILTER_FAST
+                                                       : CAIRO_FILTER_BEST);
+      cairo_paint(cr);
+      cairo_restore(cr);
+      pthread_mutex_unlock(&source_lock);
+    }
     cairo_surface_destroy(icon);
   } else {
     /* Fallback */
     if (icon)
       cairo_surface_destroy(icon);
     if (!cfg || cfg->show_letter_fallback) {
-      draw_letter_icon(cr, cls, cx, cy, size, radius,
+      draw_letter_icon(cv, win->class_name, x, y, size,
                        cfg ? cfg->icon_letter_size : 28);
     }
   }
+}
 
+/* Cached window preview centred in the card's preview box. Thumbnails are
+ * downscaled at capture time, so this is normally a 1:1 copy. */
+static bool draw_thumbnail(Canvas *cv, const char *address, int x, int y) {
+  if (!cfg || !cfg->show_thumbnails)
+    return false;
+  cairo_surface_t *thumb =
+      parallel_pass ? thumbnails_peek(address) : thumbnails_get(address);
+  if (!thumb)
+    return false;
+
+  int bx, by, bw, bh;
+  thumbnail_box(&bx, &by, &bw, &bh);
+  double tw = cairo_image_surface_get_width(thumb) / scale;
+  double th = cairo_image_surface_get_height(thumb) / scale;
+  double s = fmin(1.0, fmin(bw / tw, bh / th)); /* Scale changed since */
+  tw *= s;
+  th *= s;
+  double tx = x + bx + (bw - tw) / 2;
+  double ty = y + by + (bh - th) / 2;
+
+  cairo_t *cr = cv->cr;
+  pthread_mutex_lock(&source_lock);
+  cairo_save(cr);
+  draw_rounded_rect(cr, tx, ty, tw, th, cfg->icon_radius / 2.0);
+  cairo_clip(cr);
+  cairo_translate(cr, tx, ty);
+  cairo_scale(cr, s / scale, s / scale);
+  cairo_set_source_surface(cr, thumb, 0, 0);
+  cairo_pattern_set_filter(cairo_get_source(cr), s == 1.0 ? CAIRO_FILTER_FAST
+                                                          : CAIRO_FILTER_GOOD);
+  cairo_paint(cr);
   cairo_restore(cr);
+  pthread_mutex_unlock(&source_lock);
+  return true;
 }
 
-static void draw_card(cairo_t *cr, WindowInfo *win, double x, double y,
-                      bool selected) {
+/* Sketch of the card's workspace from the windows' layout rectangles,
+ * with the window(s) the card stands for in the accent colour. The
+ * monitor extent is estimated from every window on that monitor. */
+static void draw_minimap(Canvas *cv, AppState *state, WindowInfo *win, int x,
+                         int y) {
+  if (!cfg || !cfg->show_minimap || !state->members || win->width <= 0 ||
+      win->height <= 0)
+    return;
+
+  int mx0 = INT_MAX, my0 = INT_MAX, mx1 = INT_MIN, my1 = INT_MIN;
+  for (int i = 0; i < state->member_count; i++) {
+    WindowInfo *m = &state->members[i];
+    if (m->monitor_id != win->monitor_id || m->width <= 0 || m->height <= 0)
+      continue;
+    mx0 = m->x < mx0 ? m->x : mx0;
+    my0 = m->y < my0 ? m->y : my0;
+    mx1 = m->x + m->width > mx1 ? m->x + m->width : mx1;
+    my1 = m->y + m->height > my1 ? m->y + m->height : my1;
+  }
+  if (mx1 <= mx0 || my1 <= my0)
+    return;
+
+  /* Strip below the icon, kept clear of the count badge */
+  double mw = mx1 - mx0, mh = my1 - my0;
+  double top = 10 + 20 + 10 + cfg->icon_size + 6;
+  double box_h = cfg->card_height - 8 - top;
+  double box_w = box_h * mw / mh;
+  double max_w = cfg->card_width - 2 * 36;
+  if (box_h < 12 || max_w < 12)
+    return;
+  if (box_w > max_w) {
+    box_w = max_w;
+    box_h = box_w * mh / mw;
+  }
+  double bx = x + (cfg->card_width - box_w) / 2;
+  double by = y + top;
+  double s = box_w / mw;
+
+  double sub_r, sub_g, sub_b, acc_r, acc_g, acc_b;
+  color_to_rgb(cfg->subtext_color, &sub_r, &sub_g, &sub_b);
+  color_to_rgb(cfg->border_color, &acc_r, &acc_g, &acc_b);
+
+  cairo_t *cr = cv->cr;
   cairo_save(cr);
+  cairo_set_line_width(cr, 1);
+  cairo_set_source_rgba(cr, sub_r, sub_g, sub_b, 0.5);
+  cairo_rectangle(cr, bx - 0.5, by - 0.5, box_w + 1, box_h + 1);
+  cairo_stroke(cr);
 
-  double bg_r, bg_g, bg_b;
-  double sel_r, sel_g, sel_b;
-  double brd_r, brd_g, brd_b;
-  double txt_r, txt_g, txt_b;
+  /* Tiled, then floating, then fullscreen windows on top */
+  for (int layer = 0; layer < 3; layer++) {
+    for (int i = 0; i < state->member_count; i++) {
+      WindowInfo *m = &state->members[i];
+      int m_layer = m->is_fullscreen ? 2 : m->is_floating ? 1 : 0;
+      if (m_layer != layer || m->workspace_id != win->workspace_id ||
+          m->monitor_id != win->monitor_id || m->width <= 0 ||
+          m->height <= 0)
+        continue;
+
+      bool target = strcmp(m->address, win->address) == 0 ||
+                    (win->group_count > 1 && !win->is_floating &&
+                     !m->is_floating &&
+                     strcmp(m->class_name, win->class_name) == 0);
+      double rx = bx + (m->x - mx0) * s, ry = by + (m->y - my0) * s;
+      double rw = m->width * s, rh = m->height * s;
+      cairo_rectangle(cr, rx + 1, ry + 1, fmax(rw - 2, 1), fmax(rh - 2, 1));
+      if (target)
+        cairo_set_source_rgb(cr, acc_r, acc_g, acc_b);
+      else
+        cairo_set_source_rgba(cr, sub_r, sub_g, sub_b, 0.35);
+      cairo_fill(cr);
+    }
+  }
+  cairo_restore(cr);
+}
+
+static void draw_card(Canvas *cv, AppState *state, WindowInfo *win, int x,
+                      int y, bool selected, bool hovered) {
+  cairo_t *cr = cv->cr;
+  cairo_save(cr);
+
+  uint32_t bg = cfg ? cfg->card_bg : 0x313244;
+  uint32_t sel = cfg ? cfg->card_selected : 0x45475a;
+  double brd_r = 0.5, brd_g = 0.7, brd_b = 1.0;
+  double txt_r = 1.0, txt_g = 1.0, txt_b = 1.0;
 
   if (cfg) {
-    color_to_rgb(cfg->card_bg, &bg_r, &bg_g, &bg_b);
-    color_to_rgb(cfg->card_selected, &sel_r, &sel_g, &sel_b);
     color_to_rgb(cfg->border_color, &brd_r, &brd_g, &brd_b);
     color_to_rgb(cfg->text_color, &txt_r, &txt_g, &txt_b);
   }
@@ -176,25 +795,16 @@ static void draw_card(cairo_t *cr, WindowInfo *win, double x, double y,
 
   /* Stack effect (Context Mode) */
   if (win->group_count > 1) {
-    cairo_set_source_rgba(cr, bg_r, bg_g, bg_b, 0.5);
-    draw_rounded_rect(cr, x + 6, y + 6, w, h, r);
-    cairo_fill(cr);
-
-    cairo_set_source_rgba(cr, bg_r, bg_g, bg_b, 0.7);
-    draw_rounded_rect(cr, x + 3, y + 3, w, h, r);
-    cairo_fill(cr);
+    fill_mask(cv, card_mask(cv), x + 6, y + 6, bg, 0.5);
+    fill_mask(cv, card_mask(cv), x + 3, y + 3, bg, 0.7);
   }
 
-  /* Main Card */
-  if (selected)
-    cairo_set_source_rgb(cr, sel_r, sel_g, sel_b);
-  else
-    cairo_set_source_rgb(cr, bg_r, bg_g, bg_b);
+  /* Main Card (hover: halfway towards the selected colour) */
+  fill_mask(cv, card_mask(cv), x, y, selected ? sel : bg, 1.0);
+  if (hovered && !selected)
+    fill_mask(cv, card_mask(cv), x, y, sel, 0.5);
 
-  draw_rounded_rect(cr, x, y, w, h, r);
-  cairo_fill(cr);
-
-  /* Border */
+  /* Border (inline selection only; normally drawn by the highlight) */
   if (selected) {
     cairo_set_source_rgb(cr, brd_r, brd_g, brd_b);
     cairo_set_line_width(cr, cfg ? cfg->border_width : 2);
@@ -214,9 +824,12 @@ static void draw_card(cairo_t *cr, WindowInfo *win, double x, double y,
   pango_cairo_show_layout(cr, title);
   g_object_unref(title);
 
-  /* Icon */
-  draw_icon(cr, win->class_name, x + w / 2.0,
-            y + 10 + 20 + 10 + (cfg ? cfg->icon_size / 2.0 : 32));
+  /* Preview when one is cached, otherwise the icon and layout sketch */
+  if (!draw_thumbnail(cv, win->address, x, y)) {
+    int icon_size = cfg ? cfg->icon_size : 64;
+    draw_icon(cv, win, x + (w - icon_size) / 2, y + 10 + 20 + 10);
+    draw_minimap(cv, state, win, x, y);
+  }
 
   /* Badge (Count) */
   if (win->group_count > 1) {
@@ -228,6 +841,7 @@ static void draw_card(cairo_t *cr, WindowInfo *win, double x, double y,
 
     /* Badge BG (Accent) */
     cairo_set_source_rgb(cr, brd_r, brd_g, brd_b);
+    cairo_new_path(cr);
     cairo_arc(cr, bx, by, 10, 0, 2 * M_PI);
     cairo_fill(cr);
 
@@ -248,30 +862,184 @@ static void draw_card(cairo_t *cr, WindowInfo *win, double x, double y,
   cairo_restore(cr);
 }
 
-void calculate_dimensions(AppState *state, uint32_t *width, uint32_t *height) {
-  int count = (state && state->count > 0) ? state->count : 1;
-  int w = cfg ? cfg->card_width : 200;
-  int h = cfg ? cfg->card_height : 160;
-  int gap = cfg ? cfg->card_gap : 12;
-  int pad = cfg ? cfg->padding : 32;
-  int cols = cfg ? cfg->max_cols : 5;
+/* --- Layout --- */
+
+/* Grid geometry for `count` cards in a panel of the given size (0 x 0 when
+ * only the grid extent is wanted) */
+static void layout_compute(Layout *l, int count, uint32_t width,
+                           uint32_t height) {
+  l->count = count;
+  l->width = width;
+  l->height = height;
+  l->card_w = cfg ? cfg->card_width : 200;
+  l->card_h = cfg ? cfg->card_height : 160;
+  l->gap = cfg ? cfg->card_gap : 12;
+  l->pad = cfg ? cfg->padding : 32;
+  l->max_cols = cfg ? cfg->max_cols : 5;
+
+  int n = count > 0 ? count : 1;
+  l->cols = n < l->max_cols ? n : l->max_cols;
+  l->rows = (n + l->max_cols - 1) / l->max_cols;
+  l->grid_w = (l->cols * l->card_w) + ((l->cols - 1) * l->gap);
+  l->grid_h = (l->rows * l->card_h) + ((l->rows - 1) * l->gap);
+
+  l->start_x = ((int)width - l->grid_w) / 2;
+  l->start_y = ((int)height - l->grid_h) / 2;
+  if (l->start_x < l->pad)
+    l->start_x = l->pad;
+  if (l->start_y < l->pad)
+    l->start_y = l->pad;
+
+  /* Fully visible rows */
+  l->visible_rows =
+      ((int)height - (l->pad * 2) + l->gap) / (l->card_h + l->gap);
+  if (l->visible_rows < 1)
+    l->visible_rows = 1;
+}
 
-  if (count < cols)
-    cols = count;
-  int rows = (count + cols - 1) / cols;
+/* Layout of the current snapshot, recomputed only when the card count,
+ * panel size or config changed */
+static const Layout *current_layout(AppState *state, uint32_t width,
+                                    uint32_t height) {
+  int count = state ? state->count : 0;
+  if (layout_dirty || cached_layout.count != count ||
+      cached_layout.width != width || cached_layout.height != height) {
+    layout_compute(&cached_layout, count, width, height);
+    layout_dirty = false;
+  }
+  return &cached_layout;
+}
 
-  *width = (cols * w) + ((cols - 1) * gap) + (pad * 2);
-  *height = (rows * h) + ((rows - 1) * gap) + (pad * 2);
+const Layout *render_layout(AppState *state) {
+  return current_layout(state, state->width, state->height);
+}
+
+void layout_card_origin(const Layout *l, int index, int scroll_row, int *x,
+                        int *y) {
+  *x = l->start_x + (index % l->max_cols) * (l->card_w + l->gap);
+  *y = l->start_y + (index / l->max_cols - scroll_row) * (l->card_h + l->gap);
+}
+
+int layout_hit_test(const Layout *l, int scroll_row, double x, double y) {
+  if (l->count <= 0)
+    return -1;
+
+  /* Cards are clipped to the grid viewport */
+  if (y < l->pad / 2 || y >= (int)l->height - l->pad / 2)
+    return -1;
+
+  double gx = x - l->start_x;
+  double gy = y - l->start_y;
+  if (gx < 0 || gy < 0)
+    return -1;
+
+  int col = (int)gx / (l->card_w + l->gap);
+  int row = (int)gy / (l->card_h + l->gap);
+  if (col >= l->cols)
+    return -1;
+
+  /* In the gap between cards */
+  if (gx - col * (l->card_w + l->gap) >= l->card_w ||
+      gy - row * (l->card_h + l->gap) >= l->card_h)
+    return -1;
+
+  int index = (row + scroll_row) * l->max_cols + col;
+  return index < l->count ? index : -1;
+}
+
+void calculate_dimensions(AppState *state, uint32_t *width, uint32_t *height) {
+  Layout l;
+  layout_compute(&l, state ? state->count : 0, 0, 0);
+
+  *width = l.grid_w + (l.pad * 2);
+  *height = l.grid_h + (l.pad * 2);
 
   if (*width < 200)
     *width = 200;
   if (*height < 150)
     *height = 150;
+
+  /* Cap to a fraction of the output; the grid scrolls inside (at least one
+   * full row stays visible) */
+  if (output_height > 0) {
+    int pct = cfg ? cfg->max_height_percent : 80;
+    if (pct <= 0 || pct > 100)
+      pct = 100;
+    uint32_t limit = output_height * pct / 100;
+    uint32_t min_h = l.card_h + (l.pad * 2);
+    if (limit < min_h)
+      limit = min_h;
+    if (*height > limit)
+      *height = limit;
+  }
 }
 
-void render_ui(AppState *state, uint32_t width, uint32_t height) {
-  int stride = cairo_format_stride_for_width(CAIRO_FORMAT_ARGB32, width);
-  int size = stride * height;
+/* Number of fully visible grid rows for a panel of this height */
+static int visible_rows(AppState *state, uint32_t height) {
+  return current_layout(state, state->width, height)->visible_rows;
+}
+
+/* Scroll so the selected row is fully visible; returns true if it moved */
+static bool scroll_to_selection(AppState *state, uint32_t height) {
+  const Layout *l = current_layout(state, state->width, height);
+  int total = l->rows;
+  int vis = l->visible_rows;
+  int row = state->selected_index / l->max_cols;
+  int old = state->scroll_row;
+
+  if (row < state->scroll_row)
+    state->scroll_row = row;
+  else if (row >= state->scroll_row + vis)
+    state->scroll_row = row - vis + 1;
+
+  if (state->scroll_row > total - vis)
+    state->scroll_row = total - vis;
+  if (state->scroll_row < 0)
+    state->scroll_row = 0;
+
+  /* The pointer stays put: the card under it is as many rows further */
+  if (state->scroll_row != old && state->hover_index >= 0) {
+    int hover = state->hover_index + (state->scroll_row - old) * l->max_cols;
+    state->hover_index = hover >= 0 && hover < state->count ? hover : -1;
+  }
+  return state->scroll_row != old;
+}
+
+/* Top-left corner of card `index` in the grid (pixel aligned) */
+static void card_origin(AppState *state, int index, uint32_t width,
+                        uint32_t height, int *x, int *y) {
+  layout_card_origin(current_layout(state, width, height), index,
+                     state->scroll_row, x, y);
+}
+
+/* --- Selection Highlight Subsurface --- */
+
+static bool highlight_available(void) {
+  return highlight_surface && highlight_subsurface;
+}
+
+/* Rasterize the highlight once per config: selected tint + accent border,
+ * sized to a card plus room for the stroke */
+static void build_highlight(void) {
+  if (highlight_buffer) {
+    wl_buffer_destroy(highlight_buffer);
+    highlight_buffer = NULL;
+  }
+  highlight_mapped = false;
+
+  int w = cfg ? cfg->card_width : 200;
+  int h = cfg ? cfg->card_height : 160;
+  int r = cfg ? cfg->card_radius : 12;
+  int bw = cfg ? cfg->border_width : 2;
+
+  highlight_margin = bw / 2 + 2;
+  highlight_w = w + 2 * highlight_margin;
+  highlight_h = h + 2 * highlight_margin;
+  int hw = px(highlight_w);
+  int hh = px(highlight_h);
+
+  int stride = cairo_format_stride_for_width(CAIRO_FORMAT_ARGB32, hw);
+  int size = stride * hh;
   int fd = create_shm_file(size);
   if (fd < 0)
     return;
@@ -281,14 +1049,467 @@ void render_ui(AppState *state, uint32_t width, uint32_t height) {
     close(fd);
     return;
   }
-
-  /* CRITICAL FIX 1: Zero buffer */
   memset(data, 0, size);
 
   cairo_surface_t *surf = cairo_image_surface_create_for_data(
-      data, CAIRO_FORMAT_ARGB32, width, height, stride);
+      data, CAIRO_FORMAT_ARGB32, hw, hh, stride);
   cairo_t *cr = cairo_create(surf);
   cairo_set_antialias(cr, CAIRO_ANTIALIAS_BEST);
+  cairo_scale(cr, scale, scale);
+
+  double sel_r = 0.3, sel_g = 0.3, sel_b = 0.4;
+  double brd_r = 0.5, brd_g = 0.7, brd_b = 1.0;
+  if (cfg) {
+    color_to_rgb(cfg->card_selected, &sel_r, &sel_g, &sel_b);
+    color_to_rgb(cfg->border_color, &brd_r, &brd_g, &brd_b);
+  }
+
+  cairo_set_source_rgba(cr, sel_r, sel_g, sel_b, HIGHLIGHT_TINT_ALPHA);
+  draw_rounded_rect(cr, highlight_margin, highlight_margin, w, h, r);
+  cairo_fill(cr);
+
+  cairo_set_source_rgb(cr, brd_r, brd_g, brd_b);
+  cairo_set_line_width(cr, bw);
+  draw_rounded_rect(cr, highlight_margin, highlight_margin, w, h, r);
+  cairo_stroke(cr);
+
+  cairo_destroy(cr);
+  cairo_surface_destroy(surf);
+
+  struct wl_shm_pool *pool = wl_shm_create_pool(shm, fd, size);
+  highlight_buffer = wl_shm_pool_create_buffer(pool, 0, hw, hh, stride,
+                                               WL_SHM_FORMAT_ARGB8888);
+  wl_shm_pool_destroy(pool);
+  close(fd);
+  munmap(data, size);
+
+  highlight_dirty = false;
+}
+
+/* Map a device-pixel buffer onto `width` x `height` surface units: a
+ * viewport for fractional scales, buffer_scale when there is none (the
+ * scale is then integral, see main.c) */
+static void set_surface_scale(struct wl_surface *surf,
+                              struct wp_viewport *viewport, uint32_t width,
+                              uint32_t height) {
+  if (viewport)
+    wp_viewport_set_destination(viewport, width, height);
+  else
+    wl_surface_set_buffer_scale(surf, scale120 / 120 > 0 ? scale120 / 120 : 1);
+}
+
+/* Stage highlight position/visibility; applied on the next parent commit */
+static void update_highlight(AppState *state, uint32_t width,
+                             uint32_t height) {
+  if (!state || state->count == 0 || state->selected_index < 0 ||
+      state->selected_index >= state->count) {
+    if (highlight_mapped) {
+      wl_surface_attach(highlight_surface, NULL, 0, 0);
+      wl_surface_commit(highlight_surface);
+      highlight_mapped = false;
+    }
+    return;
+  }
+
+  if (highlight_dirty || !highlight_buffer)
+    build_highlight();
+  if (!highlight_buffer)
+    return;
+
+  if (!highlight_mapped) {
+    wl_surface_attach(highlight_surface, highlight_buffer, 0, 0);
+    set_surface_scale(highlight_surface, highlight_viewport, highlight_w,
+                      highlight_h);
+    wl_surface_damage_buffer(highlight_surface, 0, 0, INT32_MAX, INT32_MAX);
+    wl_surface_commit(highlight_surface);
+    highlight_mapped = true;
+  }
+
+  int x, y;
+  card_origin(state, state->selected_index, width, height, &x, &y);
+  wl_subsurface_set_position(highlight_subsurface, x - highlight_margin,
+                             y - highlight_margin);
+}
+
+void render_cleanup(void) {
+  tile_pool_stop();
+  free_all_assets();
+  pool_destroy_all();
+  render_reset_highlight();
+}
+
+void render_reset_highlight(void) {
+  if (highlight_buffer) {
+    wl_buffer_destroy(highlight_buffer);
+    highlight_buffer = NULL;
+  }
+  highlight_mapped = false;
+}
+
+/* Card indices rasterized for the current scroll position */
+static void visible_range(AppState *state, uint32_t height, int *first,
+                          int *last) {
+  int max_cols = cfg ? cfg->max_cols : 5;
+  int vis = visible_rows(state, height);
+  *first = state->scroll_row * max_cols;
+  *last = (state->scroll_row + vis + 1) * max_cols;
+  if (*last > state->count)
+    *last = state->count;
+}
+
+/* Add a logical rect to a device-pixel region */
+static void region_add_rect(pixman_region32_t *region, double x, double y,
+                            double w, double h) {
+  int x0 = px(x), y0 = px(y);
+  pixman_region32_union_rect(region, region, x0, y0, px(x + w) - x0,
+                             px(y + h) - y0);
+}
+
+/* Clip cairo (whose CTM is scaled to logical units) to a device region */
+static void clip_to_region(cairo_t *cr, pixman_region32_t *region) {
+  int nboxes;
+  pixman_box32_t *boxes = pixman_region32_rectangles(region, &nboxes);
+  cairo_matrix_t m;
+  cairo_get_matrix(cr, &m);
+  cairo_identity_matrix(cr);
+  for (int i = 0; i < nboxes; i++)
+    cairo_rectangle(cr, boxes[i].x1, boxes[i].y1, boxes[i].x2 - boxes[i].x1,
+                    boxes[i].y2 - boxes[i].y1);
+  cairo_clip(cr);
+  cairo_set_matrix(cr, &m);
+}
+
+/* Grid viewport: the panel minus half the padding at top and bottom */
+static void grid_clip(pixman_region32_t *region, uint32_t width,
+                      uint32_t height) {
+  int pad = cfg ? cfg->padding : 32;
+  pixman_region32_init(region);
+  region_add_rect(region, 0, pad / 2, width, height - pad);
+}
+
+/* Draw cards [first, last) restricted to `clip` (pixman fills ignore the
+ * cairo clip, so both are set) */
+static void draw_grid(Canvas *cv, AppState *state, uint32_t width,
+                      uint32_t height, bool inline_selection, int first,
+                      int last, pixman_region32_t *clip) {
+  cairo_save(cv->cr);
+  clip_to_region(cv->cr, clip);
+  pixman_image_set_clip_region32(cv->img, clip);
+
+  for (int i = first; i < last; i++) {
+    int x, y;
+    card_origin(state, i, width, height, &x, &y);
+    draw_card(cv, state, &state->windows[i], x, y,
+              inline_selection && i == state->selected_index,
+              i == state->hover_index);
+  }
+
+  pixman_image_set_clip_region32(cv->img, NULL);
+  cairo_restore(cv->cr);
+}
+
+/* --- Parallel Row Tiles --- */
+
+/* Resolve what card i will read from shared caches (icon or thumbnail,
+ * letter atlas cell) so tiles only ever look them up */
+static void warm_card(WindowInfo *win) {
+  if (cfg && cfg->show_thumbnails && thumbnails_get(win->address))
+    return;
+
+  int size = px(cfg ? cfg->icon_size : 64);
+  cairo_surface_t *icon =
+      card_icon(win, size, quality == QUALITY_FAST);
+  if (icon) {
+    cairo_surface_flush(icon);
+    cairo_surface_destroy(icon);
+    return;
+  }
+  if (!cfg || cfg->show_letter_fallback) {
+    int color, sx, sy;
+    unsigned char letter;
+    letter_of(win->class_name, &letter, &color);
+    atlas_cell(assets, letter, color, false, &sx, &sy);
+  }
+}
+
+typedef struct {
+  AppState *state;
+  unsigned char *data;
+  int stride;
+  uint32_t pw;
+  uint32_t width, height;
+  bool inline_selection;
+  int first, last;
+  pixman_region32_t *clip;
+  int ntiles;
+  int band[MAX_TILE_THREADS + 2]; /* Tile t covers device rows [t, t+1) */
+} TileJob;
+
+static struct {
+  pthread_mutex_t lock;
+  pthread_cond_t wake, done;
+  pthread_t threads[MAX_TILE_THREADS];
+  int nthreads;
+  bool quit;
+  unsigned seq; /* Bumped per job so workers see new work */
+  TileJob *job;
+  int next_tile;
+  int tiles_left;
+} tiles = {.lock = PTHREAD_MUTEX_INITIALIZER,
+           .wake = PTHREAD_COND_INITIALIZER,
+           .done = PTHREAD_COND_INITIALIZER};
+
+/* Rasterize one band: its own cairo context and pixman view onto its rows
+ * of the shared buffer, drawing every card that reaches into it */
+static void render_tile(TileJob *job, int t) {
+  int y0 = job->band[t], y1 = job->band[t + 1];
+  if (y1 <= y0)
+    return;
+  unsigned char *rows = job->data + (size_t)y0 * job->stride;
+
+  cairo_surface_t *surf = cairo_image_surface_create_for_data(
+      rows, CAIRO_FORMAT_ARGB32, job->pw, y1 - y0, job->stride);
+  cairo_t *cr = cairo_create(surf);
+  apply_quality(cr);
+  cairo_translate(cr, 0, -y0);
+  cairo_scale(cr, scale, scale);
+
+  Canvas cv = {.cr = cr, .ox = 0, .oy = y0};
+  cv.img = pixman_image_create_bits(PIXMAN_a8r8g8b8, job->pw, y1 - y0,
+                                    (uint32_t *)rows, job->stride);
+  /* Private views: pixman images carry mutable state, the bits don't */
+  pixman_image_t *shared[3] = {assets->card_mask, assets->icon_mask,
+                               assets->atlas_img};
+  pixman_image_t **views[3] = {&cv.card_mask, &cv.icon_mask, &cv.atlas};
+  for (int i = 0; i < 3; i++) {
+    if (shared[i])
+      *views[i] = pixman_image_create_bits(
+          pixman_image_get_format(shared[i]), pixman_image_get_width(shared[i]),
+          pixman_image_get_height(shared[i]), pixman_image_get_data(shared[i]),
+          pixman_image_get_stride(shared[i]));
+  }
+
+  pixman_region32_t clip;
+  pixman_region32_init_rect(&clip, 0, y0, job->pw, y1 - y0);
+  pixman_region32_intersect(&clip, &clip, job->clip);
+  pixman_region32_translate(&clip, 0, -y0);
+
+  /* Cards whose extent (stack shadow, border) overlaps the band */
+  const Layout *l = current_layout(job->state, job->width, job->height);
+  int reach = 6 + (cfg ? cfg->border_width : 2);
+  int first = -1, last = -1;
+  for (int i = job->first; i < job->last; i += l->max_cols) {
+    int x, y;
+    layout_card_origin(l, i, job->state->scroll_row, &x, &y);
+    if (px(y + l->card_h + reach) <= y0 || px(y - reach) >= y1)
+      continue;
+    if (first < 0)
+      first = i;
+    last = i + l->max_cols;
+  }
+  if (last > job->last)
+    last = job->last;
+  if (first >= 0)
+    draw_grid(&cv, job->state, job->width, job->height,
+              job->inline_selection, first, last, &clip);
+
+  pixman_region32_fini(&clip);
+  for (int i = 0; i < 3; i++) {
+    if (*views[i])
+      pixman_image_unref(*views[i]);
+  }
+  pixman_image_unref(cv.img);
+  cairo_destroy(cr);
+  cairo_surface_flush(surf);
+  cairo_surface_destroy(surf);
+}
+
+/* Take tiles until none are left (workers and the calling thread alike) */
+static void run_tiles(TileJob *job) {
+  pthread_mutex_lock(&tiles.lock);
+  while (tiles.job == job && tiles.next_tile < job->ntiles) {
+    int t = tiles.next_tile++;
+    pthread_mutex_unlock(&tiles.lock);
+    render_tile(job, t);
+    pthread_mutex_lock(&tiles.lock);
+    if (--tiles.tiles_left == 0)
+      pthread_cond_signal(&tiles.done);
+  }
+  pthread_mutex_unlock(&tiles.lock);
+}
+
+static void *tile_worker(void *arg) {
+  (void)arg;
+  unsigned seen = 0;
+  pthread_mutex_lock(&tiles.lock);
+  while (!tiles.quit) {
+    if (tiles.seq == seen || !tiles.job) {
+      pthread_cond_wait(&tiles.wake, &tiles.lock);
+      continue;
+    }
+    seen = tiles.seq;
+    TileJob *job = tiles.job;
+    pthread_mutex_unlock(&tiles.lock);
+    run_tiles(job);
+    pthread_mutex_lock(&tiles.lock);
+  }
+  pthread_mutex_unlock(&tiles.lock);
+  return NULL;
+}
+
+/* Helper threads, started on first use (0 = parallel tiles unavailable) */
+static int tile_pool_size(void) {
+  if (tiles.nthreads > 0 || tile_threads == 0)
+    return tiles.nthreads;
+
+  int want = tile_threads;
+  if (want < 0) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    want = cpus > 1 ? (int)cpus - 1 : 0;
+  }
+  if (want > MAX_TILE_THREADS)
+    want = MAX_TILE_THREADS;
+
+  tiles.quit = false;
+  for (int i = 0; i < want; i++) {
+    if (pthread_create(&tiles.threads[i], NULL, tile_worker, NULL) != 0)
+      break;
+    tiles.nthreads++;
+  }
+  if (tiles.nthreads == 0)
+    tile_threads = 0; /* Don't retry every frame */
+  else
+    LOG("Tile rasterization on %d threads", tiles.nthreads + 1);
+  return tiles.nthreads;
+}
+
+static void tile_pool_stop(void) {
+  pthread_mutex_lock(&tiles.lock);
+  tiles.quit = true;
+  pthread_cond_broadcast(&tiles.wake);
+  pthread_mutex_unlock(&tiles.lock);
+  for (int i = 0; i < tiles.nthreads; i++)
+    pthread_join(tiles.threads[i], NULL);
+  tiles.nthreads = 0;
+}
+
+/* draw_grid() for a full frame, split into row bands across the pool when
+ * the grid is large enough to pay for it */
+static void draw_grid_tiled(Canvas *cv, AppState *state, unsigned char *data,
+                            int stride, uint32_t pw, uint32_t ph,
+                            uint32_t width, uint32_t height,
+                            bool inline_selection, int first, int last,
+                            pixman_region32_t *clip) {
+  const Layout *l = current_layout(state, width, height);
+  int rows = (last - first + l->max_cols - 1) / l->max_cols;
+  int helpers = last - first >= PARALLEL_MIN_CARDS ? tile_pool_size() : 0;
+  if (helpers == 0 || rows < 2) {
+    draw_grid(cv, state, width, height, inline_selection, first, last, clip);
+    return;
+  }
+
+  for (int i = first; i < last; i++)
+    warm_card(&state->windows[i]);
+
+  /* Band edges sit on row tops, rows spread evenly over the tiles */
+  TileJob job = {.state = state,
+                 .data = data,
+                 .stride = stride,
+                 .pw = pw,
+                 .width = width,
+                 .height = height,
+                 .inline_selection = inline_selection,
+                 .first = first,
+                 .last = last,
+                 .clip = clip};
+  job.ntiles = rows < helpers + 1 ? rows : helpers + 1;
+  job.band[0] = 0;
+  for (int t = 1; t < job.ntiles; t++) {
+    int x, y;
+    layout_card_origin(l, first + (rows * t / job.ntiles) * l->max_cols,
+                       state->scroll_row, &x, &y);
+    /* A partly visible row can start below the panel (card_gap >
+     * padding): keep the bands ordered and inside the buffer */
+    int top = px(y);
+    job.band[t] = top < job.band[t - 1] ? job.band[t - 1]
+                  : top > (int)ph      ? (int)ph
+                                       : top;
+  }
+  job.band[job.ntiles] = ph;
+
+  cairo_surface_flush(cairo_get_target(cv->cr));
+  parallel_pass = true;
+  pthread_mutex_lock(&tiles.lock);
+  tiles.job = &job;
+  tiles.next_tile = 0;
+  tiles.tiles_left = job.ntiles;
+  tiles.seq++;
+  pthread_cond_broadcast(&tiles.wake);
+  pthread_mutex_unlock(&tiles.lock);
+
+  run_tiles(&job);
+
+  pthread_mutex_lock(&tiles.lock);
+  while (tiles.tiles_left > 0)
+    pthread_cond_wait(&tiles.done, &tiles.lock);
+  tiles.job = NULL;
+  pthread_mutex_unlock(&tiles.lock);
+  parallel_pass = false;
+  cairo_surface_mark_dirty(cairo_get_target(cv->cr));
+}
+
+void render_set_threads(int threads) {
+  tile_pool_stop();
+  tile_threads = threads > MAX_TILE_THREADS ? MAX_TILE_THREADS : threads;
+}
+
+/* Scroll indicator strip at the right edge, when not all rows fit */
+static void scroll_indicator_region(pixman_region32_t *region, uint32_t width,
+                                    uint32_t height) {
+  int pad = cfg ? cfg->padding : 32;
+  region_add_rect(region, (int)width - pad / 2 - 3, pad - 1, 6,
+                  (int)height - pad * 2 + 2);
+}
+
+static void draw_scroll_indicator(cairo_t *cr, AppState *state,
+                                  uint32_t width, uint32_t height) {
+  int max_cols = cfg ? cfg->max_cols : 5;
+  int pad = cfg ? cfg->padding : 32;
+  int total_rows = (state->count + max_cols - 1) / max_cols;
+  int vis = visible_rows(state, height);
+  if (total_rows <= vis)
+    return;
+
+  double r = 0.1, g = 0.1, b = 0.2;
+  double track_h = height - pad * 2;
+  double thumb_h = track_h * vis / total_rows;
+  double thumb_y = pad + track_h * state->scroll_row / total_rows;
+  if (cfg)
+    color_to_rgb(cfg->border_color, &r, &g, &b);
+  cairo_set_source_rgba(cr, r, g, b, 0.6);
+  draw_rounded_rect(cr, width - pad / 2.0 - 2, thumb_y, 4, thumb_h, 2);
+  cairo_fill(cr);
+}
+
+void render_snapshot(AppState *state, unsigned char *data, uint32_t width,
+                     uint32_t height, int stride, bool inline_selection) {
+  double t0 = now_ms();
+  uint32_t pw, ph;
+  render_buffer_size(width, height, &pw, &ph);
+
+  /* CRITICAL FIX 1: Zero buffer */
+  memset(data, 0, (size_t)stride * ph);
+
+  cairo_surface_t *surf = cairo_image_surface_create_for_data(
+      data, CAIRO_FORMAT_ARGB32, pw, ph, stride);
+  cairo_t *cr = cairo_create(surf);
+  apply_quality(cr);
+  cairo_scale(cr, scale, scale);
+
+  ensure_masks();
+  Canvas cv = {.cr = cr, .ox = 0, .oy = 0};
+  cv.img = pixman_image_create_bits(PIXMAN_a8r8g8b8, pw, ph,
+                                    (uint32_t *)data, stride);
 
   /* CRITICAL FIX 2: Source Clear */
   cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
@@ -333,48 +1554,473 @@ void render_ui(AppState *state, uint32_t width, uint32_t height) {
     pango_cairo_show_layout(cr, msg);
     g_object_unref(msg);
   } else {
-    int cw = cfg ? cfg->card_width : 200;
-    int ch = cfg ? cfg->card_height : 160;
-    int gap = cfg ? cfg->card_gap : 12;
-    int pad = cfg ? cfg->padding : 32;
-    int max_cols = cfg ? cfg->max_cols : 5;
-
-    int cols = (state->count < max_cols) ? state->count : max_cols;
-    int rows = (state->count + max_cols - 1) / max_cols;
-
-    int grid_w = (cols * cw) + ((cols - 1) * gap);
-    int grid_h = (rows * ch) + ((rows - 1) * gap);
-
-    double start_x = (width - grid_w) / 2.0;
-    double start_y = (height - grid_h) / 2.0;
-    if (start_x < pad)
-      start_x = pad;
-    if (start_y < pad)
-      start_y = pad;
-
-    for (int i = 0; i < state->count; i++) {
-      int r = i / max_cols;
-      int c = i % max_cols;
-      double x = start_x + c * (cw + gap);
-      double y = start_y + r * (ch + gap);
-      draw_card(cr, &state->windows[i], x, y, i == state->selected_index);
-    }
+    /* Virtualized grid: only the visible rows plus one prefetch row (partly
+     * shown at the bottom edge) are rasterized */
+    scroll_to_selection(state, height);
+    int first, last;
+    visible_range(state, height, &first, &last);
+
+    pixman_region32_t clip;
+    grid_clip(&clip, width, height);
+    draw_grid_tiled(&cv, state, data, stride, pw, ph, width, height,
+                    inline_selection, first, last, &clip);
+    pixman_region32_fini(&clip);
+
+    draw_scroll_indicator(cr, state, width, height);
+  }
+
+  pixman_image_unref(cv.img);
+  cairo_destroy(cr);
+  cairo_surface_flush(surf);
+  cairo_surface_destroy(surf);
+
+  /* Smoothed, so one slow frame (icon loads) doesn't flip the tier */
+  double ms = now_ms() - t0;
+  double *avg = &frame_ms[quality];
+  *avg = *avg > 0 ? *avg * 0.75 + ms * 0.25 : ms;
+}
+
+/* --- Buffer Pool & Speculative Frames --- */
+
+static bool frame_key_equal(const FrameKey *a, const FrameKey *b) {
+  return a->generation == b->generation && a->width == b->width &&
+         a->height == b->height && a->scale120 == b->scale120 &&
+         a->scroll_row == b->scroll_row &&
+         a->selected == b->selected && a->hovered == b->hovered;
+}
+
+/* `have` can be shown where `want` was asked for */
+static bool frame_key_satisfies(const FrameKey *have, const FrameKey *want) {
+  return frame_key_equal(have, want) && have->quality >= want->quality;
+}
+
+/* Identity of the pixels render_snapshot() would produce for this state */
+static void frame_key(AppState *state, uint32_t width, uint32_t height,
+                      FrameKey *key) {
+  key->generation = frame_generation;
+  key->width = width;
+  key->height = height;
+  key->scale120 = scale120;
+  key->scroll_row = state ? state->scroll_row : 0;
+  key->selected =
+      (state && !highlight_available()) ? state->selected_index : -1;
+  key->hovered = state ? state->hover_index : -1;
+  key->quality = quality;
+}
+
+static void stamp_buffer(PoolBuffer *b, AppState *state, const FrameKey *key) {
+  b->key = *key;
+  b->valid = true;
+  b->grid_x = b->grid_y = -1;
+  if (state && state->count > 0)
+    card_origin(state, 0, b->width, b->height, &b->grid_x, &b->grid_y);
+}
+
+static void pool_buffer_free(PoolBuffer *b) {
+  if (b->buffer)
+    wl_buffer_destroy(b->buffer);
+  if (b->data)
+    munmap(b->data, b->size);
+  memset(b, 0, sizeof(*b));
+}
+
+static void buffer_release(void *data, struct wl_buffer *buffer) {
+  (void)buffer;
+  PoolBuffer *b = data;
+  b->busy = false;
+  if (b->stale)
+    pool_buffer_free(b);
+}
+
+static const struct wl_buffer_listener buffer_listener = {
+    .release = buffer_release,
+};
+
+static bool pool_buffer_alloc(PoolBuffer *b, uint32_t width, uint32_t height) {
+  uint32_t pw, ph;
+  render_buffer_size(width, height, &pw, &ph);
+  int stride = cairo_format_stride_for_width(CAIRO_FORMAT_ARGB32, pw);
+  int size = stride * ph;
+  int fd = create_shm_file(size);
+  if (fd < 0)
+    return false;
+
+  void *data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (data == MAP_FAILED) {
+    close(fd);
+    return false;
   }
 
-  /* Wayland Commit */
   struct wl_shm_pool *pool = wl_shm_create_pool(shm, fd, size);
-  struct wl_buffer *buffer = wl_shm_pool_create_buffer(
-      pool, 0, width, height, stride, WL_SHM_FORMAT_ARGB8888);
+  b->buffer = wl_shm_pool_create_buffer(pool, 0, pw, ph, stride,
+                                        WL_SHM_FORMAT_ARGB8888);
+  wl_shm_pool_destroy(pool);
+  close(fd);
 
-  wl_surface_attach(surface, buffer, 0, 0);
-  wl_surface_damage_buffer(surface, 0, 0, width,
-                           height); /* Use damage_buffer for best safety */
+  b->data = data;
+  b->size = size;
+  b->stride = stride;
+  b->width = width;
+  b->height = height;
+  b->px_w = pw;
+  b->px_h = ph;
+  b->scale120 = scale120;
+  b->busy = false;
+  b->stale = false;
+  b->valid = false;
+  wl_buffer_add_listener(b->buffer, &buffer_listener, b);
+  return true;
+}
+
+static void pool_destroy_all(void) {
+  for (int i = 0; i < POOL_SIZE; i++) {
+    if (!buffer_pool[i].buffer)
+      continue;
+    if (buffer_pool[i].busy) {
+      /* Still held by the compositor: free once released */
+      buffer_pool[i].stale = true;
+      buffer_pool[i].valid = false;
+    } else {
+      pool_buffer_free(&buffer_pool[i]);
+    }
+  }
+  front_buffer = NULL;
+}
+
+/* A buffer already holding the frame `key` (may be the front buffer) */
+static PoolBuffer *find_prepared(const FrameKey *key) {
+  for (int i = 0; i < POOL_SIZE; i++) {
+    PoolBuffer *b = &buffer_pool[i];
+    if (b->buffer && b->valid && !b->stale && frame_key_satisfies(&b->key, key))
+      return b;
+  }
+  return NULL;
+}
+
+/* Allocated for this logical size at the current scale */
+static bool buffer_fits(const PoolBuffer *b, uint32_t width, uint32_t height) {
+  return b->width == width && b->height == height && b->scale120 == scale120;
+}
+
+static bool key_protected(const PoolBuffer *b, const FrameKey *keep,
+                          int nkeep) {
+  for (int i = 0; i < nkeep; i++) {
+    if (b->valid && frame_key_equal(&b->key, &keep[i]))
+      return true;
+  }
+  return false;
+}
+
+/* Get a writable buffer of the given size, never reusing one the compositor
+ * holds or one that carries a frame listed in `keep` */
+static PoolBuffer *acquire_buffer(uint32_t width, uint32_t height,
+                                  const FrameKey *keep, int nkeep) {
+  PoolBuffer *pick = NULL;
+  for (int i = 0; i < POOL_SIZE; i++) {
+    PoolBuffer *b = &buffer_pool[i];
+    if (!b->buffer) {
+      if (!pick)
+        pick = b;
+      continue;
+    }
+    if (b->busy || b->stale || key_protected(b, keep, nkeep))
+      continue;
+    /* Prefer recycling an allocated buffer of the right size */
+    if (!pick || !pick->buffer || buffer_fits(b, width, height)) {
+      pick = b;
+      if (buffer_fits(b, width, height) && !b->valid)
+        break;
+    }
+  }
+  if (!pick)
+    return NULL;
+
+  if (pick->buffer && !buffer_fits(pick, width, height))
+    pool_buffer_free(pick);
+  if (!pick->buffer && !pool_buffer_alloc(pick, width, height))
+    return NULL;
+
+  pick->valid = false;
+  return pick;
+}
+
+/* Attach and commit; `damage` limits the damaged area (NULL: whole buffer) */
+static void present_buffer(PoolBuffer *b, AppState *state,
+                           pixman_region32_t *damage) {
+  /* Sync-mode subsurface: its state lands together with the parent commit */
+  if (highlight_available())
+    update_highlight(state, b->width, b->height);
+
+  wl_surface_attach(surface, b->buffer, 0, 0);
+  set_surface_scale(surface, panel_viewport, b->width, b->height);
+  if (damage) {
+    int nboxes;
+    pixman_box32_t *boxes = pixman_region32_rectangles(damage, &nboxes);
+    for (int i = 0; i < nboxes; i++)
+      wl_surface_damage_buffer(surface, boxes[i].x1, boxes[i].y1,
+                               boxes[i].x2 - boxes[i].x1,
+                               boxes[i].y2 - boxes[i].y1);
+  } else {
+    wl_surface_damage_buffer(surface, 0, 0, b->px_w,
+                             b->px_h); /* Use damage_buffer for best safety */
+  }
+  wl_surface_commit(surface);
+  b->busy = true;
+  front_buffer = b;
+
+  refine_pending = b->key.quality == QUALITY_FAST;
+  if (refine_pending)
+    fast_frames++;
+}
+
+/* Wayland presenter: reuse a prepared frame or rasterize into a pool buffer */
+void render_ui(AppState *state, uint32_t width, uint32_t height) {
+  choose_quality();
+  if (state && state->count > 0)
+    scroll_to_selection(state, height);
+
+  FrameKey key;
+  frame_key(state, width, height, &key);
+
+  PoolBuffer *b = find_prepared(&key);
+  if (!b) {
+    b = acquire_buffer(width, height, NULL, 0);
+    if (!b)
+      return;
+    render_snapshot(state, b->data, width, height, b->stride,
+                    !highlight_available());
+    stamp_buffer(b, state, &key);
+  }
+
+  present_buffer(b, state, NULL);
+}
+
+void render_selection(AppState *state) {
+  last_input_ms = now_ms();
+  choose_quality();
+
+  /* Leaving the viewport changes the grid content itself */
+  if (!highlight_available() || scroll_to_selection(state, state->height)) {
+    FrameKey key;
+    frame_key(state, state->width, state->height, &key);
+    if (find_prepared(&key))
+      spec_hits++;
+    else
+      spec_misses++;
+    render_ui(state, state->width, state->height);
+    return;
+  }
+
+  update_highlight(state, state->width, state->height);
   wl_surface_commit(surface);
+}
+
+/* Copy the front frame into a fresh buffer and repaint only the card slots
+ * in `ranges` (clipped to the viewport), damaging just those. Falls back
+ * to a full frame when no reusable front frame exists or the grid moved. */
+static void repaint_slots(AppState *state, const int (*ranges)[2], int n,
+                          bool indicator) {
+  PoolBuffer *front = front_buffer;
+  if (!state || state->count == 0 || !front || !front->buffer ||
+      !front->valid || !buffer_fits(front, state->width, state->height) ||
+      scroll_to_selection(state, state->height) ||
+      front->key.scroll_row != state->scroll_row) {
+    render_ui(state, state->width, state->height);
+    return;
+  }
 
+  /* Grid re-centred (column/row count changed): everything moved */
+  const Layout *l = current_layout(state, state->width, state->height);
+  int gx, gy;
+  layout_card_origin(l, 0, state->scroll_row, &gx, &gy);
+  if (gx != front->grid_x || gy != front->grid_y) {
+    render_ui(state, state->width, state->height);
+    return;
+  }
+
+  /* Copy the front frame into another buffer. Only when none is free is
+   * the front one drawn over in place, once the compositor released it. */
+  PoolBuffer *b = acquire_buffer(state->width, state->height, &front->key, 1);
+  if (!b && !front->busy && !front->stale) {
+    b = front;
+    b->valid = false;
+  }
+  if (!b)
+    return;
+  if (b != front)
+    memcpy(b->data, front->data, (size_t)front->stride * front->px_h);
+  choose_quality();
+
+  /* Slots past count (a removed last card) are cleared, not drawn */
+  int vis_first, vis_last;
+  visible_range(state, state->height, &vis_first, &vis_last);
+  int slots_end = (state->scroll_row + l->visible_rows + 1) * l->max_cols;
+
+  pixman_region32_t damage, viewport;
+  pixman_region32_init(&damage);
+  for (int r = 0; r < n; r++) {
+    for (int i = ranges[r][0]; i < ranges[r][1]; i++) {
+      if (i < vis_first || i >= slots_end)
+        continue;
+      int x, y;
+      layout_card_origin(l, i, state->scroll_row, &x, &y);
+      region_add_rect(&damage, x - l->gap / 2, y - l->gap / 2,
+                      l->card_w + l->gap, l->card_h + l->gap);
+    }
+  }
+  grid_clip(&viewport, state->width, state->height);
+  pixman_region32_intersect(&damage, &damage, &viewport);
+  pixman_region32_fini(&viewport);
+
+  if (indicator)
+    scroll_indicator_region(&damage, state->width, state->height);
+
+  cairo_surface_t *surf = cairo_image_surface_create_for_data(
+      b->data, CAIRO_FORMAT_ARGB32, b->px_w, b->px_h, b->stride);
+  cairo_t *cr = cairo_create(surf);
+  apply_quality(cr);
+  cairo_scale(cr, scale, scale);
+  ensure_masks();
+  Canvas cv = {.cr = cr, .ox = 0, .oy = 0};
+  cv.img = pixman_image_create_bits(PIXMAN_a8r8g8b8, b->px_w, b->px_h,
+                                    (uint32_t *)b->data, b->stride);
+
+  /* Restore the panel background under the damaged area (uniform away from
+   * the rounded corners), then redraw what lies on it */
+  double r = 0.1, g = 0.1, bl = 0.2;
+  if (cfg)
+    color_to_rgb(cfg->background, &r, &g, &bl);
+  cairo_save(cr);
+  clip_to_region(cr, &damage);
+  cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
+  cairo_set_source_rgba(cr, r, g, bl, 0.95);
+  cairo_paint(cr);
+  cairo_restore(cr);
+
+  for (int i = 0; i < n; i++) {
+    int first = ranges[i][0] > vis_first ? ranges[i][0] : vis_first;
+    int last = ranges[i][1] < vis_last ? ranges[i][1] : vis_last;
+    if (first < last)
+      draw_grid(&cv, state, b->width, b->height, !highlight_available(), first,
+                last, &damage);
+  }
+  if (indicator)
+    draw_scroll_indicator(cr, state, b->width, b->height);
+
+  pixman_image_unref(cv.img);
   cairo_destroy(cr);
+  cairo_surface_flush(surf);
   cairo_surface_destroy(surf);
-  wl_buffer_destroy(buffer);
-  wl_shm_pool_destroy(pool);
-  close(fd);
-  munmap(data, size);
+
+  /* Unrepainted areas keep the front frame's quality */
+  FrameKey key;
+  frame_key(state, state->width, state->height, &key);
+  if (front->key.quality < key.quality)
+    key.quality = front->key.quality;
+  stamp_buffer(b, state, &key);
+  present_buffer(b, state, &damage);
+  pixman_region32_fini(&damage);
+}
+
+void render_cards(AppState *state, int first, int last) {
+  /* Window list changed: every prepared frame is outdated */
+  frame_generation++;
+
+  const int ranges[1][2] = {{first, last}};
+  repaint_slots(state, ranges, 1, true); /* Row count may have changed */
+}
+
+void render_card_ranges(AppState *state, const int (*ranges)[2], int n) {
+  frame_generation++; /* Prepared frames show the old content */
+  repaint_slots(state, ranges, n, false);
+}
+
+void render_hover(AppState *state, int previous) {
+  int ranges[2][2];
+  int n = 0;
+  if (previous >= 0) {
+    ranges[n][0] = previous;
+    ranges[n][1] = previous + 1;
+    n++;
+  }
+  if (state->hover_index >= 0 && state->hover_index != previous) {
+    ranges[n][0] = state->hover_index;
+    ranges[n][1] = state->hover_index + 1;
+    n++;
+  }
+  if (n > 0)
+    repaint_slots(state, (const int(*)[2])ranges, n, false);
+}
+
+bool render_speculate(AppState *state) {
+  if (!state || !shm || !surface)
+    return false;
+
+  /* Refinement first: the visible frame matters more than a guess */
+  if (refine_pending) {
+    if (render_refine_delay() > 0)
+      return false;
+    render_ui(state, state->width, state->height); /* Idle: best tier */
+    refined_frames++;
+    return true;
+  }
+
+  int depth = cfg ? cfg->prerender : 1;
+  if (state->count < 2 || depth <= 0)
+    return false;
+  choose_quality();
+
+  /* Predicted next (and previous) selection states */
+  FrameKey keys[2];
+  AppState predicted[2];
+  int n = 0;
+  const int dirs[2] = {1, -1};
+  for (int i = 0; i < depth && i < 2; i++) {
+    predicted[n] = *state;
+    predicted[n].selected_index =
+        (state->selected_index + dirs[i] + state->count) % state->count;
+    scroll_to_selection(&predicted[n], state->height);
+    frame_key(&predicted[n], state->width, state->height, &keys[n]);
+    n++;
+  }
+
+  for (int i = 0; i < n; i++) {
+    if (find_prepared(&keys[i]))
+      continue; /* Already there (or only a highlight move away) */
+
+    PoolBuffer *b = acquire_buffer(state->width, state->height, keys, n);
+    if (!b)
+      return false;
+    render_snapshot(&predicted[i], b->data, state->width, state->height,
+                    b->stride, !highlight_available());
+    stamp_buffer(b, &predicted[i], &keys[i]);
+    return true; /* One frame per idle slice; more may follow */
+  }
+  return false;
+}
+
+int render_refine_delay(void) {
+  if (!refine_pending)
+    return -1;
+  double left = last_input_ms + REFINE_IDLE_MS - now_ms();
+  return left > 0 ? (int)left + 1 : 0;
+}
+
+void render_prefetch_icon(const char *class_name, int scale120) {
+  int size = cfg ? cfg->icon_size : 64;
+  icons_prefetch(class_name, (int)lround(size * (scale120 / 120.0)));
+}
+
+void render_invalidate(void) {
+  frame_generation++;
+  refine_pending = false;
+}
+
+void render_log_stats(void) {
+  if (spec_hits || spec_misses)
+    LOG("Speculative frames: %u hits, %u misses", spec_hits, spec_misses);
+  if (fast_frames)
+    LOG("Fast-tier frames: %u (%u refined; best %.1f ms, fast %.1f ms)",
+        fast_frames, refined_frames, frame_ms[QUALITY_BEST],
+        frame_ms[QUALITY_FAST]);
 }
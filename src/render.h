@@ -12,15 +12,133 @@
 extern struct wl_shm *shm;
 extern struct wl_surface *surface;
 
+/* Selection highlight subsurface (NULL when wl_subcompositor is missing) */
+extern struct wl_surface *highlight_surface;
+extern struct wl_subsurface *highlight_subsurface;
+
+/* Viewports mapping device-pixel buffers to surface size (NULL without
+ * wp_viewporter) */
+struct wp_viewport;
+extern struct wp_viewport *panel_viewport;
+extern struct wp_viewport *highlight_viewport;
+
 /* Set config for rendering */
 void render_set_config(Config *config);
 
+/* Logical height of the panel's output, used to cap the panel height */
+void render_set_output_height(uint32_t height);
+
+/*
+ * Grid geometry of one snapshot. Card rects follow from these numbers, so
+ * rendering, damage and pointer hit tests share it without per-card
+ * storage.
+ */
+typedef struct {
+  int count;
+  uint32_t width, height; /* Panel size */
+  int card_w, card_h, gap, pad;
+  int max_cols;
+  int cols, rows;       /* Columns in use, total rows */
+  int grid_w, grid_h;   /* Unscrolled grid extent */
+  int start_x, start_y; /* Top-left of card 0 at scroll row 0 */
+  int visible_rows;     /* Fully visible rows */
+} Layout;
+
+/* Layout for the state's current card count and panel size (cached) */
+const Layout *render_layout(AppState *state);
+
+/* Top-left corner of card `index` with the grid scrolled by scroll_row */
+void layout_card_origin(const Layout *layout, int index, int scroll_row,
+                        int *x, int *y);
+
+/* Card under a surface-local point, or -1 (gaps, padding, past the end) */
+int layout_hit_test(const Layout *layout, int scroll_row, double x, double y);
+
+/*
+ * Output scale in 1/120 steps (as sent by wp_fractional_scale_v1; 120 =
+ * 1x). Frames are rasterized in device pixels; masks, letter atlas and
+ * icons are kept per scale, so switching back to a seen scale is free.
+ */
+void render_set_scale(int scale120);
+
+/* Buffer size in device pixels for a panel of width x height at the
+ * current scale */
+void render_buffer_size(uint32_t width, uint32_t height, uint32_t *px_w,
+                        uint32_t *px_h);
+
+/* Device-pixel box window previews are downscaled to */
+void render_thumbnail_size(int *w, int *h);
+
+/*
+ * Helper threads for parallel row-tile rasterization of large grids
+ * (-1 = CPU count - 1, the default; 0 = always single-threaded)
+ */
+void render_set_threads(int threads);
+
 /* Calculate optimal window dimensions based on window count */
 void calculate_dimensions(AppState *state, uint32_t *width, uint32_t *height);
 
+/*
+ * Rasterize a snapshot into a caller-provided ARGB32 buffer. Does not touch
+ * Wayland. width/height are logical; the buffer holds the device-pixel
+ * size given by render_buffer_size(). With inline_selection the selected
+ * card is drawn in place instead of relying on the highlight subsurface.
+ */
+void render_snapshot(AppState *state, unsigned char *data, uint32_t width,
+                     uint32_t height, int stride, bool inline_selection);
+
 /* Render the window switcher UI */
 void render_ui(AppState *state, uint32_t width, uint32_t height);
 
+/* Move the selection highlight without repainting the grid */
+void render_selection(AppState *state);
+
+/* Drop the highlight buffer (call before destroying highlight_surface) */
+void render_reset_highlight(void);
+
+/*
+ * Use idle time to pre-render the predicted next (and with prerender = 2,
+ * previous) selection frame into a spare buffer. Renders at most one frame
+ * per call; returns true if more speculative work is pending.
+ */
+bool render_speculate(AppState *state);
+
+/*
+ * Window list edited in place (live update) without a size change: copy
+ * the last frame and repaint only card slots [first, last) and the scroll
+ * indicator, damaging just those. Falls back to render_ui() when the
+ * grid moved or no reusable frame exists.
+ */
+void render_cards(AppState *state, int first, int last);
+
+/* Same for scattered cards whose content changed (e.g. an icon landed):
+ * only the slots in each [first, last) range, without the indicator */
+void render_card_ranges(AppState *state, const int (*ranges)[2], int n);
+
+/* Repaint only the cards leaving (previous) and entering hover */
+void render_hover(AppState *state, int previous);
+
+/*
+ * Frames over cfg->frame_budget are drawn at a fast tier while the
+ * selection keeps changing; render_speculate() replaces them with a
+ * best-quality frame once input pauses. Milliseconds until that
+ * refinement is due (0 = now), or -1 if none is pending.
+ */
+int render_refine_delay(void);
+
+/* Warm the icon cache for a class or app ID at the size cards draw it on
+ * an output of scale120 (background priority, daemon only) */
+void render_prefetch_icon(const char *class_name, int scale120);
+
+/* Mark all rasterized frames outdated (window list changed) */
+void render_invalidate(void);
+
+/* Log speculative frame hit/miss counters */
+void render_log_stats(void);
+
+/* Free cached render resources (masks, highlight buffer) */
+void render_cleanup(void);
+
 /* Create a shared memory file for Wayland buffers */
 int create_shm_file(off_t size);
 
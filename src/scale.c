@@ -0,0 +1,351 @@
+/* src/scale.c - Premultiplied ARGB32 Downscaler */
+#define _POSIX_C_SOURCE 200809L
+
+#include "scale.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__SSE2__) && defined(__GNUC__) &&                                  \
+    (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define HAVE_AVX2_KERNEL 1
+#endif
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+/*
+ * Fixed point: each axis' weights sum to 1 << WEIGHT_BITS. The vertical
+ * pass leaves 7 fraction bits per channel (max 255 << 7, so rows fit in
+ * int16 for the SSE2 multiply-add), the horizontal pass removes the rest.
+ */
+#define WEIGHT_BITS 12
+#define MID_SHIFT (WEIGHT_BITS - 7)
+#define OUT_SHIFT (WEIGHT_BITS + 7)
+
+/* Source pixels under each output pixel, with their coverage weights */
+typedef struct {
+  int *start;
+  int *count;
+  uint16_t *weight; /* [out * max_taps + k] */
+  int max_taps;
+} Taps;
+
+typedef struct {
+  void (*accum)(uint32_t *acc, const uint8_t *row, int n, uint32_t w);
+  void (*narrow)(int16_t *out, const uint32_t *acc, int n);
+  void (*horiz)(uint32_t *dst, const int16_t *mid, const Taps *t, int dw);
+} Kernels;
+
+/* Exact integer coverage: output i spans [i*n, (i+1)*n) and source j
+ * spans [j*m, (j+1)*m) in units of 1/(n*m) of the axis */
+static bool taps_init(Taps *t, int n, int m) {
+  t->max_taps = n / m + 2;
+  t->start = malloc(sizeof(int) * m);
+  t->count = malloc(sizeof(int) * m);
+  t->weight = calloc((size_t)m * t->max_taps, sizeof(uint16_t));
+  if (!t->start || !t->count || !t->weight)
+    return false;
+
+  for (int i = 0; i < m; i++) {
+    int64_t x0 = (int64_t)i * n, x1 = (int64_t)(i + 1) * n;
+    int first = (int)(x0 / m);
+    int last = (int)((x1 - 1) / m);
+    uint16_t *w = &t->weight[(size_t)i * t->max_taps];
+    int sum = 0, big = 0;
+    for (int j = first; j <= last; j++) {
+      int64_t lo = (int64_t)j * m > x0 ? (int64_t)j * m : x0;
+      int64_t hi = (int64_t)(j + 1) * m < x1 ? (int64_t)(j + 1) * m : x1;
+      int k = j - first;
+      w[k] = (uint16_t)(((hi - lo) << WEIGHT_BITS) / n);
+      sum += w[k];
+      if (w[k] > w[big])
+        big = k;
+    }
+    w[big] += (1 << WEIGHT_BITS) - sum; /* Rounding slack, so flat stays flat */
+    t->start[i] = first;
+    t->count[i] = last - first + 1;
+  }
+  return true;
+}
+
+static void taps_free(Taps *t) {
+  free(t->start);
+  free(t->count);
+  free(t->weight);
+}
+
+/* --- Scalar --- */
+
+static void accum_scalar(uint32_t *acc, const uint8_t *row, int n,
+                         uint32_t w) {
+  for (int i = 0; i < n; i++)
+    acc[i] += row[i] * w;
+}
+
+static void narrow_scalar(int16_t *out, const uint32_t *acc, int n) {
+  for (int i = 0; i < n; i++)
+    out[i] = (int16_t)((acc[i] + (1 << (MID_SHIFT - 1))) >> MID_SHIFT);
+}
+
+static void horiz_scalar(uint32_t *dst, const int16_t *mid, const Taps *t,
+                         int dw) {
+  for (int x = 0; x < dw; x++) {
+    const int16_t *p = mid + 4 * t->start[x];
+    const uint16_t *w = &t->weight[(size_t)x * t->max_taps];
+    uint32_t s[4] = {1u << (OUT_SHIFT - 1), 1u << (OUT_SHIFT - 1),
+                     1u << (OUT_SHIFT - 1), 1u << (OUT_SHIFT - 1)};
+    for (int k = 0; k < t->count[x]; k++, p += 4) {
+      for (int c = 0; c < 4; c++)
+        s[c] += (uint32_t)p[c] * w[k];
+    }
+    uint8_t *out = (uint8_t *)&dst[x];
+    for (int c = 0; c < 4; c++)
+      out[c] = (uint8_t)(s[c] >> OUT_SHIFT);
+  }
+}
+
+/* --- SSE2 --- */
+
+#if defined(__SSE2__)
+static void accum_sse2(uint32_t *acc, const uint8_t *row, int n,
+                       uint32_t w) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i wv = _mm_set1_epi16((short)w);
+  int i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(row + i));
+    __m128i halves[2] = {_mm_unpacklo_epi8(v, zero),
+                         _mm_unpackhi_epi8(v, zero)};
+    for (int h = 0; h < 2; h++) {
+      /* 16 x 16 -> 32 bit products from the low and high halves */
+      __m128i lo = _mm_mullo_epi16(halves[h], wv);
+      __m128i hi = _mm_mulhi_epu16(halves[h], wv);
+      __m128i *a = (__m128i *)(acc + i + 8 * h);
+      _mm_storeu_si128(a, _mm_add_epi32(_mm_loadu_si128(a),
+                                        _mm_unpacklo_epi16(lo, hi)));
+      _mm_storeu_si128(a + 1, _mm_add_epi32(_mm_loadu_si128(a + 1),
+                                            _mm_unpackhi_epi16(lo, hi)));
+    }
+  }
+  accum_scalar(acc + i, row + i, n - i, w);
+}
+
+static void narrow_sse2(int16_t *out, const uint32_t *acc, int n) {
+  const __m128i round = _mm_set1_epi32(1 << (MID_SHIFT - 1));
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m128i a = _mm_loadu_si128((const __m128i *)(acc + i));
+    __m128i b = _mm_loadu_si128((const __m128i *)(acc + i + 4));
+    a = _mm_srli_epi32(_mm_add_epi32(a, round), MID_SHIFT);
+    b = _mm_srli_epi32(_mm_add_epi32(b, round), MID_SHIFT);
+    _mm_storeu_si128((__m128i *)(out + i), _mm_packs_epi32(a, b));
+  }
+  narrow_scalar(out + i, acc + i, n - i);
+}
+
+static void horiz_sse2(uint32_t *dst, const int16_t *mid, const Taps *t,
+                       int dw) {
+  const __m128i zero = _mm_setzero_si128();
+  for (int x = 0; x < dw; x++) {
+    const int16_t *p = mid + 4 * t->start[x];
+    const uint16_t *w = &t->weight[(size_t)x * t->max_taps];
+    __m128i sum = _mm_set1_epi32(1 << (OUT_SHIFT - 1));
+    for (int k = 0; k < t->count[x]; k++, p += 4) {
+      /* (channel, 0) x (weight, 0) pairs: one 32-bit product per lane */
+      __m128i px =
+          _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i *)p), zero);
+      sum = _mm_add_epi32(sum, _mm_madd_epi16(px, _mm_set1_epi32(w[k])));
+    }
+    sum = _mm_srli_epi32(sum, OUT_SHIFT);
+    sum = _mm_packs_epi32(sum, sum);
+    dst[x] = (uint32_t)_mm_cvtsi128_si32(_mm_packus_epi16(sum, sum));
+  }
+}
+#endif
+
+/* --- AVX2 (compiled for the target, used only if the CPU has it) --- */
+
+#if defined(HAVE_AVX2_KERNEL)
+__attribute__((target("avx2"))) static void
+accum_avx2(uint32_t *acc, const uint8_t *row, int n, uint32_t w) {
+  const __m256i wv = _mm256_set1_epi32((int)w);
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256i px =
+        _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(row + i)));
+    __m256i *a = (__m256i *)(acc + i);
+    _mm256_storeu_si256(
+        a, _mm256_add_epi32(_mm256_loadu_si256(a), _mm256_mullo_epi32(px, wv)));
+  }
+  accum_scalar(acc + i, row + i, n - i, w);
+}
+
+__attribute__((target("avx2"))) static void
+narrow_avx2(int16_t *out, const uint32_t *acc, int n) {
+  const __m256i round = _mm256_set1_epi32(1 << (MID_SHIFT - 1));
+  int i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m256i a = _mm256_loadu_si256((const __m256i *)(acc + i));
+    __m256i b = _mm256_loadu_si256((const __m256i *)(acc + i + 8));
+    a = _mm256_srli_epi32(_mm256_add_epi32(a, round), MID_SHIFT);
+    b = _mm256_srli_epi32(_mm256_add_epi32(b, round), MID_SHIFT);
+    /* packs works per 128-bit lane: restore the element order */
+    __m256i p = _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), 0xD8);
+    _mm256_storeu_si256((__m256i *)(out + i), p);
+  }
+  narrow_scalar(out + i, acc + i, n - i);
+}
+#endif
+
+/* --- NEON --- */
+
+#if defined(__ARM_NEON)
+static void accum_neon(uint32_t *acc, const uint8_t *row, int n,
+                       uint32_t w) {
+  int i = 0;
+  for (; i + 16 <= n; i += 16) {
+    uint8x16_t v = vld1q_u8(row + i);
+    uint16x8_t lo = vmovl_u8(vget_low_u8(v));
+    uint16x8_t hi = vmovl_u8(vget_high_u8(v));
+    uint32_t *a = acc + i;
+    vst1q_u32(a, vmlal_n_u16(vld1q_u32(a), vget_low_u16(lo), (uint16_t)w));
+    vst1q_u32(a + 4,
+              vmlal_n_u16(vld1q_u32(a + 4), vget_high_u16(lo), (uint16_t)w));
+    vst1q_u32(a + 8,
+              vmlal_n_u16(vld1q_u32(a + 8), vget_low_u16(hi), (uint16_t)w));
+    vst1q_u32(a + 12,
+              vmlal_n_u16(vld1q_u32(a + 12), vget_high_u16(hi), (uint16_t)w));
+  }
+  accum_scalar(acc + i, row + i, n - i, w);
+}
+
+static void narrow_neon(int16_t *out, const uint32_t *acc, int n) {
+  int i = 0;
+  for (; i + 4 <= n; i += 4)
+    vst1_u16((uint16_t *)(out + i), vrshrn_n_u32(vld1q_u32(acc + i), MID_SHIFT));
+  narrow_scalar(out + i, acc + i, n - i);
+}
+
+static void horiz_neon(uint32_t *dst, const int16_t *mid, const Taps *t,
+                       int dw) {
+  for (int x = 0; x < dw; x++) {
+    const uint16_t *p = (const uint16_t *)(mid + 4 * t->start[x]);
+    const uint16_t *w = &t->weight[(size_t)x * t->max_taps];
+    uint32x4_t sum = vdupq_n_u32(0);
+    for (int k = 0; k < t->count[x]; k++, p += 4)
+      sum = vmlal_n_u16(sum, vld1_u16(p), w[k]);
+    uint16x4_t s16 = vmovn_u32(vrshrq_n_u32(sum, OUT_SHIFT));
+    uint8x8_t s8 = vmovn_u16(vcombine_u16(s16, s16));
+    vst1_lane_u32(&dst[x], vreinterpret_u32_u8(s8), 0);
+  }
+}
+#endif
+
+/* --- Dispatch --- */
+
+static const Kernels kernels[] = {
+    [SCALE_SCALAR] = {accum_scalar, narrow_scalar, horiz_scalar},
+#if defined(__SSE2__)
+    [SCALE_SSE2] = {accum_sse2, narrow_sse2, horiz_sse2},
+#endif
+#if defined(HAVE_AVX2_KERNEL)
+    [SCALE_AVX2] = {accum_avx2, narrow_avx2, horiz_sse2},
+#endif
+#if defined(__ARM_NEON)
+    [SCALE_NEON] = {accum_neon, narrow_neon, horiz_neon},
+#endif
+};
+#define NUM_KERNELS (int)(sizeof(kernels) / sizeof(kernels[0]))
+
+static ScaleIsa active_isa = SCALE_SCALAR;
+static pthread_once_t isa_once = PTHREAD_ONCE_INIT;
+
+static bool isa_supported(ScaleIsa isa) {
+  if ((int)isa >= NUM_KERNELS || !kernels[isa].accum)
+    return false;
+#if defined(HAVE_AVX2_KERNEL)
+  if (isa == SCALE_AVX2)
+    return __builtin_cpu_supports("avx2");
+#endif
+  return true;
+}
+
+static void pick_isa(void) {
+  static const ScaleIsa order[] = {SCALE_AVX2, SCALE_NEON, SCALE_SSE2};
+  for (size_t i = 0; i < sizeof(order) / sizeof(order[0]); i++) {
+    if (isa_supported(order[i])) {
+      active_isa = order[i];
+      return;
+    }
+  }
+}
+
+ScaleIsa scale_get_isa(void) {
+  pthread_once(&isa_once, pick_isa);
+  return active_isa;
+}
+
+bool scale_set_isa(ScaleIsa isa) {
+  pthread_once(&isa_once, pick_isa);
+  if (!isa_supported(isa))
+    return false;
+  active_isa = isa;
+  return true;
+}
+
+const char *scale_isa_name(ScaleIsa isa) {
+  switch (isa) {
+  case SCALE_SCALAR:
+    return "scalar";
+  case SCALE_SSE2:
+    return "sse2";
+  case SCALE_AVX2:
+    return "avx2";
+  case SCALE_NEON:
+    return "neon";
+  }
+  return "?";
+}
+
+bool scale_argb32(const unsigned char *src, int sw, int sh, ptrdiff_t sstride,
+                  unsigned char *dst, int dw, int dh, int dstride,
+                  bool opaque) {
+  if (sw < 1 || sh < 1 || dw < 1 || dh < 1 || dw > sw || dh > sh)
+    return false;
+
+  const Kernels *k = &kernels[scale_get_isa()];
+  int n = sw * 4;
+  Taps tx = {0}, ty = {0};
+  uint32_t *acc = malloc(sizeof(uint32_t) * n);
+  int16_t *mid = malloc(sizeof(int16_t) * n);
+  bool ok = acc && mid && taps_init(&tx, sw, dw) && taps_init(&ty, sh, dh);
+
+  for (int y = 0; ok && y < dh; y++) {
+    memset(acc, 0, sizeof(uint32_t) * n);
+    const uint16_t *w = &ty.weight[(size_t)y * ty.max_taps];
+    for (int j = 0; j < ty.count[y]; j++) {
+      if (w[j])
+        k->accum(acc, src + (ptrdiff_t)(ty.start[y] + j) * sstride, n, w[j]);
+    }
+    k->narrow(mid, acc, n);
+
+    uint32_t *row = (uint32_t *)(dst + (size_t)y * dstride);
+    k->horiz(row, mid, &tx, dw);
+    if (opaque) {
+      for (int x = 0; x < dw; x++)
+        row[x] |= 0xff000000u;
+    }
+  }
+
+  taps_free(&tx);
+  taps_free(&ty);
+  free(acc);
+  free(mid);
+  return ok;
+}
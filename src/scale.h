@@ -0,0 +1,34 @@
+/* src/scale.h - Premultiplied ARGB32 Downscaler */
+#ifndef SCALE_H
+#define SCALE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Area-averaging (box) reduction for premultiplied ARGB32, as used for
+ * icons and window previews. Every output pixel is the coverage-weighted
+ * mean of the source pixels under it, in fixed point. The row passes have
+ * SSE2, AVX2 and NEON versions next to the scalar one; the best the CPU
+ * supports is picked on first use. All of them give identical output.
+ */
+
+typedef enum { SCALE_SCALAR, SCALE_SSE2, SCALE_AVX2, SCALE_NEON } ScaleIsa;
+
+/*
+ * Scale src (sw x sh) into dst (dw x dh). Strides are in bytes; a negative
+ * source stride reads rows bottom-up (y-inverted captures). With opaque
+ * set the source alpha byte is ignored (RGB24/XRGB) and output is opaque.
+ * Only reductions are handled: false if dw > sw or dh > sh (or out of
+ * memory), leaving dst untouched.
+ */
+bool scale_argb32(const unsigned char *src, int sw, int sh, ptrdiff_t sstride,
+                  unsigned char *dst, int dw, int dh, int dstride,
+                  bool opaque);
+
+/* Kernel in use; switching fails if the CPU lacks the instructions */
+ScaleIsa scale_get_isa(void);
+bool scale_set_isa(ScaleIsa isa);
+const char *scale_isa_name(ScaleIsa isa);
+
+#endif /* SCALE_H */
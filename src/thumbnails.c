@@ -0,0 +1,942 @@
+/* src/thumbnails.c - Window Preview Capture & Cache */
+#define _POSIX_C_SOURCE 200809L
+
+#include "thumbnails.h"
+#include "render.h"
+#include "scale.h"
+#include "util.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "hyprland-toplevel-export-v1-client-protocol.h"
+#ifdef HAVE_EXT_CAPTURE
+#include "ext-foreign-toplevel-list-v1-client-protocol.h"
+#include "ext-image-capture-source-v1-client-protocol.h"
+#include "ext-image-copy-capture-v1-client-protocol.h"
+#endif
+
+#define LOG(fmt, ...) fprintf(stderr, "[Thumbs] " fmt "\n", ##__VA_ARGS__)
+
+#define MAX_PENDING 32
+#define RECAPTURE_MS 2000 /* A fresher preview than this isn't retaken */
+
+/* Cached, already downscaled preview */
+typedef struct Thumbnail {
+  char *address;
+  cairo_surface_t *surface; /* ARGB32, premultiplied, device pixels */
+  size_t bytes;
+  unsigned last_used;
+  double captured_ms;
+  struct Thumbnail *next;
+} Thumbnail;
+
+typedef struct {
+  char *address;
+  char *class_name; /* ext-image-copy-capture matches on app_id + title */
+  char *title;
+} CaptureRequest;
+
+#ifdef HAVE_EXT_CAPTURE
+/* Toplevel known through ext-foreign-toplevel-list */
+typedef struct ExtToplevel {
+  struct ext_foreign_toplevel_handle_v1 *handle;
+  char *app_id;
+  char *title;
+  struct ExtToplevel *next;
+} ExtToplevel;
+#endif
+
+static bool enabled = false;
+static size_t cache_cap = 16u << 20;
+static int cache_box_w = 0, cache_box_h = 0; /* Box previews were fit to */
+
+static Thumbnail *thumbs = NULL;
+static size_t total_bytes = 0;
+static unsigned use_clock = 0;
+
+static CaptureRequest queue[MAX_PENDING];
+static int queue_len = 0;
+static CaptureRequest focused; /* Window that currently has focus */
+
+static void (*ready_handler)(const char *address) = NULL;
+
+/* Capture globals */
+static struct hyprland_toplevel_export_manager_v1 *hl_export = NULL;
+#ifdef HAVE_EXT_CAPTURE
+static struct ext_foreign_toplevel_list_v1 *ext_list = NULL;
+static struct wl_registry *ext_list_registry = NULL; /* Where it was seen */
+static uint32_t ext_list_name = 0;
+static struct ext_foreign_toplevel_image_capture_source_manager_v1
+    *ext_sources = NULL;
+static struct ext_image_copy_capture_manager_v1 *ext_copy = NULL;
+static ExtToplevel *ext_toplevels = NULL;
+#endif
+
+/* The one capture in flight: either a Hyprland export frame or an ext
+ * source + session + frame */
+static struct {
+  bool active;
+  CaptureRequest req;
+  struct wl_buffer *buffer;
+  void *data;
+  size_t size;
+  uint32_t format, width, height, stride;
+  uint32_t transform; /* wl_output_transform of the buffer contents */
+  struct hyprland_toplevel_export_frame_v1 *hl_frame;
+#ifdef HAVE_EXT_CAPTURE
+  struct ext_image_capture_source_v1 *source;
+  struct ext_image_copy_capture_session_v1 *session;
+  struct ext_image_copy_capture_frame_v1 *frame;
+#endif
+} cap;
+
+static void start_next(void);
+
+static void request_free(CaptureRequest *req) {
+  free(req->address);
+  free(req->class_name);
+  free(req->title);
+  memset(req, 0, sizeof(*req));
+}
+
+static bool request_set(CaptureRequest *req, const char *address,
+                        const char *class_name, const char *title) {
+  request_free(req);
+  req->address = strdup(address);
+  req->class_name = strdup(class_name ? class_name : "");
+  req->title = strdup(title ? title : "");
+  if (!req->address || !req->class_name || !req->title) {
+    request_free(req);
+    return false;
+  }
+  return true;
+}
+
+/* --- Cache --- */
+
+static Thumbnail *find_thumb(const char *address, Thumbnail ***link) {
+  Thumbnail **prev = &thumbs;
+  for (Thumbnail *t = thumbs; t; prev = &t->next, t = t->next) {
+    if (strcmp(t->address, address) == 0) {
+      if (link)
+        *link = prev;
+      return t;
+    }
+  }
+  return NULL;
+}
+
+static void unlink_thumb(Thumbnail **link) {
+  Thumbnail *t = *link;
+  *link = t->next;
+  total_bytes -= t->bytes;
+  cairo_surface_destroy(t->surface);
+  free(t->address);
+  free(t);
+}
+
+static void evict_to(size_t budget) {
+  while (total_bytes > budget && thumbs) {
+    Thumbnail **oldest = &thumbs;
+    for (Thumbnail **link = &thumbs; *link; link = &(*link)->next) {
+      if ((*link)->last_used < (*oldest)->last_used)
+        oldest = link;
+    }
+    unlink_thumb(oldest);
+  }
+}
+
+static void clear_cache(void) {
+  while (thumbs)
+    unlink_thumb(&thumbs);
+}
+
+static void store(const char *address, cairo_surface_t *surface) {
+  size_t bytes = (size_t)cairo_image_surface_get_stride(surface) *
+                 cairo_image_surface_get_height(surface);
+  if (bytes > cache_cap) {
+    cairo_surface_destroy(surface);
+    return;
+  }
+
+  Thumbnail **link;
+  if (find_thumb(address, &link))
+    unlink_thumb(link);
+  evict_to(cache_cap - bytes);
+
+  Thumbnail *t = calloc(1, sizeof(Thumbnail));
+  if (!t || !(t->address = strdup(address))) {
+    free(t);
+    cairo_surface_destroy(surface);
+    return;
+  }
+  t->surface = surface;
+  t->bytes = bytes;
+  t->last_used = ++use_clock;
+  t->captured_ms = now_ms();
+  t->next = thumbs;
+  thumbs = t;
+  total_bytes += bytes;
+}
+
+/*
+ * Where the upright image starts in the capture, and the byte steps from
+ * one upright pixel to the next along x and y, for a buffer stored with
+ * the given wl_output_transform (the buffer_transform mapping of
+ * wl_surface). w and h are the upright size.
+ */
+static size_t transform_steps(uint32_t transform, int w, int h,
+                              ptrdiff_t *step_x, ptrdiff_t *step_y) {
+  ptrdiff_t px = 4, row = cap.stride;
+  size_t right = (size_t)(w - 1) * 4, bottom = (size_t)(h - 1) * row;
+  switch (transform) {
+  case WL_OUTPUT_TRANSFORM_90:
+    *step_x = -row;
+    *step_y = px;
+    return (size_t)(w - 1) * row;
+  case WL_OUTPUT_TRANSFORM_180:
+    *step_x = -px;
+    *step_y = -row;
+    return bottom + right;
+  case WL_OUTPUT_TRANSFORM_270:
+    *step_x = row;
+    *step_y = -px;
+    return (size_t)(h - 1) * px;
+  case WL_OUTPUT_TRANSFORM_FLIPPED:
+    *step_x = -px;
+    *step_y = row;
+    return right;
+  case WL_OUTPUT_TRANSFORM_FLIPPED_90:
+    *step_x = row;
+    *step_y = px;
+    return 0;
+  case WL_OUTPUT_TRANSFORM_FLIPPED_180:
+    *step_x = px;
+    *step_y = -row;
+    return bottom;
+  case WL_OUTPUT_TRANSFORM_FLIPPED_270:
+    *step_x = -row;
+    *step_y = -px;
+    return (size_t)(w - 1) * row + (size_t)(h - 1) * px;
+  default:
+    *step_x = px;
+    *step_y = row;
+    return 0;
+  }
+}
+
+/* Downscale the captured buffer once into the card's preview box */
+static cairo_surface_t *downscale(void) {
+  int box_w, box_h;
+  render_thumbnail_size(&box_w, &box_h);
+  if (box_w <= 0 || box_h <= 0 || cap.width == 0 || cap.height == 0)
+    return NULL;
+
+  /* 90 and 270 degree transforms swap the sides */
+  bool swap = cap.transform & 1;
+  int src_w = swap ? cap.height : cap.width;
+  int src_h = swap ? cap.width : cap.height;
+
+  double s = fmin((double)box_w / src_w, (double)box_h / src_h);
+  if (s > 1.0)
+    s = 1.0;
+  int w = (int)lround(src_w * s);
+  int h = (int)lround(src_h * s);
+  if (w < 1 || h < 1)
+    return NULL;
+
+  /* Mirrored rows are read bottom-up in place; anything that moves
+   * pixels across rows is first copied out upright */
+  ptrdiff_t step_x, stride;
+  const unsigned char *rows =
+      (unsigned char *)cap.data +
+      transform_steps(cap.transform, src_w, src_h, &step_x, &stride);
+  unsigned char *upright = NULL;
+  if (step_x != 4) {
+    upright = malloc((size_t)src_w * src_h * 4);
+    if (!upright)
+      return NULL;
+    unsigned char *out = upright;
+    for (int y = 0; y < src_h; y++) {
+      const unsigned char *in = rows + y * stride;
+      for (int x = 0; x < src_w; x++, in += step_x, out += 4)
+        memcpy(out, in, 4);
+    }
+    rows = upright;
+    stride = (ptrdiff_t)src_w * 4;
+  }
+
+  cairo_surface_t *dst = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, w, h);
+  if (cairo_surface_status(dst) != CAIRO_STATUS_SUCCESS) {
+    cairo_surface_destroy(dst);
+    free(upright);
+    return NULL;
+  }
+
+  /* Box-filter kernel straight from the shm buffer */
+  cairo_surface_flush(dst);
+  if (scale_argb32(rows, src_w, src_h, stride,
+                   cairo_image_surface_get_data(dst), w, h,
+                   cairo_image_surface_get_stride(dst),
+                   cap.format == WL_SHM_FORMAT_XRGB8888)) {
+    cairo_surface_mark_dirty(dst);
+    free(upright);
+    return dst;
+  }
+
+  /* cairo wants a positive stride: a y-inverted buffer is flipped by the
+   * matrix instead */
+  bool flip = stride < 0;
+  cairo_surface_t *src = cairo_image_surface_create_for_data(
+      flip ? cap.data : (unsigned char *)rows,
+      cap.format == WL_SHM_FORMAT_XRGB8888 ? CAIRO_FORMAT_RGB24
+                                           : CAIRO_FORMAT_ARGB32,
+      src_w, src_h, flip ? -stride : stride);
+  cairo_t *cr = cairo_create(dst);
+  if (flip) {
+    cairo_translate(cr, 0, h);
+    cairo_scale(cr, 1, -1);
+  }
+  cairo_scale(cr, (double)w / src_w, (double)h / src_h);
+  cairo_set_source_surface(cr, src, 0, 0);
+  cairo_pattern_set_filter(cairo_get_source(cr), CAIRO_FILTER_GOOD);
+  cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
+  cairo_paint(cr);
+  cairo_destroy(cr);
+  cairo_surface_destroy(src);
+  free(upright);
+
+  if (cairo_surface_status(dst) != CAIRO_STATUS_SUCCESS) {
+    cairo_surface_destroy(dst);
+    return NULL;
+  }
+  cairo_surface_flush(dst);
+  return dst;
+}
+
+/* --- Capture --- */
+
+static bool alloc_buffer(void) {
+  cap.size = (size_t)cap.stride * cap.height;
+  int fd = create_shm_file(cap.size);
+  if (fd < 0)
+    return false;
+
+  cap.data = mmap(NULL, cap.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (cap.data == MAP_FAILED) {
+    cap.data = NULL;
+    close(fd);
+    return false;
+  }
+
+  struct wl_shm_pool *pool = wl_shm_create_pool(shm, fd, cap.size);
+  cap.buffer = wl_shm_pool_create_buffer(pool, 0, cap.width, cap.height,
+                                         cap.stride, cap.format);
+  wl_shm_pool_destroy(pool);
+  close(fd);
+  return cap.buffer != NULL;
+}
+
+static void finish_capture(bool ok) {
+  if (ok && enabled) {
+    cairo_surface_t *thumb = downscale();
+    if (thumb) {
+      LOG("Captured %s (%dx%d)", cap.req.address,
+          cairo_image_surface_get_width(thumb),
+          cairo_image_surface_get_height(thumb));
+      store(cap.req.address, thumb);
+      if (ready_handler)
+        ready_handler(cap.req.address);
+    }
+  } else if (!ok) {
+    LOG("Capture failed: %s", cap.req.address);
+  }
+
+  if (cap.hl_frame)
+    hyprland_toplevel_export_frame_v1_destroy(cap.hl_frame);
+#ifdef HAVE_EXT_CAPTURE
+  if (cap.frame)
+    ext_image_copy_capture_frame_v1_destroy(cap.frame);
+  if (cap.session)
+    ext_image_copy_capture_session_v1_destroy(cap.session);
+  if (cap.source)
+    ext_image_capture_source_v1_destroy(cap.source);
+#endif
+  if (cap.buffer)
+    wl_buffer_destroy(cap.buffer);
+  if (cap.data)
+    munmap(cap.data, cap.size);
+  request_free(&cap.req);
+  memset(&cap, 0, sizeof(cap));
+
+  start_next();
+}
+
+static bool usable_format(uint32_t format) {
+  return format == WL_SHM_FORMAT_ARGB8888 || format == WL_SHM_FORMAT_XRGB8888;
+}
+
+/* hyprland-toplevel-export-v1 */
+
+static void hl_buffer(void *data, struct hyprland_toplevel_export_frame_v1 *f,
+                      uint32_t format, uint32_t width, uint32_t height,
+                      uint32_t stride) {
+  (void)data;
+  (void)f;
+  if (cap.format == 0 && cap.width == 0 && usable_format(format)) {
+    cap.format = format;
+    cap.width = width;
+    cap.height = height;
+    cap.stride = stride;
+  }
+}
+
+static void hl_damage(void *data, struct hyprland_toplevel_export_frame_v1 *f,
+                      uint32_t x, uint32_t y, uint32_t w, uint32_t h) {
+  (void)data;
+  (void)f;
+  (void)x;
+  (void)y;
+  (void)w;
+  (void)h;
+}
+
+static void hl_flags(void *data, struct hyprland_toplevel_export_frame_v1 *f,
+                     uint32_t flags) {
+  (void)data;
+  (void)f;
+  cap.transform = flags & HYPRLAND_TOPLEVEL_EXPORT_FRAME_V1_FLAGS_Y_INVERT
+                      ? WL_OUTPUT_TRANSFORM_FLIPPED_180
+                      : WL_OUTPUT_TRANSFORM_NORMAL;
+}
+
+static void hl_ready(void *data, struct hyprland_toplevel_export_frame_v1 *f,
+                     uint32_t sec_hi, uint32_t sec_lo, uint32_t nsec) {
+  (void)data;
+  (void)f;
+  (void)sec_hi;
+  (void)sec_lo;
+  (void)nsec;
+  finish_capture(true);
+}
+
+static void hl_failed(void *data,
+                      struct hyprland_toplevel_export_frame_v1 *f) {
+  (void)data;
+  (void)f;
+  finish_capture(false);
+}
+
+static void hl_linux_dmabuf(void *data,
+                            struct hyprland_toplevel_export_frame_v1 *f,
+                            uint32_t format, uint32_t width, uint32_t height) {
+  (void)data;
+  (void)f;
+  (void)format;
+  (void)width;
+  (void)height;
+}
+
+static void hl_buffer_done(void *data,
+                           struct hyprland_toplevel_export_frame_v1 *f) {
+  (void)data;
+  if (cap.width == 0 || !alloc_buffer()) {
+    finish_capture(false);
+    return;
+  }
+  hyprland_toplevel_export_frame_v1_copy(f, cap.buffer, 1);
+}
+
+static const struct hyprland_toplevel_export_frame_v1_listener hl_listener = {
+    .buffer = hl_buffer,
+    .damage = hl_damage,
+    .flags = hl_flags,
+    .ready = hl_ready,
+    .failed = hl_failed,
+    .linux_dmabuf = hl_linux_dmabuf,
+    .buffer_done = hl_buffer_done,
+};
+
+/* Hyprland identifies windows by the low 32 bits of their address */
+static bool start_hyprland(void) {
+  char *end;
+  unsigned long long addr = strtoull(cap.req.address, &end, 16);
+  if (end == cap.req.address || addr == 0)
+    return false;
+  cap.hl_frame = hyprland_toplevel_export_manager_v1_capture_toplevel(
+      hl_export, 0, (uint32_t)(addr & 0xffffffffu));
+  hyprland_toplevel_export_frame_v1_add_listener(cap.hl_frame, &hl_listener,
+                                                 NULL);
+  return true;
+}
+
+#ifdef HAVE_EXT_CAPTURE
+/* ext-image-copy-capture-v1 */
+
+static void session_buffer_size(void *data,
+                                struct ext_image_copy_capture_session_v1 *s,
+                                uint32_t width, uint32_t height) {
+  (void)data;
+  (void)s;
+  cap.width = width;
+  cap.height = height;
+  cap.stride = width * 4;
+}
+
+static void session_shm_format(void *data,
+                               struct ext_image_copy_capture_session_v1 *s,
+                               uint32_t format) {
+  (void)data;
+  (void)s;
+  if (cap.format == 0 && usable_format(format))
+    cap.format = format;
+}
+
+static void session_dmabuf_device(void *data,
+                                  struct ext_image_copy_capture_session_v1 *s,
+                                  struct wl_array *device) {
+  (void)data;
+  (void)s;
+  (void)device;
+}
+
+static void session_dmabuf_format(void *data,
+                                  struct ext_image_copy_capture_session_v1 *s,
+                                  uint32_t format, struct wl_array *modifiers) {
+  (void)data;
+  (void)s;
+  (void)format;
+  (void)modifiers;
+}
+
+static void frame_transform(void *data, struct ext_image_copy_capture_frame_v1 *f,
+                            uint32_t transform) {
+  (void)data;
+  (void)f;
+  cap.transform = transform;
+}
+
+static void frame_damage(void *data, struct ext_image_copy_capture_frame_v1 *f,
+                         int32_t x, int32_t y, int32_t w, int32_t h) {
+  (void)data;
+  (void)f;
+  (void)x;
+  (void)y;
+  (void)w;
+  (void)h;
+}
+
+static void frame_presentation_time(void *data,
+                                    struct ext_image_copy_capture_frame_v1 *f,
+                                    uint32_t sec_hi, uint32_t sec_lo,
+                                    uint32_t nsec) {
+  (void)data;
+  (void)f;
+  (void)sec_hi;
+  (void)sec_lo;
+  (void)nsec;
+}
+
+static void frame_ready(void *data, struct ext_image_copy_capture_frame_v1 *f) {
+  (void)data;
+  (void)f;
+  finish_capture(true);
+}
+
+static void frame_failed(void *data, struct ext_image_copy_capture_frame_v1 *f,
+                         uint32_t reason) {
+  (void)data;
+  (void)f;
+  (void)reason;
+  finish_capture(false);
+}
+
+static const struct ext_image_copy_capture_frame_v1_listener frame_listener = {
+    .transform = frame_transform,
+    .damage = frame_damage,
+    .presentation_time = frame_presentation_time,
+    .ready = frame_ready,
+    .failed = frame_failed,
+};
+
+/* Constraints are complete: allocate and capture one frame */
+static void session_done(void *data,
+                         struct ext_image_copy_capture_session_v1 *s) {
+  (void)data;
+  if (cap.frame)
+    return; /* Constraints changed mid-capture; the frame will fail */
+  if (cap.width == 0 || cap.format == 0 || !alloc_buffer()) {
+    finish_capture(false);
+    return;
+  }
+  cap.frame = ext_image_copy_capture_session_v1_create_frame(s);
+  ext_image_copy_capture_frame_v1_add_listener(cap.frame, &frame_listener,
+                                               NULL);
+  ext_image_copy_capture_frame_v1_attach_buffer(cap.frame, cap.buffer);
+  ext_image_copy_capture_frame_v1_damage_buffer(cap.frame, 0, 0, cap.width,
+                                                cap.height);
+  ext_image_copy_capture_frame_v1_capture(cap.frame);
+}
+
+static void session_stopped(void *data,
+                            struct ext_image_copy_capture_session_v1 *s) {
+  (void)data;
+  (void)s;
+  finish_capture(false);
+}
+
+static const struct ext_image_copy_capture_session_v1_listener
+    session_listener = {
+        .buffer_size = session_buffer_size,
+        .shm_format = session_shm_format,
+        .dmabuf_device = session_dmabuf_device,
+        .dmabuf_format = session_dmabuf_format,
+        .done = session_done,
+        .stopped = session_stopped,
+};
+
+/* ext handles carry no backend address: match app_id + title, or the
+ * app_id alone when only one window has it */
+static ExtToplevel *match_ext_toplevel(const CaptureRequest *req) {
+  ExtToplevel *by_class = NULL;
+  int class_matches = 0;
+  for (ExtToplevel *t = ext_toplevels; t; t = t->next) {
+    if (!t->app_id || strcmp(t->app_id, req->class_name) != 0)
+      continue;
+    if (t->title && strcmp(t->title, req->title) == 0)
+      return t;
+    by_class = t;
+    class_matches++;
+  }
+  return class_matches == 1 ? by_class : NULL;
+}
+
+static bool start_ext(void) {
+  ExtToplevel *t = match_ext_toplevel(&cap.req);
+  if (!t)
+    return false;
+  cap.source = ext_foreign_toplevel_image_capture_source_manager_v1_create_source(
+      ext_sources, t->handle);
+  cap.session =
+      ext_image_copy_capture_manager_v1_create_session(ext_copy, cap.source, 0);
+  ext_image_copy_capture_session_v1_add_listener(cap.session,
+                                                 &session_listener, NULL);
+  return true;
+}
+
+#endif /* HAVE_EXT_CAPTURE */
+
+static bool can_capture(void) {
+#ifdef HAVE_EXT_CAPTURE
+  return shm && (hl_export || (ext_list && ext_sources && ext_copy));
+#else
+  return shm && hl_export;
+#endif
+}
+
+static void start_next(void) {
+  while (!cap.active && queue_len > 0 && enabled && can_capture()) {
+    cap.req = queue[0];
+    memmove(queue, queue + 1, (queue_len - 1) * sizeof(CaptureRequest));
+    queue_len--;
+    memset(&queue[queue_len], 0, sizeof(CaptureRequest));
+
+#ifdef HAVE_EXT_CAPTURE
+    cap.active = hl_export ? start_hyprland() : start_ext();
+#else
+    cap.active = start_hyprland();
+#endif
+    if (!cap.active)
+      request_free(&cap.req);
+  }
+}
+
+static void enqueue(const CaptureRequest *req) {
+  if (!enabled || !can_capture() || !req->address || !req->address[0])
+    return;
+
+  Thumbnail *t = find_thumb(req->address, NULL);
+  if (t && now_ms() - t->captured_ms < RECAPTURE_MS)
+    return;
+  if (cap.active && strcmp(cap.req.address, req->address) == 0)
+    return;
+  for (int i = 0; i < queue_len; i++) {
+    if (strcmp(queue[i].address, req->address) == 0)
+      return;
+  }
+  if (queue_len == MAX_PENDING)
+    return;
+
+  CaptureRequest *slot = &queue[queue_len];
+  memset(slot, 0, sizeof(*slot));
+  if (!request_set(slot, req->address, req->class_name, req->title))
+    return;
+  queue_len++;
+  start_next();
+}
+
+/* --- ext-foreign-toplevel-list --- */
+
+#ifdef HAVE_EXT_CAPTURE
+
+static void ext_handle_closed(void *data,
+                              struct ext_foreign_toplevel_handle_v1 *handle) {
+  ExtToplevel *dead = data;
+  for (ExtToplevel **link = &ext_toplevels; *link; link = &(*link)->next) {
+    if (*link == dead) {
+      *link = dead->next;
+      break;
+    }
+  }
+  ext_foreign_toplevel_handle_v1_destroy(handle);
+  free(dead->app_id);
+  free(dead->title);
+  free(dead);
+}
+
+static void ext_handle_done(void *data,
+                            struct ext_foreign_toplevel_handle_v1 *handle) {
+  (void)data;
+  (void)handle;
+}
+
+static void ext_handle_title(void *data,
+                             struct ext_foreign_toplevel_handle_v1 *handle,
+                             const char *title) {
+  ExtToplevel *t = data;
+  (void)handle;
+  free(t->title);
+  t->title = strdup(title ? title : "");
+}
+
+static void ext_handle_app_id(void *data,
+                              struct ext_foreign_toplevel_handle_v1 *handle,
+                              const char *app_id) {
+  ExtToplevel *t = data;
+  (void)handle;
+  free(t->app_id);
+  t->app_id = strdup(app_id ? app_id : "");
+}
+
+static void ext_handle_identifier(void *data,
+                                  struct ext_foreign_toplevel_handle_v1 *handle,
+                                  const char *identifier) {
+  (void)data;
+  (void)handle;
+  (void)identifier;
+}
+
+static const struct ext_foreign_toplevel_handle_v1_listener
+    ext_handle_listener = {
+        .closed = ext_handle_closed,
+        .done = ext_handle_done,
+        .title = ext_handle_title,
+        .app_id = ext_handle_app_id,
+        .identifier = ext_handle_identifier,
+};
+
+static void ext_list_toplevel(void *data, struct ext_foreign_toplevel_list_v1 *l,
+                              struct ext_foreign_toplevel_handle_v1 *handle) {
+  (void)data;
+  (void)l;
+  ExtToplevel *t = calloc(1, sizeof(ExtToplevel));
+  if (!t) {
+    ext_foreign_toplevel_handle_v1_destroy(handle);
+    return;
+  }
+  t->handle = handle;
+  t->next = ext_toplevels;
+  ext_toplevels = t;
+  ext_foreign_toplevel_handle_v1_add_listener(handle, &ext_handle_listener, t);
+}
+
+static void ext_list_finished(void *data,
+                              struct ext_foreign_toplevel_list_v1 *l) {
+  (void)data;
+  ext_foreign_toplevel_list_v1_destroy(l);
+  ext_list = NULL;
+  ext_list_registry = NULL; /* Gone for good: don't bind it again */
+}
+
+static const struct ext_foreign_toplevel_list_v1_listener ext_list_listener = {
+    .toplevel = ext_list_toplevel,
+    .finished = ext_list_finished,
+};
+
+/* The list streams every toplevel's title and app_id for as long as it is
+ * bound, so it is only bound while previews are on */
+static void bind_ext_list(void) {
+  if (ext_list || !ext_list_registry)
+    return;
+  ext_list = wl_registry_bind(ext_list_registry, ext_list_name,
+                              &ext_foreign_toplevel_list_v1_interface, 1);
+  ext_foreign_toplevel_list_v1_add_listener(ext_list, &ext_list_listener,
+                                            NULL);
+}
+
+static void drop_ext_list(void) {
+  while (ext_toplevels) {
+    ExtToplevel *t = ext_toplevels;
+    ext_toplevels = t->next;
+    ext_foreign_toplevel_handle_v1_destroy(t->handle);
+    free(t->app_id);
+    free(t->title);
+    free(t);
+  }
+  if (ext_list) {
+    ext_foreign_toplevel_list_v1_destroy(ext_list);
+    ext_list = NULL;
+  }
+}
+#else
+static void bind_ext_list(void) {}
+static void drop_ext_list(void) {}
+#endif /* HAVE_EXT_CAPTURE */
+
+/* --- Public API --- */
+
+bool thumbnails_bind(struct wl_registry *registry, uint32_t name,
+                     const char *interface, uint32_t version) {
+  (void)version;
+  if (strcmp(interface, hyprland_toplevel_export_manager_v1_interface.name) ==
+      0) {
+    hl_export = wl_registry_bind(
+        registry, name, &hyprland_toplevel_export_manager_v1_interface, 1);
+#ifdef HAVE_EXT_CAPTURE
+  } else if (strcmp(interface, ext_foreign_toplevel_list_v1_interface.name) ==
+             0) {
+    ext_list_registry = registry;
+    ext_list_name = name;
+    if (enabled)
+      bind_ext_list();
+  } else if (strcmp(interface,
+                    ext_foreign_toplevel_image_capture_source_manager_v1_interface
+                        .name) == 0) {
+    ext_sources = wl_registry_bind(
+        registry, name,
+        &ext_foreign_toplevel_image_capture_source_manager_v1_interface, 1);
+  } else if (strcmp(interface,
+                    ext_image_copy_capture_manager_v1_interface.name) == 0) {
+    ext_copy = wl_registry_bind(registry, name,
+                                &ext_image_copy_capture_manager_v1_interface, 1);
+#endif
+  } else {
+    return false;
+  }
+  return true;
+}
+
+void thumbnails_set_config(Config *config) {
+  enabled = config ? config->show_thumbnails : false;
+  cache_cap = (size_t)(config ? config->thumbnail_cache_mb : 16) << 20;
+
+  /* Previews are downscaled to fit the card once, so a new card layout
+   * needs new captures */
+  int w, h;
+  render_thumbnail_size(&w, &h);
+  if (w != cache_box_w || h != cache_box_h)
+    clear_cache();
+  cache_box_w = w;
+  cache_box_h = h;
+
+  if (!enabled) {
+    clear_cache();
+    for (int i = 0; i < queue_len; i++)
+      request_free(&queue[i]);
+    queue_len = 0;
+    drop_ext_list();
+  } else {
+    evict_to(cache_cap);
+    bind_ext_list();
+  }
+
+  if (enabled && !can_capture())
+    LOG("No toplevel capture protocol: previews disabled");
+}
+
+void thumbnails_window_event(const WindowEvent *event) {
+  if (!event || !event->address)
+    return;
+
+  switch (event->type) {
+  case WINDOW_EVENT_FOCUS:
+    if (focused.address && strcmp(focused.address, event->address) == 0)
+      break;
+    /* The window being left is captured: its content is settled and it
+     * is still mapped, unlike at show time when speed matters */
+    if (focused.address)
+      enqueue(&focused);
+    request_set(&focused, event->address, event->class_name, event->title);
+    break;
+  case WINDOW_EVENT_TITLE:
+    if (focused.address && strcmp(focused.address, event->address) == 0 &&
+        event->title) {
+      free(focused.title);
+      focused.title = strdup(event->title);
+    }
+    break;
+  case WINDOW_EVENT_CLOSE: {
+    Thumbnail **link;
+    if (find_thumb(event->address, &link))
+      unlink_thumb(link);
+    if (focused.address && strcmp(focused.address, event->address) == 0)
+      request_free(&focused);
+    break;
+  }
+  default:
+    break;
+  }
+}
+
+cairo_surface_t *thumbnails_get(const char *address) {
+  if (!enabled || !address)
+    return NULL;
+  Thumbnail *t = find_thumb(address, NULL);
+  if (!t)
+    return NULL;
+  t->last_used = ++use_clock;
+  return t->surface;
+}
+
+cairo_surface_t *thumbnails_peek(const char *address) {
+  if (!enabled || !address)
+    return NULL;
+  Thumbnail *t = find_thumb(address, NULL);
+  return t ? t->surface : NULL;
+}
+
+void thumbnails_set_ready_handler(void (*handler)(const char *address)) {
+  ready_handler = handler;
+}
+
+void thumbnails_cleanup(void) {
+  enabled = false; /* finish_capture() must not store or chain */
+  if (cap.active)
+    finish_capture(false);
+  for (int i = 0; i < queue_len; i++)
+    request_free(&queue[i]);
+  queue_len = 0;
+  request_free(&focused);
+  clear_cache();
+
+  drop_ext_list();
+#ifdef HAVE_EXT_CAPTURE
+  ext_list_registry = NULL;
+  if (ext_sources) {
+    ext_foreign_toplevel_image_capture_source_manager_v1_destroy(ext_sources);
+    ext_sources = NULL;
+  }
+  if (ext_copy) {
+    ext_image_copy_capture_manager_v1_destroy(ext_copy);
+    ext_copy = NULL;
+  }
+#endif
+  if (hl_export) {
+    hyprland_toplevel_export_manager_v1_destroy(hl_export);
+    hl_export = NULL;
+  }
+}
@@ -0,0 +1,41 @@
+/* src/thumbnails.h - Window Preview Capture & Cache */
+#ifndef THUMBNAILS_H
+#define THUMBNAILS_H
+
+#include "backend.h"
+#include "config.h"
+#include <cairo/cairo.h>
+#include <stdbool.h>
+#include <wayland-client.h>
+
+/*
+ * Previews are captured in the background (hyprland-toplevel-export-v1 on
+ * Hyprland, ext-image-copy-capture-v1 elsewhere), downscaled once to the
+ * card's preview box and kept in a byte-capped LRU cache. Nothing here
+ * ever blocks: a card without a cached preview just shows its icon.
+ */
+
+/* Bind capture globals from registry_global; true if `interface` was ours */
+bool thumbnails_bind(struct wl_registry *registry, uint32_t name,
+                     const char *interface, uint32_t version);
+
+/* Enable/disable and apply the memory cap (NULL: defaults) */
+void thumbnails_set_config(Config *config);
+
+/* Feed backend events: a window losing focus is (re)captured, a closed
+ * one dropped */
+void thumbnails_window_event(const WindowEvent *event);
+
+/* Cached preview for a window (borrowed reference), or NULL */
+cairo_surface_t *thumbnails_get(const char *address);
+
+/* Same without marking it recently used; safe from render threads */
+cairo_surface_t *thumbnails_peek(const char *address);
+
+/* Called after a capture lands, e.g. to repaint that card */
+void thumbnails_set_ready_handler(void (*handler)(const char *address));
+
+/* Cancel captures and free the cache */
+void thumbnails_cleanup(void);
+
+#endif /* THUMBNAILS_H */
@@ -0,0 +1,14 @@
+/* src/util.h - Small Shared Helpers */
+#ifndef UTIL_H
+#define UTIL_H
+
+#include <time.h>
+
+/* Monotonic clock in milliseconds, for timing and timeouts */
+static inline double now_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+#endif /* UTIL_H */
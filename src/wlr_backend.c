@@ -30,6 +30,9 @@ struct WindowNode {
   int is_active;
   int is_minimized;
   uint64_t activation_serial; /* window activation serial */
+  int announced;              /* first done received (reported as open) */
+  int title_changed;          /* title updated since the last done */
+  int activated;              /* became active since the last done */
   WindowNode *next;
 };
 
@@ -47,6 +50,20 @@ typedef struct {
 
 static WlrBackendState backend_state = {0};
 
+/* Live update receiver, only set inside wlr_dispatch_events() */
+static WindowEventHandler event_handler = NULL;
+
+static void emit_event(WindowEventType type, WindowNode *window) {
+  if (!event_handler)
+    return;
+  WindowEvent ev = {0};
+  ev.type = type;
+  ev.address = window->identifier ? window->identifier : "";
+  ev.title = window->title ? window->title : "Untitled";
+  ev.class_name = window->app_id ? window->app_id : "unknown";
+  event_handler(&ev);
+}
+
 // move window to the front of the activation history list
 static void move_window_to_front(WindowNode *window) {
   if (!window || !backend_state.windows || window == backend_state.windows) {
@@ -115,6 +132,7 @@ toplevel_handle_title(void *data,
   if (window->title)
     free(window->title);
   window->title = strdup(title ? title : "");
+  window->title_changed = 1;
   LOG("Window title updated: %s", window->title);
 }
 
@@ -179,6 +197,7 @@ toplevel_handle_state(void *data,
   if (window->is_active && !was_active) {
     LOG("Window became active: %s", window->title);
     move_window_to_front(window);
+    window->activated = 1;
   }
 }
 
@@ -190,6 +209,19 @@ toplevel_handle_done(void *data,
 
   LOG("Window done: %s (app_id: %s)", window->title, window->app_id);
   backend_state.needs_refresh = 1;
+
+  /* done closes an atomic batch of property updates */
+  if (!window->announced) {
+    window->announced = 1;
+    if (!window->is_minimized)
+      emit_event(WINDOW_EVENT_OPEN, window);
+  } else if (window->title_changed) {
+    emit_event(WINDOW_EVENT_TITLE, window);
+  }
+  if (window->activated)
+    emit_event(WINDOW_EVENT_FOCUS, window);
+  window->title_changed = 0;
+  window->activated = 0;
 }
 
 static void
@@ -199,6 +231,8 @@ toplevel_handle_closed(void *data,
   (void)toplevel;
 
   LOG("Window closed: %s", window->title);
+  if (window->announced)
+    emit_event(WINDOW_EVENT_CLOSE, window);
 
   WindowNode **prev = &backend_state.windows;
   WindowNode *curr = backend_state.windows;
@@ -461,6 +495,9 @@ int wlr_get_windows(AppState *state, Config *config) {
       continue;
     }
 
+    memset(&info, 0, sizeof(info));
+    info.monitor_id = -1;
+
     info.address = strdup(curr->identifier ? curr->identifier : "");
     info.title = strdup(curr->title ? curr->title : "Untitled");
     info.class_name = strdup(curr->app_id ? curr->app_id : "unknown");
@@ -548,4 +585,28 @@ void wlr_activate_window(const char *identifier) {
   LOG("Window not found: %s", identifier);
 }
 
+int wlr_get_event_fd(void) {
+  if (!backend_state.initialized)
+    return -1;
+  return wl_display_get_fd(backend_state.display);
+}
+
+void wlr_dispatch_events(WindowEventHandler handler) {
+  if (!backend_state.initialized)
+    return;
+
+  event_handler = handler;
+  if (wl_display_prepare_read(backend_state.display) == 0) {
+    struct pollfd pfd = {.fd = wl_display_get_fd(backend_state.display),
+                         .events = POLLIN};
+    if (poll(&pfd, 1, 0) > 0 && (pfd.revents & POLLIN))
+      wl_display_read_events(backend_state.display);
+    else
+      wl_display_cancel_read(backend_state.display);
+  }
+  wl_display_dispatch_pending(backend_state.display);
+  wl_display_flush(backend_state.display);
+  event_handler = NULL;
+}
+
 const char *wlr_get_name(void) { return "wlr"; }
\ No newline at end of file
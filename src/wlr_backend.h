@@ -17,6 +17,12 @@ int wlr_get_windows(AppState *state, Config *config);
 /* Activate window via wlr protocol */
 void wlr_activate_window(const char *identifier);
 
+/* Display fd of the backend's own Wayland connection */
+int wlr_get_event_fd(void);
+
+/* Dispatch toplevel events, reporting opened/closed/retitled windows */
+void wlr_dispatch_events(WindowEventHandler handler);
+
 /* Get backend name */
 const char *wlr_get_name(void);
 